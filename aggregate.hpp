@@ -0,0 +1,76 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   aggregate.hpp
+*   @brief  Streaming statistics for the sensor readings taken between two reports.  Each Welford accumulator
+*           keeps the count, min, max, running mean and sum of squared differences (Welford's method, which
+*           doesn't lose precision the way sum/sum-of-squares does) so a window of any length uses the same
+*           few bytes.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#ifndef __AGGREGATE_HPP__
+#define __AGGREGATE_HPP__
+
+#include <stdint.h>
+#include <math.h>
+
+//the sensor values that are aggregated
+typedef enum agg_field_t {
+    AGG_ADC=0,
+    AGG_TEMPERATURE,
+    AGG_PRESSURE,
+    AGG_HUMIDITY,
+    AGG_COUNT
+    } agg_field;
+
+typedef struct agg_stats_t {
+    uint32_t count;         //samples in the window, the other values are only valid when count > 0
+    double   min;
+    double   max;
+    double   mean;
+    double   stddev;        //sample standard deviation, 0 with fewer than 2 samples
+    } agg_stats;
+
+class Welford {
+    private:
+        uint32_t n;
+        double   mean;
+        double   m2;        //sum of squared differences from the mean
+        double   lo, hi;
+
+    public:
+        Welford() { reset(); }
+
+        void reset(void) { n = 0; mean = m2 = lo = hi = 0.0; }
+
+        void add(double x) {
+            double d;
+            if( !n )
+                lo = hi = x;
+            else if( x < lo )
+                lo = x;
+            else if( x > hi )
+                hi = x;
+            n++;
+            d     = x - mean;
+            mean += d / n;
+            m2   += d * (x - mean);
+            }
+
+        void stats(agg_stats *s) const {
+            s->count  = n;
+            s->min    = lo;
+            s->max    = hi;
+            s->mean   = mean;
+            s->stddev = (n > 1)? sqrt(m2 / (n-1)) : 0.0;
+            }
+};
+
+#endif // __AGGREGATE_HPP__
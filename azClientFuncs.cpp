@@ -4,12 +4,18 @@
 */
 
 #include <stdlib.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "iothub_client_core_common.h"
 #include "iothub_client_ll.h"
 #include "azure_c_shared_utility/platform.h"
 #include "azure_c_shared_utility/agenttime.h"
+#include "azure_c_shared_utility/tickcounter.h"
 #include "jsondecoder.h"
+#include "jsmn.h"
+#include "tlsio_socket.h"
 
 #include "led.hpp"
 #include "lis2dw12.hpp"
@@ -17,269 +23,946 @@
 #include "barometer.hpp"
 #include "hts221.hpp"
 #include "gps.hpp"
+#include "sampler.hpp"
+#include "capture.hpp"
+#include "transport.hpp"
+#include "jsonwriter.hpp"
+#include "linkstats.hpp"
+#include "datausage.hpp"
 
 #include "azure_certs.h"
 
 #include "azIoTClient.h"
 
-#ifdef USE_MQTT
 #include "iothubtransportmqtt.h"
-#else
+#include "iothubtransportmqtt_websockets.h"
+#include "iothubtransportamqp.h"
+#include "iothubtransportamqp_websockets.h"
 #include "iothubtransporthttp.h"
-#endif
 
 //The following connection string must be updated for the individual users Azure IoT Device
 //static const char* connectionString = "HostName=XXXX;DeviceId=xxxx;SharedAccessKey=xxxx";
 static const char* connectionString = "HostName=M18QxIoTClient.azure-devices.net;DeviceId=SK2-IMEI353087080010952;SharedAccessKey=3vyDD6lO1VRCfi1bCZ58QsTUsViEZ3Q4JBErtvQzBcA=";
 
-extern void sendMessage(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, char* buffer, size_t size);
+extern bool sendMessage(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char* buffer, size_t size, 
+                        const char* content_type=NULL, const char* content_encoding=NULL, void *payload=NULL,
+                        bool reply=false);
 extern void prty_json(char* src, int srclen);
 
-char* send_sensrpt(void);
-char* send_devrpt(void);
-char* send_locrpt(void);
-char* send_temprpt(void);
-char* send_posrpt(void);
-char* send_envrpt(void);
+size_t send_sensrpt(JsonWriter& jw);
+size_t send_devrpt(JsonWriter& jw);
+size_t send_locrpt(JsonWriter& jw);
+size_t send_temprpt(JsonWriter& jw);
+size_t send_posrpt(JsonWriter& jw);
+size_t send_envrpt(JsonWriter& jw);
 IOTHUBMESSAGE_DISPOSITION_RESULT receiveMessageCallback( IOTHUB_MESSAGE_HANDLE message, void *userContextCallback);
+static void deviceTwinCallback(DEVICE_TWIN_UPDATE_STATE update_state, const unsigned char* payLoad, size_t size, 
+                               void* userContextCallback);
+static size_t end_report(JsonWriter& jw);
+static void write_sensor_list(JsonWriter& jw);
+bool twin_enabled(void);
+void set_report_period(int period);
+static void twin_reset(void);
+static int deviceMethodCallback(const char* method_name, const unsigned char* payload, size_t size, 
+                                METHOD_HANDLE method_id, void* userContextCallback);
+static void connectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, 
+                                     void* userContextCallback);
+
+LinkStats link_stats;
+
+//
+// called from IoTHubClient_LL_DoWork() once the hub has acknowledged the message (or it was given up on),
+// and from IoTHubClient_LL_Destroy() for those still in flight.  Telemetry that wasn't acknowledged goes
+// back to the transport to be stored and sent again.
+//
+static void sendConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *userContextCallback)
+{
+    LinkStats::msg_slot *m = (LinkStats::msg_slot *)userContextCallback;
+    void                *payload = m->payload;
+    send_result          r;
+
+    switch( result ) {
+        case IOTHUB_CLIENT_CONFIRMATION_OK:              r = SEND_OK;        break;
+        case IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT: r = SEND_TIMEOUT;   break;
+        case IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY: r = SEND_CANCELLED; break;
+        default:                                         r = SEND_ERROR;     break;
+        }
+    if( verbose )
+        printf("(----)message %u confirmed: %s\n", (unsigned)m->seq, LinkStats::result_name(r));
+    link_stats.complete(m, r);
+    if( payload != NULL )
+        transport.confirmed(payload, r == SEND_OK);
+}
 
-void sendMessage(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, char* buffer, size_t size)
+//
+// returns false if the message could not be handed to the IoT Hub client, this includes the case
+// where too many earlier messages are still waiting for their confirmation.  'payload' is handed to
+// Transport::confirmed() with the result, NULL if nobody needs it.  A 'reply' to a command uses the
+// replies' slots rather than the telemetry window.
+//
+bool sendMessage(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char* buffer, size_t size, 
+                 const char* content_type, const char* content_encoding, void *payload, bool reply)
 {
+    LinkStats::msg_slot *m;
+    struct timespec      ts;
+    char                 prop[24];
+    bool                 ok;
+
+    if( (m=link_stats.begin(reply)) == NULL ) {
+        printf("FAILED to send, %d messages waiting for confirmation!\n", link_stats.pending());
+        return false;
+        }
+    m->payload = payload;
+
     IOTHUB_MESSAGE_HANDLE messageHandle = IoTHubMessage_CreateFromByteArray((const unsigned char*)buffer, size);
     if (messageHandle == NULL) {
         printf("unable to create a new IoTHubMessage\r\n");
-        return;
+        link_stats.cancel(m);
+        return false;
         }
-    if (IoTHubClient_LL_SendEventAsync(iotHubClientHandle, messageHandle, NULL, NULL) != IOTHUB_CLIENT_OK)
+
+    // let IoT Hub routing know how to decode the body
+    if( content_type != NULL )
+        IoTHubMessage_SetContentTypeSystemProperty(messageHandle, content_type);
+    if( content_encoding != NULL )
+        IoTHubMessage_SetContentEncodingSystemProperty(messageHandle, content_encoding);
+
+    // the sequence number and enqueue time (ms since the epoch) let the back end spot gaps and measure delays
+    clock_gettime(CLOCK_REALTIME, &ts);
+    snprintf(prop, sizeof(prop), "%u", (unsigned)m->seq);
+    IoTHubMessage_SetMessageId(messageHandle, prop);
+    IoTHubMessage_SetProperty(messageHandle, "seq", prop);
+    snprintf(prop, sizeof(prop), "%lld", (long long)ts.tv_sec*1000 + ts.tv_nsec/1000000);
+    IoTHubMessage_SetProperty(messageHandle, "enqueued", prop);
+    if( reply )
+        IoTHubMessage_SetProperty(messageHandle, REPLY_PROPERTY, "1");    //the data usage counts it as C2D
+
+    ok = (IoTHubClient_LL_SendEventAsync(iotHubClientHandle, messageHandle, sendConfirmationCallback, m) == IOTHUB_CLIENT_OK);
+    iothub_work |= ok;              //have the main loop run DoWork to send it
+    if( !ok ) {
+        link_stats.cancel(m);
         printf("FAILED to send!\n");
+        }
     else
-        printf("OK\n");
+        printf("queued #%u\n", (unsigned)m->seq);
 
     IoTHubMessage_Destroy(messageHandle);
+    return ok;
 }
 
-IOTHUB_CLIENT_LL_HANDLE setup_azure(void)
+int iothub_transport = XPORT_MQTT;
+int retry_policy     = IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER;
+int retry_giveup     = 0;              //seconds, 0 = keep retrying
+int retry_cap        = RETRY_DEF_CAP;
+
+static const struct {
+    const char                       *name;
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER  protocol;
+    } transports[XPORT_COUNT] = {
+    { "mqtt",    MQTT_Protocol },
+    { "mqtt-ws", MQTT_WebSocket_Protocol },
+    { "amqp",    AMQP_Protocol },
+    { "amqp-ws", AMQP_Protocol_over_WebSocketsTls },
+    { "http",    HTTP_Protocol },
+    };
+
+const char *transport_name(int xport)
+{
+    return (xport >= 0 && xport < XPORT_COUNT)? transports[xport].name : "?";
+}
+
+// returns the XPORT_ value for a transport name, or -1
+int transport_id(const char *name)
+{
+    for( int i=0; i<XPORT_COUNT; i++ )
+        if( !strcmp(name, transports[i].name) )
+            return i;
+    return -1;
+}
+
+//
+// the PEM file named in AZIOT_TRUSTED_CERTS, read once, NULL if there is none.  A stand-in for the hub
+// (hubstub, which 'make check' runs) has its own certificate and names it there.
+//
+static const char *own_certificates(void)
 {
+    static char *pem;
+    const char  *file = getenv("AZIOT_TRUSTED_CERTS");
+    FILE        *fp;
+    long         len;
+
+    if( pem != NULL || file == NULL || (fp=fopen(file, "r")) == NULL )
+        return pem;
+    if( fseek(fp, 0, SEEK_END) == 0 && (len=ftell(fp)) > 0 && fseek(fp, 0, SEEK_SET) == 0 &&
+        (pem=(char*)malloc(len+1)) != NULL ) {
+        if( fread(pem, 1, len, fp) == (size_t)len )
+            pem[len] = '\0';
+        else {
+            free(pem);
+            pem = NULL;
+            }
+        }
+    fclose(fp);
+    if( pem == NULL )
+        printf("unable to read %s\r\n", file);
+    return pem;
+}
+
+//
+// the roots the hub's certificate chains up to, all of them if the hub isn't a known Azure cloud
+//
+static const char *hub_certificates(const char *connection_string)
+{
+    const char *p = strstr(connection_string, "HostName=");
+    char        host[128];
+
+    if( own_certificates() != NULL )
+        return own_certificates();
+    if( p == NULL || sscanf(p+9, "%127[^;]", host) != 1 )
+        return certificates;
+    return certificates_for_host(host);
+}
 
-    /* Setup IoTHub client configuration */
-#ifndef USE_MQTT
-    IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle = IoTHubClient_LL_CreateFromConnectionString(connectionString, HTTP_Protocol);
-#else
-    IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle = IoTHubClient_LL_CreateFromConnectionString(connectionString, MQTT_Protocol);
-#endif
+// the hub check (-H) connects to a stand-in for the hub
+void iothub_connection_string(const char *cs)
+{
+    connectionString = cs;
+}
+
+static TLSIO_SOCKET_WATCH hub_watch;       //given to the clients setup_azure() creates
+
+//
+// the transport worker has the socket of the clients setup_azure() creates reported to it, NULL to stop
+//
+void iothub_watch_socket(TLSIO_SOCKET_CALLBACK callback, void *context)
+{
+    hub_watch.callback = callback;
+    hub_watch.context  = context;
+}
+
+//
+// creates a client for the hub (or a stand-in for it) in 'connection_string' using transport 'xport', its
+// connection's socket is reported to 'watch' if that is given
+//
+IOTHUB_CLIENT_LL_HANDLE create_client(const char *connection_string, int xport, const TLSIO_SOCKET_WATCH *watch)
+{
+    IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle = IoTHubClient_LL_CreateFromConnectionString(connection_string, transports[xport].protocol);
     if (iotHubClientHandle == NULL) {
         printf("Failed on IoTHubClient_Create\r\n");
         return NULL;
         }
 
-    // add the certificate information
-    if (IoTHubClient_LL_SetOption(iotHubClientHandle, "TrustedCerts", certificates) != IOTHUB_CLIENT_OK) {
+    // add the certificate information, the tlsio parses it once and shares it between reconnects
+    if (IoTHubClient_LL_SetOption(iotHubClientHandle, "TrustedCerts", hub_certificates(connection_string)) != IOTHUB_CLIENT_OK) {
         IoTHubClient_LL_Destroy(iotHubClientHandle);
         printf("failure to set option \"TrustedCerts\"\r\n");
         return NULL;
         }
 
-    // add the certificate information
-
-#ifndef USE_MQTT
-    // polls will happen effectively at ~10 seconds.  The default value of minimumPollingTime is 25 minutes. 
-    // For more information, see:
-    //     https://azure.microsoft.com/documentation/articles/iot-hub-devguide/#messaging
-
-    unsigned int minimumPollingTime = 9;
-    if (IoTHubClient_LL_SetOption(iotHubClientHandle, "MinimumPollingTime", &minimumPollingTime) != IOTHUB_CLIENT_OK) {
+    // give up on a message that has not been acknowledged in time so its in-flight slot is released
+    tickcounter_ms_t messageTimeout = SEND_TIMEOUT_MS;
+    if (IoTHubClient_LL_SetOption(iotHubClientHandle, "messageTimeout", &messageTimeout) != IOTHUB_CLIENT_OK) {
         IoTHubClient_LL_Destroy(iotHubClientHandle);
-        printf("failure to set option \"MinimumPollingTime\"\r\n");
+        printf("failure to set option \"messageTimeout\"\r\n");
         return NULL;
         }
-#endif
 
-    // set C2D and device method callback
-    IoTHubClient_LL_SetMessageCallback(iotHubClientHandle, receiveMessageCallback, NULL);
+    // without it the client is only run from the house keeping tick
+    if( watch != NULL && watch->callback != NULL &&
+        IoTHubClient_LL_SetOption(iotHubClientHandle, TLSIO_OPTION_SOCKET_WATCH, watch) != IOTHUB_CLIENT_OK && verbose )
+        printf("the %s transport doesn't report its socket\r\n", transport_name(xport));
+
+    if( xport == XPORT_HTTP ) {
+        // polls will happen effectively at ~10 seconds.  The default value of minimumPollingTime is 25 minutes. 
+        // For more information, see:
+        //     https://azure.microsoft.com/documentation/articles/iot-hub-devguide/#messaging
+
+        unsigned int minimumPollingTime = 9;
+        if (IoTHubClient_LL_SetOption(iotHubClientHandle, "MinimumPollingTime", &minimumPollingTime) != IOTHUB_CLIENT_OK) {
+            IoTHubClient_LL_Destroy(iotHubClientHandle);
+            printf("failure to set option \"MinimumPollingTime\"\r\n");
+            return NULL;
+            }
+        }
+    return iotHubClientHandle;
+}
+
+IOTHUB_CLIENT_LL_HANDLE setup_azure(void)
+{
+    IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle = create_client(connectionString, iothub_transport, &hub_watch);
+
+    // set the retry policy, connection status, C2D and device method callbacks
+    if( iotHubClientHandle != NULL ) {
+        if( IoTHubClient_LL_SetRetryPolicy(iotHubClientHandle, (IOTHUB_CLIENT_RETRY_POLICY)retry_policy, retry_giveup) != IOTHUB_CLIENT_OK )
+            printf("failure to set the retry policy\r\n");
+        IoTHubClient_LL_SetConnectionStatusCallback(iotHubClientHandle, connectionStatusCallback, NULL);
+        IoTHubClient_LL_SetMessageCallback(iotHubClientHandle, receiveMessageCallback, NULL);
+        if( twin_enabled() ) {          //HTTP has neither the twin nor direct methods
+            twin_reset();
+            IoTHubClient_LL_SetDeviceTwinCallback(iotHubClientHandle, deviceTwinCallback, NULL);
+            IoTHubClient_LL_SetDeviceMethodCallback_Ex(iotHubClientHandle, deviceMethodCallback, NULL);
+            }
+        }
     return iotHubClientHandle;
 }
 
 //------------------------------------------------------------------
-#define SENS_REPORT "{"                                           \
-  "\"ObjectName\":\"sensor-report\","                             \
-  "\"SOM\":[\"ADC\",\"LIS2DW12-TEMP\",\"LIS2DW12-POS\",\"GPS\"]," \
-  "\"CLICK\":["
+// Connection status and reconnects.  The IoT Hub client retries a dropped connection itself, following
+// retry_policy, for up to retry_giveup seconds (0 = forever).  When it gives up, or the hub refuses the
+// device, the client is destroyed and created again from the house keeping tick.  The wait between those
+// attempts doubles from RETRY_BASE_SECS up to retry_cap seconds and is jittered so a fleet that lost the
+// same cell tower doesn't come back all at once.  Once the link has been down for retry_giveup seconds the
+// program gives up too and exits with a failure, leaving it to whatever started it.
+
+static bool            reconnect_needed;
+static int             reconnect_attempts;      //since the link was last up
+static struct timespec reconnect_at;            //CLOCK_MONOTONIC
+static bool            gave_up;
+
+static const struct {
+    const char                 *name;
+    IOTHUB_CLIENT_RETRY_POLICY  policy;
+    } retry_policies[] = {
+    { "none",        IOTHUB_CLIENT_RETRY_NONE },
+    { "immediate",   IOTHUB_CLIENT_RETRY_IMMEDIATE },
+    { "interval",    IOTHUB_CLIENT_RETRY_INTERVAL },
+    { "linear",      IOTHUB_CLIENT_RETRY_LINEAR_BACKOFF },
+    { "exponential", IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF },
+    { "jitter",      IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER },
+    { "random",      IOTHUB_CLIENT_RETRY_RANDOM },
+    };
+#define RETRY_POLICIES (int)(sizeof(retry_policies)/sizeof(retry_policies[0]))
+
+const char *retry_policy_name(int policy)
+{
+    for( int i=0; i<RETRY_POLICIES; i++ )
+        if( retry_policies[i].policy == policy )
+            return retry_policies[i].name;
+    return "?";
+}
 
-char* send_sensrpt(void)
+// returns the IOTHUB_CLIENT_RETRY_ value for a policy name, or -1
+int retry_policy_id(const char *name)
 {
-    int   len = sizeof(SENS_REPORT)+30;
-    char* ptr = (char*)malloc(len);
+    for( int i=0; i<RETRY_POLICIES; i++ )
+        if( !strcmp(name, retry_policies[i].name) )
+            return retry_policies[i].policy;
+    return -1;
+}
 
-    snprintf(ptr,len,SENS_REPORT);
+static const char *reason_name(IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
+{
+    switch( reason ) {
+        case IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN:    return "ExpiredSasToken";
+        case IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED:      return "DeviceDisabled";
+        case IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL:       return "BadCredential";
+        case IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED:        return "RetryExpired";
+        case IOTHUB_CLIENT_CONNECTION_NO_NETWORK:           return "NoNetwork";
+        case IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR:  return "CommunicationError";
+        case IOTHUB_CLIENT_CONNECTION_OK:                   return "OK";
+        default:                                            return "?";
+        }
+}
 
-    if( click_modules & (BAROMETER_CLICK|HTS221_CLICK) ) {
-        if (click_modules & BAROMETER_CLICK )
-            strcat(ptr,"\"BAROMETER\"");
+//
+// for the jitter; rand() is never seeded, every device would draw the same waits from it
+//
+static unsigned int jitter_random(void)
+{
+    unsigned int    r;
+    struct timespec ts;
+    int             fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
 
-        if (click_modules & HTS221_CLICK )
-            strcat(ptr,",\"TEMP&HUMID\"");
+    if( fd < 0 || read(fd, &r, sizeof(r)) != (ssize_t)sizeof(r) ) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        r = (unsigned int)ts.tv_nsec ^ (unsigned int)getpid();
         }
-    else
-        strcat(ptr,"\"NONE\"");
+    if( fd >= 0 )
+        close(fd);
+    return r;
+}
 
-    strcat(ptr,"]}");
-    return ptr;
+//
+// the next attempt is RETRY_BASE_SECS << attempts (at most retry_cap) seconds away, less up to half of it
+//
+static void schedule_reconnect(void)
+{
+    int wait = retry_cap;
+
+    if( reconnect_attempts < 16 && (RETRY_BASE_SECS << reconnect_attempts) < retry_cap )
+        wait = RETRY_BASE_SECS << reconnect_attempts;
+    wait -= jitter_random() % (wait/2 + 1);
+    clock_gettime(CLOCK_MONOTONIC, &reconnect_at);
+    reconnect_at.tv_sec += wait;
+    reconnect_needed = true;
+    printf("(----)reconnect to IoT Hub in %d seconds\n", wait);
 }
 
-//------------------------------------------------------------------
-#define DEV_REPORT "{"                             \
-  "\"ObjectName\":\"Device-Info\","                \
-  "\"ReportingDevice\":\"M18QWG/M18Q2FG-1\","      \
-  "\"DeviceICCID\":\"%s\","                        \
-  "\"DeviceIMEI\":\"%s\""                          \
-  "}"
+//
+// runs from IoTHubClient_LL_DoWork(), so the client can't be destroyed here; iothub_reconnect() does that
+//
+static void connectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, 
+                                     void* userContextCallback)
+{
+    bool up = (result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED);
+
+    if( up != link_stats.connected() || verbose )
+        printf("(----)IoT Hub connection %s (%s)\n", up? "up" : "down", reason_name(reason));
+    link_stats.connection(up, reason_name(reason));
+    if( up ) {
+        reconnect_needed   = false;
+        reconnect_attempts = 0;
+        }
+    else if( !reconnect_needed && (reason == IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED || 
+                                   reason == IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL ||
+                                   reason == IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED) )
+        schedule_reconnect();     //the client won't try again by itself
+}
 
-char* send_devrpt(void)
+//
+// creates the client for the first time, or again after the connection was lost; on failure another
+// attempt is scheduled (iothub_reconnect() counts the attempts).  Returns false if there is no client.
+//
+bool iothub_connect(void)
 {
-    int     len = sizeof(DEV_REPORT)+50;
-    char*   ptr = (char*)malloc(len);
+    iothub_generation++;                //the method handles of the last client are no longer good
+    if( (IoTHub_client_ll_handle = setup_azure()) == NULL ) {
+        printf("ERROR:couldn't create the IoT Hub client!\n");
+        schedule_reconnect();
+        return false;
+        }
+    reconnect_needed = false;
+    return true;
+}
 
-    snprintf(ptr,len,DEV_REPORT, iccid, imei);
-    return ptr;
+//
+// called from the house keeping tick, re-creates the client once a scheduled reconnect is due.  Returns
+// false once the link has been down for longer than retry_giveup.
+//
+bool iothub_reconnect(void)
+{
+    struct timespec now;
+
+    if( gave_up )
+        return false;
+    if( retry_giveup && !link_stats.connected() && link_stats.down_ms() >= retry_giveup*1000.0 ) {
+        printf("ERROR:no IoT Hub connection for %d seconds, giving up!\n", retry_giveup);
+        gave_up = true;
+        return false;
+        }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if( !reconnect_needed || capture.status() == CAP_UPLOADING || now.tv_sec < reconnect_at.tv_sec || 
+        (now.tv_sec == reconnect_at.tv_sec && now.tv_nsec < reconnect_at.tv_nsec) )
+        return true;
+
+    printf("(----)re-creating the IoT Hub client (attempt %d)\n", ++reconnect_attempts);
+    if( IoTHub_client_ll_handle != NULL )
+        IoTHubClient_LL_Destroy(IoTHub_client_ll_handle);
+    link_stats.recreated();
+    iothub_connect();
+    return true;
+}
+
+bool iothub_gave_up(void)
+{
+    return gave_up;
 }
 
 //------------------------------------------------------------------
-#define LOC_REPORT "{"                  \
-  "\"ObjectName\":\"location-report\"," \
-  "\"last GPS fix\":\"%s\","            \
-  "\"lat\":%.02f,"                      \
-  "\"long\":%.02f"                      \
-  "}"
+// Device twin.  The state that rarely changes (identity, sensor inventory and the tunables) is kept in the
+// twin's reported properties instead of every telemetry message, and is only sent again when it changes.
+// The tunables are set through the desired properties:
+//
+//   { "ReportPeriod": 60, "SamplePeriods": { "adc": 1000, "gps": 60000 }, "Aggregate": true }
+//
+// HTTP has no twin, with it the state stays in the telemetry and SET-PERIOD is the way to change the period.
+//
+
+#define TWIN_LEN     512
+
+static char twin_acked[TWIN_LEN];     //the reported properties the hub has accepted
+static char twin_pending[TWIN_LEN];   //sent but not yet accepted, empty when nothing is outstanding
+
+bool twin_enabled(void)
+{
+    return iothub_transport != XPORT_HTTP;
+}
 
-char* send_locrpt(void)
+// a new client has nothing outstanding; what the hub accepted earlier is still in the twin
+static void twin_reset(void)
 {
-    gpsstatus *loc;
-    char      temp[25];
-    struct tm *ptm;
-    int       len = sizeof(LOC_REPORT)+35;
-    char*     ptr = (char*)malloc(len);
+    twin_pending[0] = '\0';
+}
 
-    loc = gps.getLocation();
-    ptm = gmtime(&loc->last_good);
-    strftime(temp,25,"%a %F %X",ptm);
+void set_report_period(int period)
+{
+    int i = period % REPORT_PERIOD_RESOLUTION;
 
-    snprintf(ptr,len, LOC_REPORT, temp, loc->last_pos.lat, loc->last_pos.lng);
-    return ptr;
+    if( period < REPORT_PERIOD_RESOLUTION )
+        period = REPORT_PERIOD_RESOLUTION;
+    else if( i != 0 )
+        period += (REPORT_PERIOD_RESOLUTION-i);
+    report_period = period;
 }
 
-//------------------------------------------------------------------
-#define TEMP_REPORT "{"             \
-  "\"ObjectName\":\"temp-report\"," \
-  "\"Temperature\":%.02f"           \
-  "}"
+static size_t write_twin(JsonWriter& jw)
+{
+    jw.reset();
+    jw.begin_object()
+      .member("ObjectName",      REPORTING_OBJECT_NAME)
+      .member("ObjectType",      REPORTING_OBJECT_TYPE)
+      .member("Version",         REPORTING_OBJECT_VERSION)
+      .member("ReportingDevice", REPORTING_DEVICE)
+      .member("DeviceICCID",     iccid)
+      .member("DeviceIMEI",      imei)
+      .member("ReportPeriod",    report_period)
+      .member("Aggregate",       sensors.aggregate())
+      .key("Sensors").begin_object();
+    write_sensor_list(jw);
+    jw.end_object()
+      .key("SamplePeriods").begin_object();
+    for( int i=0; i<SRC_COUNT; i++ )
+        jw.member(Sampler::source_name(i), sensors.period(i));
+    jw.end_object();
+    return end_report(jw);
+}
+
+static void reportedStateCallback(int status_code, void *userContextCallback)
+{
+    if( status_code >= 200 && status_code < 300 )
+        strcpy(twin_acked, twin_pending);
+    else if( verbose )
+        printf("(----)device twin update failed, status %d\n", status_code);
+    twin_pending[0] = '\0';
+}
 
-char* send_temprpt(void)
+//
+// sends the reported properties if they have changed since the hub last accepted them, called once a second
+//
+void twin_update(void)
 {
-    int   len = sizeof(TEMP_REPORT)+10;
-    char* ptr = (char*)malloc(len);
+    static char twin_buf[TWIN_LEN];
+    JsonWriter  jw(twin_buf, sizeof(twin_buf));
+    size_t      len;
 
-    snprintf(ptr,len,TEMP_REPORT, mems.lis2dw12_getTemp());
-    return ptr;
+    if( !twin_enabled() || twin_pending[0] )
+        return;
+    len = write_twin(jw);
+    if( !len || !strcmp(twin_buf, twin_acked) )
+        return;
+    if( IoTHubClient_LL_SendReportedState(IoTHub_client_ll_handle, (const unsigned char*)twin_buf, len, 
+                                          reportedStateCallback, NULL) == IOTHUB_CLIENT_OK ) {
+        strcpy(twin_pending, twin_buf);
+        iothub_work = true;
+        if( verbose ) 
+            printf("(----)device twin reported properties updated\n");
+        }
 }
 
-//------------------------------------------------------------------
-#define POS_REPORT "{"                 \
-  "\"ObjectName\":\"board-position\"," \
-  "\"Board Moved\":%d,"                \
-  "\"Board Position\":%d"              \
-  "}"
+// index of the token that follows token i and everything it contains, at most r (the token count)
+static int twin_skip(jsmntok_t *t, int r, int i)
+{
+    int n;
+
+    if( i >= r )
+        return r;
+    n = t[i].size;
+    for( i++; n > 0 && i < r; n-- )
+        i = twin_skip(t, r, i);
+    return i;
+}
+
+static bool twin_key(const char *js, jsmntok_t *t, const char *key)
+{
+    int len = t->end - t->start;
+    return t->type == JSMN_STRING && (int)strlen(key) == len && !strncmp(js+t->start, key, len);
+}
 
-char* send_posrpt(void)
+// applies the desired properties in the object at token 'obj' of the r tokens
+static void twin_desired(char *js, jsmntok_t *t, int r, int obj)
 {
-    int   len = sizeof(POS_REPORT)+10;
-    char* ptr = (char*)malloc(len);
+    int i = obj+1;
+
+    for( int n=0; n<t[obj].size && i+1<r; n++, i=twin_skip(t, r, i+1) ) {
+        jsmntok_t *v = &t[i+1];
+
+        if( twin_key(js, &t[i], "ReportPeriod") && v->type == JSMN_PRIMITIVE ) {
+            set_report_period(atoi(js+v->start));
+            if( verbose ) printf("Report Period set to %d by the device twin.\n",report_period);
+            }
+        else if( twin_key(js, &t[i], "Aggregate") && v->type == JSMN_PRIMITIVE )
+            sensors.aggregate(js[v->start] == 't');
+        else if( twin_key(js, &t[i], "SamplePeriods") && v->type == JSMN_OBJECT ) {
+            int k = i+2;
+            for( int m=0; m<v->size && k+1<r; m++, k=twin_skip(t, r, k+1) ) {
+                char name[16];
+                int  len = t[k].end - t[k].start;
+                int  src, ms;
+
+                if( t[k].type != JSMN_STRING || len >= (int)sizeof(name) || t[k+1].type != JSMN_PRIMITIVE )
+                    continue;
+                memcpy(name, js+t[k].start, len);
+                name[len] = '\0';
+                ms = atoi(js+t[k+1].start);
+                if( (src=Sampler::source(name)) >= 0 && ms >= 100 )
+                    sensors.set_period(src, ms);
+                }
+            }
+        }
+}
 
-    snprintf(ptr,len,POS_REPORT, mems.movement_ocured(), mems.lis2dw12_getPosition());
-    return ptr;        
+//
+// the whole twin ({"desired":{...},"reported":{...}}) arrives when the client connects, after that only the
+// desired properties that changed
+//
+static void deviceTwinCallback(DEVICE_TWIN_UPDATE_STATE update_state, const unsigned char* payLoad, size_t size, 
+                               void* userContextCallback)
+{
+    jsmn_parser p;
+    jsmntok_t  *t = NULL;
+    char       *js = (char *)malloc(size + 1);
+    int         r, i;
+
+    if( js == NULL )
+        return;
+    memcpy(js, payLoad, size);
+    js[size] = '\0';
+
+    //the whole twin can be large, count the tokens first
+    jsmn_init(&p);
+    r = jsmn_parse(&p, js, size, NULL, 0);
+    if( r > 0 && (t = (jsmntok_t *)malloc(r * sizeof(jsmntok_t))) != NULL ) {
+        jsmn_init(&p);
+        r = jsmn_parse(&p, js, size, t, r);
+        }
+    if( t == NULL || r < 1 || t[0].type != JSMN_OBJECT ) 
+        printf("(----)unable to parse the device twin\n");
+    else if( update_state == DEVICE_TWIN_UPDATE_PARTIAL )
+        twin_desired(js, t, r, 0);
+    else {
+        i = 1;
+        for( int n=0; n<t[0].size && i+1<r; n++, i=twin_skip(t, r, i+1) )
+            if( twin_key(js, &t[i], "desired") && t[i+1].type == JSMN_OBJECT )
+                twin_desired(js, t, r, i+1);
+        }
+    free(t);
+    free(js);
 }
 
 //------------------------------------------------------------------
-#define ENV_REPORT "{"                    \
-  "\"ObjectName\":\"enviroment-report\"," \
-  "\"Barometer\":%.02f,"                  \
-  "\"Humidity\":%.01f"                    \
-  "}"
+// The requested reports are all built into a caller supplied JsonWriter, each returns the 
+// length of the report or 0 if it did not fit.
+
+static size_t end_report(JsonWriter& jw)
+{
+    jw.end_object();
+    return jw.overflow()? 0 : jw.length();
+}
 
-char* send_envrpt(void)
+//------------------------------------------------------------------
+// the sensors on the SOM and the Click boards that were found, as the SOM and CLICK arrays
+//
+static void write_sensor_list(JsonWriter& jw)
 {
-    int   len = sizeof(ENV_REPORT)+15;
-    char* ptr = (char*)malloc(len);
+    jw.key("SOM").begin_array()
+          .value("ADC").value("LIS2DW12-TEMP").value("LIS2DW12-POS").value("GPS")
+      .end_array()
+      .key("CLICK").begin_array();
 
-    snprintf(ptr,len,ENV_REPORT,
-            (click_modules & BAROMETER_CLICK )? barom.get_pressure():0,
-            (click_modules & HTS221_CLICK )? humid.readHumidity():0   );
-    return ptr;
+    if( click_modules & (BAROMETER_CLICK|HTS221_CLICK) ) {
+        if (click_modules & BAROMETER_CLICK )
+            jw.value("BAROMETER");
+
+        if (click_modules & HTS221_CLICK )
+            jw.value("TEMP&HUMID");
+        }
+    else
+        jw.value("NONE");
+
+    jw.end_array();
 }
 
-IOTHUBMESSAGE_DISPOSITION_RESULT receiveMessageCallback(
-    IOTHUB_MESSAGE_HANDLE message, 
-    void *userContextCallback)
+size_t send_sensrpt(JsonWriter& jw)
 {
-    const unsigned char *buffer = NULL;
-    char* pmsg = NULL;
-    size_t size = 0;
+    jw.reset();
+    jw.begin_object()
+      .member("ObjectName", "sensor-report");
+    write_sensor_list(jw);
+    return end_report(jw);
+}
 
-    if (IOTHUB_MESSAGE_OK != IoTHubMessage_GetByteArray(message, &buffer, &size))
-        return IOTHUBMESSAGE_ABANDONED;
+//------------------------------------------------------------------
+size_t send_devrpt(JsonWriter& jw)
+{
+    jw.reset();
+    jw.begin_object()
+      .member("ObjectName",      "Device-Info")
+      .member("ReportingDevice", REPORTING_DEVICE)
+      .member("DeviceICCID",     iccid)
+      .member("DeviceIMEI",      imei);
+    return end_report(jw);
+}
 
-    // message needs to be converted to zero terminated string
-    char * temp = (char *)malloc(size + 1);
-    if (temp == NULL)
-        return IOTHUBMESSAGE_ABANDONED;
+//------------------------------------------------------------------
+size_t send_locrpt(JsonWriter& jw)
+{
+    sensor_snapshot snap;
+    struct tm       fix;
+
+    sensors.get(&snap);
+    gmtime_r(&snap.gps_fix, &fix);
+
+    jw.reset();
+    jw.begin_object()
+      .member("ObjectName",   "location-report")
+      .member("last GPS fix", &fix, "%a %F %X")
+      .member("lat",          (double)snap.gps_pos.lat, 2)
+      .member("long",         (double)snap.gps_pos.lng, 2);
+    return end_report(jw);
+}
 
-    strncpy(temp, (char*)buffer, size);
-    temp[size] = '\0';
-
-    if( !strcmp(temp, "REPORT-SENSORS") )
-        pmsg = send_sensrpt();
-    else if( !strcmp(temp, "GET-DEV-INFO") )
-        pmsg = send_devrpt();
-    else if( !strcmp(temp, "GET-LOCATION") )
-        pmsg = send_locrpt();
-    else if( !strcmp(temp, "GET-TEMP") )
-        pmsg = send_temprpt();
-    else if( !strcmp(temp, "GET-POS") )
-        pmsg = send_posrpt();
-    else if( !strcmp(temp, "GET-ENV") )
-        pmsg = send_envrpt();
-    else if( !strcmp(temp, "LED-ON-MAGENTA") ){
+//------------------------------------------------------------------
+size_t send_temprpt(JsonWriter& jw)
+{
+    sensor_snapshot snap;
+
+    sensors.get(&snap);
+    jw.reset();
+    jw.begin_object()
+      .member("ObjectName",  "temp-report")
+      .member("Temperature", (double)snap.temperature, 2);
+    return end_report(jw);
+}
+
+//------------------------------------------------------------------
+size_t send_posrpt(JsonWriter& jw)
+{
+    static uint32_t last_moves = 0;
+    sensor_snapshot snap;
+
+    sensors.get(&snap);
+    jw.reset();
+    jw.begin_object()
+      .member("ObjectName",     "board-position")
+      .member("Board Moved",    (int)(snap.move_count != last_moves))
+      .member("Board Position", snap.position);
+    last_moves = snap.move_count;
+    return end_report(jw);
+}
+
+//------------------------------------------------------------------
+size_t send_envrpt(JsonWriter& jw)
+{
+    sensor_snapshot snap;
+
+    sensors.get(&snap);
+    jw.reset();
+    jw.begin_object()
+      .member("ObjectName", "enviroment-report")
+      .member("Barometer",  (click_modules & BAROMETER_CLICK )? (double)snap.pressure:0.0, 2)
+      .member("Humidity",   (click_modules & HTS221_CLICK )? snap.humidity:0.0, 1);
+    return end_report(jw);
+}
+
+//------------------------------------------------------------------
+// Commands arrive either as C2D messages ("SET-PERIOD 60") or, except with HTTP, as direct methods (method
+// SET-PERIOD with the payload 60).  A C2D command's report goes back as a telemetry message, a direct
+// method's in the method response.
+
+#define CMD_DONE     -1     //the command has no report
+#define CMD_UNKNOWN  -2
+
+//
+// runs command 'cmd', 'arg' is its argument or NULL.  Returns the length of the report made in 'rpt', 0 if
+// the report did not fit, CMD_DONE or CMD_UNKNOWN.
+//
+static int run_command(const char *cmd, const char *arg, JsonWriter& rpt)
+{
+    int rpt_len = CMD_DONE;
+
+    if( !strcmp(cmd, "REPORT-SENSORS") )
+        rpt_len = (int)send_sensrpt(rpt);
+    else if( !strcmp(cmd, "GET-DEV-INFO") )
+        rpt_len = (int)send_devrpt(rpt);
+    else if( !strcmp(cmd, "GET-LOCATION") )
+        rpt_len = (int)send_locrpt(rpt);
+    else if( !strcmp(cmd, "GET-TEMP") )
+        rpt_len = (int)send_temprpt(rpt);
+    else if( !strcmp(cmd, "GET-POS") )
+        rpt_len = (int)send_posrpt(rpt);
+    else if( !strcmp(cmd, "GET-ENV") )
+        rpt_len = (int)send_envrpt(rpt);
+    else if( !strcmp(cmd, "GET-CAPTURE") )
+        rpt_len = (int)capture.write(rpt);
+    else if( !strcmp(cmd, "CAPTURE") ) {
+        char name[8] = "";
+        int  ms = 0, secs = 0;
+        if( arg == NULL || sscanf(arg, "%7s %d %d", name, &ms, &secs) != 3 || !capture.start(Capture::source(name), ms, secs) )
+            printf("(----)capture '%s' not started\n", arg? arg : "");
+        else if( verbose )
+            printf("Capturing %s every %dms for %d seconds.\n", name, ms, secs);
+        rpt_len = (int)capture.write(rpt);
+        }
+    else if( !strcmp(cmd, "UPLOAD-CAPTURE") ) {
+        capture.request_upload();          //started by the transport worker
+        rpt_len = (int)capture.write(rpt);
+        }
+    else if( !strcmp(cmd, "LED-ON-MAGENTA") ){
         status_led.action(Led::LED_ON,Led::MAGENTA);
         if( verbose ) printf("Turning LED on to Magenta.\n");
         }
-    else if( !strcmp(temp, "LED-BLINK-MAGENTA") ){
+    else if( !strcmp(cmd, "LED-BLINK-MAGENTA") ){
         status_led.action(Led::LED_BLINK,Led::MAGENTA);
         if( verbose ) printf("Setting LED to blink Magenta\n");
         }
-    else if( !strcmp(temp, "LED-OFF") ){
+    else if( !strcmp(cmd, "LED-OFF") ){
         status_led.action(Led::LED_OFF,Led::BLACK);
         if( verbose ) printf("Turning LED off.\n");
         }
-    else if( strstr(temp, "SET-PERIOD") ) {
-        sscanf(temp,"SET-PERIOD %d",&report_period);
-        int i=report_period % REPORT_PERIOD_RESOLUTION;
-        if( i != 0 )
-            report_period += (REPORT_PERIOD_RESOLUTION-i);
+    else if( !strncmp(cmd, "SET-PERIOD", 10) && (cmd[10] == '\0' || isdigit((unsigned char)cmd[10])) ) {
+        int period = report_period;
+        if( arg == NULL && cmd[10] != '\0' )
+            arg = cmd+10;                  //"SET-PERIOD60", the period right after the name
+        if( arg != NULL )
+            sscanf(arg,"%d",&period);
+        set_report_period(period);
         if( verbose ) printf("Report Period remotely set to %d.\n",report_period);
         }
     else
-        printf("Received message: '%s'\r\n", temp);
+        rpt_len = CMD_UNKNOWN;
+    return rpt_len;
+}
 
-    if( pmsg != NULL ) {
-        printf("(----)Azure IoT Hub requested response sent - ");
-        sendMessage(IoTHub_client_ll_handle, pmsg, strlen(pmsg));
-        if( verbose )
-            prty_json(pmsg,strlen(pmsg));
-        free(pmsg);
+//
+// the body of a direct method response: the report, or {"Result":"OK"}/{"Error":...} made in 'rpt' when
+// there is none.  Returns the method status.
+//
+static int method_response(int rpt_len, JsonWriter& rpt, size_t *len)
+{
+    int status = 200;
+
+    if( rpt_len <= 0 ) {
+        rpt.reset();
+        rpt.begin_object();
+        if( rpt_len == CMD_UNKNOWN ) {
+            status = 404;
+            rpt.member("Error", "unknown method");
+            }
+        else if( rpt_len == 0 ) {
+            status = 413;
+            rpt.member("Error", "response too large");
+            }
+        else
+            rpt.member("Result", "OK");
+        rpt_len = (int)end_report(rpt);
+        }
+    *len = rpt_len;
+    return status;
+}
+
+//
+// runs the commands the transport worker has received, the replies go back through the transport.  Runs on
+// the application thread so a slow sensor read doesn't hold up the IoT Hub client.
+//
+void run_commands(void)
+{
+    static char rpt_buf[MSG_LEN];
+    JsonWriter  rpt(rpt_buf, sizeof(rpt_buf));
+    xport_cmd   c;
+    int         rpt_len, status;
+    size_t      len;
+    char       *arg;
+
+    while( transport.next_command(&c) ) {
+        // "COMMAND argument"
+        if( (arg=strchr(c.cmd, ' ')) != NULL )
+            *arg++ = '\0';
+        rpt_len = run_command(c.cmd, arg, rpt);
+
+        if( c.method_id != NULL ) {
+            status = method_response(rpt_len, rpt, &len);
+            if( verbose ) {
+                printf("(----)direct method %s returned %d - ", c.cmd, status);
+                prty_json(rpt_buf, len);
+                }
+            if( !transport.respond(c.method_id, c.generation, status, rpt_buf, len) )
+                printf("(----)direct method %s response not sent!\n", c.cmd);
+            }
+        else if( rpt_len == CMD_UNKNOWN )
+            printf("Received message: '%s%s%s'\r\n", c.cmd, arg? " ":"", arg? arg:"");
+        else if( rpt_len == 0 )
+            printf("(----)Azure IoT Hub requested response too large to send!\n");
+        else if( rpt_len > 0 ) {
+            printf("(----)Azure IoT Hub requested response %s - ", transport.reply(rpt_buf, rpt_len)? "sent" : "NOT sent");
+            if( verbose )
+                prty_json(rpt_buf, rpt_len);
+            }
+        free(c.cmd);
         }
-    free(temp);
-    return IOTHUBMESSAGE_ACCEPTED;
 }
 
+//
+// the next two run on the transport worker from IoTHubClient_LL_DoWork(); the commands are handed to the
+// application, except GET-LINK-STATS whose counters belong to the worker
+//
+IOTHUBMESSAGE_DISPOSITION_RESULT receiveMessageCallback(
+    IOTHUB_MESSAGE_HANDLE message, 
+    void *userContextCallback)
+{
+    const unsigned char *buffer = NULL;
+    static char rpt_buf[MSG_LEN];
+    JsonWriter  rpt(rpt_buf, sizeof(rpt_buf));
+    size_t      size = 0, len;
 
+    if (IOTHUB_MESSAGE_OK != IoTHubMessage_GetByteArray(message, &buffer, &size))
+        return IOTHUBMESSAGE_ABANDONED;
 
+    if( size == 14 && !memcmp(buffer, "GET-LINK-STATS", 14) ) {
+        if( (len = link_stats.write(rpt)) != 0 ) {
+            printf("(----)Azure IoT Hub requested response sent - ");
+            sendMessage(IoTHub_client_ll_handle, rpt_buf, len, NULL, NULL, NULL, true);
+            if( verbose )
+                prty_json(rpt_buf, len);
+            }
+        return IOTHUBMESSAGE_ACCEPTED;
+        }
+    if( !transport.post_command((const char*)buffer, size, NULL) ) {
+        printf("(----)too many commands waiting, C2D message abandoned\n");
+        return IOTHUBMESSAGE_ABANDONED;          //the hub delivers it again later
+        }
+    return IOTHUBMESSAGE_ACCEPTED;
+}
 
+//
+// a direct method is answered later, through IoTHubClient_LL_DeviceMethodResponse(), once the application
+// has run it
+//
+static int deviceMethodCallback(const char* method_name, const unsigned char* payload, size_t size, 
+                                METHOD_HANDLE method_id, void* userContextCallback)
+{
+    static char rpt_buf[MSG_LEN];
+    JsonWriter  rpt(rpt_buf, sizeof(rpt_buf));
+    char        cmd[64];
+    int         n, status;
+    size_t      len;
+
+    if( size >= 2 && payload[0] == '"' && payload[size-1] == '"' ) {    //a JSON string, e.g. "accel 40 60"
+        payload++;
+        size -= 2;
+        }
+    if( size > 24 )
+        size = 24;
+    n = snprintf(cmd, sizeof(cmd), "%.31s%s%.*s", method_name, size? " " : "", (int)size, (const char*)payload);
+
+    if( !strcmp(method_name, "GET-LINK-STATS") ) {
+        status = method_response((int)link_stats.write(rpt), rpt, &len);
+        IoTHubClient_LL_DeviceMethodResponse(IoTHub_client_ll_handle, method_id, (const unsigned char*)rpt_buf, len, status);
+        }
+    else if( !transport.post_command(cmd, n, method_id) ) {
+        rpt.reset();
+        rpt.begin_object().member("Error", "busy");
+        len = end_report(rpt);
+        IoTHubClient_LL_DeviceMethodResponse(IoTHub_client_ll_handle, method_id, (const unsigned char*)rpt_buf, len, 503);
+        }
+    return 0;
+}
@@ -41,13 +41,49 @@ extern "C" {
 #include "barometer.hpp"
 #include "hts221.hpp"
 #include "wwan.hpp"
+#include "sampler.hpp"
+#include "capture.hpp"
+#include "batcher.hpp"
+#include "report.hpp"
+#include "jsonwriter.hpp"
+#include "binwriter.hpp"
+#include "spool.hpp"
+#include "reactor.hpp"
+#include "linkstats.hpp"
+#include "transport.hpp"
+#include "datausage.hpp"
+#include "tlsio_socket.h"
 
 #include "azIoTClient.h"
 
-IOTHUB_CLIENT_LL_HANDLE  setup_azure(void);
-void sendMessage(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, char* buffer, size_t size);
+bool iothub_reconnect(void);
+bool iothub_gave_up(void);
+bool sendMessage(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char* buffer, size_t size, 
+                 const char* content_type=NULL, const char* content_encoding=NULL, void *payload=NULL,
+                 bool reply=false);
 void button_release(int);
 void bb_release(int);             //boot button release
+void bench_json(int iterations);
+void bench_encoders(void);
+void bench_transports(const char *connection_string, int first, int last);
+bool bench_load(const char *connection_string, int xport);
+void bench_idle(const char *connection_string, int xport);
+bool hub_check(const char *connection_string);
+void bench_mal(int commands);
+const char *transport_name(int xport);
+int transport_id(const char *name);
+const char *retry_policy_name(int policy);
+int retry_policy_id(const char *name);
+bool twin_enabled(void);
+void twin_update(void);
+void run_commands(void);
+void prty_json(char* src, int srclen);
+void verbose_output(const char * format, ...);
+void chk_uart2_input(void);
+
+extern LinkStats link_stats;
+extern int       iothub_transport;
+extern int       retry_policy, retry_giveup, retry_cap;
 
 Led::Color   current_color;
 Led::Action  current_action;
@@ -67,6 +103,15 @@ unsigned int click_modules = 0;   //no Click Modules present
 #define IN_LPM     2
 #define EXIT_LPM   3
 
+#define REACTOR_TICK_MS  1000   //house keeping tick while connected
+#define CAPTURE_PROGRESS 10     //seconds between upload progress messages
+
+//Telemetry encodings
+#define ENC_JSON     0
+#define ENC_CBOR     1
+#define ENC_MSGPACK  2
+#define ENC_COUNT    3
+
 
 //if using UART2, the following are needed
 struct termios options;
@@ -83,6 +128,22 @@ Hts221    humid(HTS221_SAD);
 Button    user_button(GPIO_PIN_98, BUTTON_ACTIVE_HIGH, button_release);
 Button    boot_button(GPIO_PIN_1, BUTTON_ACTIVE_LOW, bb_release);  //handle the boot button
 Devinfo   device;
+Sampler   sensors(&adc, &mems, &barom, &humid, &gps);
+Capture   capture(&mems, &gps);
+Batcher   batch;
+Report    report;
+Spool     spool;
+Encoder  *telemetry_fmt;          //encoder used for the standard telemetry reports
+int       telemetry_enc = ENC_JSON;
+Encoder  *encoders[ENC_COUNT];    //indexed by the ENC_ value, which is kept with spooled messages
+struct timeval time_sent;         //when the last standard report was made
+Reactor   reactor;
+Transport transport;              //the worker thread that owns the IoT Hub client
+bool      iothub_work;            //the IoT Hub client has something to send, DoWork is needed (worker only)
+uint32_t  iothub_generation;      //counts the clients created, a method handle is only good for its own (worker only)
+int       stats_period = 0;       //seconds between Link-Stats telemetry, 0 = only on request
+int       usage_period = 0;       //seconds between Data-Usage telemetry, 0 = only on the UART console
+DataUsage data_usage;
 
 //
 // arguments the program takes during startup.
@@ -93,6 +154,44 @@ void usage (void)
     printf(" -u  : Enable/Use UART2.\n");
     printf(" -v  : Display Messages as sent.\n");
     printf(" -r X: Set the reporting period in 'X' (seconds)\n");
+    printf(" -n N: Send the telemetry in batches of up to 'N' samples\n");
+    printf(" -w X: Send a batch once its oldest sample is 'X' seconds old (default %d)\n", BATCH_DEF_WINDOW);
+    printf(" -m X: Limit a batch message to 'X' bytes (default %d)\n", BATCH_DEF_MAX_BYTES);
+    printf(" -d K: Deadband reporting, only send fields that changed with a full report every 'K'\n");
+    printf(" -e F: Encode telemetry as F, one of 'json' (default), 'cbor' or 'msgpack'\n");
+    printf(" -a  : Add min/max/mean/stddev of the readings taken since the last report\n");
+    printf(" -s X: Sample every sensor every 'X' milliseconds\n");
+    printf(" -p S=X: Sample sensor S every 'X' milliseconds, S is one of:\n      ");
+    for( int i=0; i<SRC_COUNT; i++ )
+        printf(" %s (%dms)", Sampler::source_name(i), Sampler::default_period(i));
+    printf("\n");
+    printf(" -q X: Store up to 'X' KB of telemetry while disconnected or in LPM (default %d, 0 = off)\n", SPOOL_DEF_KBYTES);
+    printf(" -Q  : When the store is full, drop new telemetry instead of the oldest\n");
+    printf(" -i N: Allow up to 'N' messages to wait for their send confirmation (default %d, max %d)\n", INFLIGHT_DEF, INFLIGHT_MAX);
+    printf(" -l X: Send the delivery counts and latency histogram every 'X' seconds\n");
+    printf(" -U X: Send the cellular data used by each kind of traffic every 'X' seconds (mqtt and http only,\n");
+    printf("      the other transports' traffic is all counted as Other)\n");
+    printf(" -C S=X,N: Record capture source S every 'X' milliseconds for 'N' seconds, then upload it as a blob.\n");
+    printf("      S is one of:");
+    for( int i=0; i<CAP_SOURCES; i++ )
+        printf(" %s", Capture::source_name(i));
+    printf("\n");
+    printf(" -T P: Connect using transport P:");
+    for( int i=0; i<XPORT_COUNT; i++ )
+        printf(" %s%s", transport_name(i), i? "" : " (default)");
+    printf("\n");
+    printf(" -R P: IoT Hub client retry policy P:");
+    for( int i=IOTHUB_CLIENT_RETRY_NONE; i<=IOTHUB_CLIENT_RETRY_RANDOM; i++ )
+        printf(" %s%s", retry_policy_name(i), (i == IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER)? " (default)" : "");
+    printf("\n");
+    printf(" -c X: Wait at most 'X' seconds between reconnect attempts (default %d)\n", RETRY_DEF_CAP);
+    printf(" -g X: Give up and exit after 'X' seconds without a connection (default 0 = never)\n");
+    printf(" -b  : Run the benchmarks and exit\n");
+    printf(" -B C: Benchmark the transports (or the one given with -T) against the hub in connection string C\n");
+    printf(" -L C: Sweep the message rate over the -T transport against the hub in connection string C\n");
+    printf(" -I C: Measure the idle CPU use of the -T transport, polled and from the reactor, against the hub in C\n");
+    printf(" -H C: Run the -T transport for 20 s against the hub in C: commands, methods, the twin and a capture upload\n");
+    printf(" -M N: Time 'N' MAL commands with kept connections and with one connection per command, then exit\n");
     printf(" -?  : Display usage info\n");
 }
 
@@ -110,6 +209,7 @@ void button_release( int dur )
     if( dur > 3 ) {
         status_led.set_interval(125);
         done = true;
+        reactor.wake();
         }
 
 }
@@ -133,6 +233,7 @@ void bb_release( int dur )
         default: 
             break;
         }
+    reactor.wake();
 }
 
 void bb_press( void )
@@ -143,73 +244,370 @@ void bb_press( void )
 }
 
 /* Standard Report sent to Azure repeatedly */
-#define MSG_LEN                    512
-#define IOTDEVICE_MSG_FORMAT       \
-   "{"                             \
-     "\"ObjectName\":\"%s\","      \
-     "\"ObjectType\":\"%s\","      \
-     "\"Version\":\"%s\","         \
-     "\"ReportingDevice\":\"%s\"," \
-     "\"DeviceICCID\":\"%s\","     \
-     "\"DeviceIMEI\":\"%s\","      \
-     "\"ADC_value\":%.02f,"        \
-     "\"last GPS fix\":\"%s\","    \
-     "\"lat\":%.02f,"              \
-     "\"long\":%.02f,"             \
-     "\"Temperature\":%.02f,"      \
-     "\"Board Moved\":%d,"         \
-     "\"Board Position\":%d,"      \
-     "\"Report Period\":%d,"       \
-     "\"TOD\":\"%s UTC\""          
-
-char* make_message(char* iccid, char* imei)
+size_t make_message(Encoder& enc, char* iccid, char* imei)
+{
+    static uint32_t last_moves = 0;
+    sensor_snapshot snap;
+    agg_stats       window[AGG_COUNT];
+
+    sensors.get(&snap);
+
+    report.clear();
+    if( !twin_enabled() ) {        //otherwise these are reported properties of the device twin
+        report.set(RF_OBJECT_NAME,  REPORTING_OBJECT_NAME);
+        report.set(RF_OBJECT_TYPE,  REPORTING_OBJECT_TYPE);
+        report.set(RF_VERSION,      REPORTING_OBJECT_VERSION);
+        report.set(RF_DEVICE,       REPORTING_DEVICE);
+        report.set(RF_ICCID,        iccid);
+        report.set(RF_IMEI,         imei);
+        report.set(RF_PERIOD,       report_period);
+        }
+    report.set(RF_ADC,          (double)snap.adc);
+    report.set(RF_GPS_FIX,      snap.gps_fix);
+    report.set(RF_LAT,          (double)snap.gps_pos.lat);
+    report.set(RF_LONG,         (double)snap.gps_pos.lng);
+    report.set(RF_TEMPERATURE,  (double)snap.temperature);
+    report.set(RF_MOVED,        (int)(snap.move_count != last_moves));
+    report.set(RF_POSITION,     snap.position);
+    report.set(RF_TOD,          time(NULL));
+    last_moves = snap.move_count;
+
+    if( click_modules & BAROMETER_CLICK ) 
+        report.set(RF_BAROMETER, (double)snap.pressure);
+
+    if( click_modules & HTS221_CLICK ) 
+        report.set(RF_HUMIDITY, snap.humidity);
+
+    if( sensors.aggregate() ) {
+        sensors.window(window);
+        report.set(RF_ADC_STATS,         &window[AGG_ADC]);
+        report.set(RF_TEMPERATURE_STATS, &window[AGG_TEMPERATURE]);
+        report.set(RF_BAROMETER_STATS,   &window[AGG_PRESSURE]);
+        report.set(RF_HUMIDITY_STATS,    &window[AGG_HUMIDITY]);
+        }
+
+    enc.reset();
+    report.write(enc);
+
+    if( enc.overflow() ) {
+        printf("Telemetry message too large (%d bytes max)!\n", (int)enc.capacity());
+        return 0;
+        }
+    return enc.length();
+}
+
+//
+// true while there is a connection to send on, telemetry is spooled at other times
+//
+bool link_up(void)
+{
+    return (lpm_enabled == NO_LPM || lpm_enabled == ENTER_LPM) && transport.ready();
+}
+
+//
+// keeps a telemetry message that couldn't be sent, it will be sent again once connected
+//
+void spool_telemetry(const char *ptr, size_t len, int samples, int fmt)
+{
+    int dropped = spool.dropped();
+
+    if( !spool.enabled() ) {
+        printf("Telemetry not sent, %d sample(s) lost.\n", samples);
+        return;
+        }
+    if( !spool.put(ptr, len, samples, fmt) )
+        printf("Telemetry store full, %d sample(s) lost.\n", samples);
+    else if( spool.dropped() != dropped )
+        printf("Telemetry store full, %d oldest message(s) dropped.\n", spool.dropped()-dropped);
+    verbose_output("Stored %d sample(s), %d message(s) waiting to be sent.\n", samples, spool.count());
+    spool.sync();
+}
+
+//
+// telemetry the transport worker couldn't send comes back here to be stored
+//
+void store_refused(void)
+{
+    xport_msg m;
+
+    while( transport.next_refused(&m) ) {
+        spool_telemetry(m.data, m.len, m.samples, m.fmt);
+        free(m.data);
+        }
+}
+
+//
+// hands a telemetry message to the transport worker, false if it couldn't take it
+//
+static bool hand_over(const char *ptr, size_t len, int samples, int fmt)
+{
+    bool ok = transport.send(ptr, len, samples, fmt, encoders[fmt]->content_type(), encoders[fmt]->content_encoding());
+
+    printf(ok? "handed to the transport\n" : "transport busy!\n");
+    return ok;
+}
+
+//
+// re-sends stored telemetry, oldest first, a few messages at a time so the backlog doesn't swamp the link
+// (or the IoT Hub client's outgoing queue) when the connection comes back.  A message is taken out of the
+// spool once the transport has it, if the hub doesn't confirm it it comes back through store_refused().
+//
+void drain_spool(void)
+{
+    const char *ptr;
+    size_t      len;
+    int         samples, fmt, n;
+
+    if( spool.empty() || !link_up() || !spool.burst_due() )
+        return;
+
+    status_led.action(Led::LED_ON,Led::BLUE);
+    for( n=0; n<SPOOL_BURST && spool.peek(&ptr, &len, &samples, &fmt); n++ ) {
+        if( fmt >= ENC_COUNT )
+            fmt = ENC_JSON;
+        printf("Re-send stored telemetry, %d sample(s) (%d waiting) - ", samples, spool.count()-1);
+        if( !hand_over(ptr, len, samples, fmt) )
+            break;
+        spool.pop();
+        }
+    spool.sync();
+    status_led.action(Led::LED_ON,Led::GREEN);
+}
+
+//
+// sends a telemetry message (a single report or a batch of them) and prints it if verbose
+//
+void send_telemetry(char *ptr, size_t len, int samples)
 {
-    gpsstatus *loc;
-    char      buffer[25], temp[25];
-    char*     ptr = (char*)malloc(MSG_LEN);
-    time_t    rawtime;
-    struct tm *ptm;
+    static int msg_sent = 1;
+    char       buffer[12];
+    time_t     rawtime;
+
+    if( !link_up() ) {
+        spool_telemetry(ptr, len, samples, telemetry_enc);
+        return;
+        }
 
     time(&rawtime);
-    ptm = gmtime(&rawtime);
-    strftime(buffer,sizeof(buffer),"%a %F %X",ptm);
-
-    loc = gps.getLocation();
-    ptm = gmtime(&loc->last_good);
-    strftime(temp,sizeof(temp),"%a %F %X",ptm);
-
-    snprintf(ptr, MSG_LEN, IOTDEVICE_MSG_FORMAT, 
-                           REPORTING_OBJECT_NAME,
-                           REPORTING_OBJECT_TYPE,
-                           REPORTING_OBJECT_VERSION,
-                           REPORTING_DEVICE,
-                           iccid,
-                           imei,
-                           (float)adc,
-                           temp,
-                           loc->last_pos.lat,
-                           loc->last_pos.lng,
-                           mems.lis2dw12_getTemp(),
-                           mems.movement_ocured(),
-                           mems.lis2dw12_getPosition(),
-                           report_period,
-                           buffer);
-
-    if( click_modules & BAROMETER_CLICK ) {
-        snprintf(temp, sizeof(temp), ",\"Barometer\":%.02f", barom.get_pressure());
-        strcat(ptr,temp);
+    strftime(buffer,sizeof(buffer),"%X",gmtime(&rawtime));
+    status_led.action(Led::LED_ON,Led::BLUE);
+    printf("(%04d)",msg_sent++);
+    if( samples > 1 )
+        printf("Send IoTHubClient Batch of %d@%s - ",samples,buffer);
+    else
+        printf("Send IoTHubClient Message@%s - ",buffer);
+    if( !hand_over(ptr, len, samples, telemetry_enc) )
+        spool_telemetry(ptr, len, samples, telemetry_enc);
+    if( telemetry_fmt->is_text() )
+        prty_json(ptr, len);
+    else
+        verbose_output("%d bytes of %s\n\n", (int)len, telemetry_fmt->content_type());
+    status_led.action(Led::LED_ON,Led::GREEN);
+}
+
+void send_batch(void)
+{
+    char  *ptr;
+    size_t len;
+
+    if( !batch.samples() )
+        return;
+    len = batch.finish(&ptr);
+    send_telemetry(ptr, len, batch.samples());
+    batch.clear();
+}
+
+//
+// a new sample either goes straight out or is added to the current batch
+//
+void report_sample(char *ptr, size_t len)
+{
+    if( !batch.enabled() ) {
+        send_telemetry(ptr, len, 1);
+        return;
         }
+    if( !batch.fits(len) )
+        send_batch();
+    if( !batch.add(ptr, len) )      //too big to ever be batched
+        send_telemetry(ptr, len, 1);
+}
+
+//
+// makes the standard report
+//
+void report_now(void)
+{
+    size_t len;
 
-    if( click_modules & HTS221_CLICK ) {
-        snprintf(temp, sizeof(temp), ",\"Humidity\":%.01f",  humid.readHumidity());
-        strcat(ptr,temp);
+    gettimeofday(&time_sent, NULL);
+    len = make_message(*telemetry_fmt, iccid, imei);
+    if( len ) 
+        report_sample((char*)telemetry_fmt->data(), len);
+}
+
+//
+// makes the standard report when the report period is up, and sends the batch when it is ready; used by
+// the LPM states which poll once a second
+//
+void sample_telemetry(void)
+{
+    struct timeval time_now;
+
+    gettimeofday(&time_now, NULL);
+    if( difftime(time_now.tv_sec, time_sent.tv_sec) >= report_period ) 
+        report_now();
+    if( batch.ready() )
+        send_batch();
+}
+
+//------------------------------------------------------------------
+// Reactor callbacks, while connected (NO_LPM) the main loop sleeps in the reactor until one of these is due
+//
+
+static int report_timer = -1, tick_timer = -1, report_timer_period;
+
+static void on_report_timer(int, uint32_t, void *)
+{
+    if( lpm_enabled == NO_LPM )
+        report_now();
+}
+
+//
+// the house keeping tick: batch window, spool bursts and report period changes made by a command
+//
+static void on_tick(int, uint32_t, void *)
+{
+    if( report_period != report_timer_period ) {
+        report_timer_period = report_period;
+        reactor.set_timer(report_timer, report_period*1000);
         }
+    if( lpm_enabled != NO_LPM )
+        return;
+    if( batch.ready() )
+        send_batch();
+    drain_spool();
+}
+
+static void on_uart2(int, uint32_t, void *)
+{
+    chk_uart2_input();
+}
+
+bool start_reactor(void)
+{
+    if( !reactor.open() )
+        return false;
+    report_timer_period = report_period;
+    report_timer = reactor.add_timer(report_period*1000, on_report_timer);
+    tick_timer   = reactor.add_timer(REACTOR_TICK_MS, on_tick);
+    if( use_uart2 )
+        reactor.add(uart2_fd, EPOLLIN, on_uart2);
+    return report_timer >= 0 && tick_timer >= 0;
+}
 
-    strcat( ptr, "}");
+//------------------------------------------------------------------
+// The transport worker (see Transport) owns the IoT Hub client, everything below runs on it
+//
 
-    int c = (strstr(buffer,":")-buffer) - 2;
-    printf("Send IoTHubClient Message@%s - ",&buffer[c]);
-    return ptr;
+void iothub_dowork(void)
+{
+    iothub_work = false;
+    if( IoTHub_client_ll_handle != NULL )       //NULL while waiting to reconnect
+        IoTHubClient_LL_DoWork(IoTHub_client_ll_handle);
+}
+
+//
+// sends the delivery results and latency histogram as a Link-Stats telemetry message
+//
+static void send_link_stats(void)
+{
+    static char stats_buf[MSG_LEN];
+    JsonWriter  jw(stats_buf, sizeof(stats_buf));
+    size_t      len = link_stats.write(jw);
+
+    if( !len )
+        return;
+    printf("(----)Send Link-Stats - ");
+    sendMessage(IoTHub_client_ll_handle, stats_buf, len, jw.content_type(), jw.content_encoding());
+    prty_json(stats_buf, len);
+}
+
+//
+// sends the wire bytes of each traffic class as a Data-Usage telemetry message, its own bytes count
+// towards the next one
+//
+static void send_data_usage(void)
+{
+    static char usage_buf[MSG_LEN];
+    JsonWriter  jw(usage_buf, sizeof(usage_buf));
+    size_t      len = data_usage.write(jw);
+
+    if( !len )
+        return;
+    printf("(----)Send Data-Usage - ");
+    sendMessage(IoTHub_client_ll_handle, usage_buf, len, jw.content_type(), jw.content_encoding());
+    prty_json(usage_buf, len);
+}
+
+//
+// a finished capture is uploaded straight away, or when UPLOAD-CAPTURE asks for it; the progress of the
+// upload is printed as it goes and the final throughput once it is over
+//
+static void check_capture(void)
+{
+    static int  last = CAP_IDLE, ticks;
+    static char cap_buf[256];
+    JsonWriter  jw(cap_buf, sizeof(cap_buf));
+    int         s = capture.status();
+    size_t      len;
+
+    if( (capture.upload_requested() || (s == CAP_RECORDED && last == CAP_RECORDING)) &&
+        IoTHub_client_ll_handle != NULL && capture.upload(IoTHub_client_ll_handle) )
+        s = CAP_UPLOADING;
+    if( s == last && (s != CAP_UPLOADING || ++ticks*XPORT_TICK_MS < CAPTURE_PROGRESS*1000) )
+        return;
+    ticks = 0;
+    if( s != last )
+        printf("(----)Capture %s\n", Capture::state_name(s));
+    if( (len = capture.write(jw)) != 0 )
+        prty_json(cap_buf, len);
+    last = s;
+}
+
+//
+// the worker's house keeping tick: reconnects, Link-Stats, the capture upload and the device twin, the
+// worker runs DoWork (MQTT keep-alive, retries, token renewal) right after it
+//
+static void transport_tick(void)
+{
+    static int stats_ticks, usage_ticks;
+
+    if( !iothub_reconnect() ) {
+        done = true;
+        reactor.wake();
+        return;
+        }
+    if( stats_period && ++stats_ticks*XPORT_TICK_MS >= stats_period*1000 ) {
+        stats_ticks = 0;
+        send_link_stats();
+        }
+    if( usage_period && ++usage_ticks*XPORT_TICK_MS >= usage_period*1000 ) {
+        usage_ticks = 0;
+        send_data_usage();
+        }
+    check_capture();
+    twin_update();
+}
+
+//
+// the upload uses the client, it has to finish before the worker destroys it
+//
+static void transport_closing(void)
+{
+    if( capture.status() == CAP_UPLOADING ) {
+        verbose_output("Finishing the capture upload...\n");
+        capture.wait();
+        }
 }
 
 void verbose_output( const char * format, ... )
@@ -257,6 +655,17 @@ void chk_uart2_input(void) {
         if( strstr(buffer, "testoled") )
             testOLED();
 
+        if( strstr(buffer, "usage") ) {
+            char       usage[MSG_LEN];
+            JsonWriter jw(usage, sizeof(usage));
+            size_t     len = data_usage.write(jw);
+
+            if( len == 0 || write(uart2_fd, usage, len) != (ssize_t)len || write(uart2_fd, "\n", 1) != 1 )
+                printf("unable to write the data usage to UART2\n");
+            else if( iothub_transport != XPORT_MQTT && iothub_transport != XPORT_HTTP )
+                dprintf(uart2_fd, "(%s traffic is all counted as Other)\n", transport_name(iothub_transport));
+            }
+
         if( strstr(buffer, "exit") )
              done = true;
         }
@@ -265,29 +674,45 @@ void chk_uart2_input(void) {
 int main(int argc, char *argv[]) 
 {
 
-    int            i, msg_sent=1;
+    int            i;
+    int            batch_samples=0, batch_window=BATCH_DEF_WINDOW, batch_bytes=BATCH_DEF_MAX_BYTES;
+    int            spool_kbytes=SPOOL_DEF_KBYTES;
+    int            sample_ms;
+    int            cap_src=-1, cap_ms=0, cap_secs=0;
+    char          *p;
+    bool           spool_oldest=true;
+    bool           xport_set=false;
+    const char    *bench_hub=NULL, *load_hub=NULL, *idle_hub=NULL, *check_hub=NULL;
     bool           verbose_save=verbose;
-    char          *ptr;
+    char           msg_buf[MSG_LEN];
+    JsonWriter     json_msg(msg_buf, sizeof(msg_buf));
+    CborWriter     cbor_msg(msg_buf, sizeof(msg_buf));
+    MsgpackWriter  msgpack_msg(msg_buf, sizeof(msg_buf));
     Wwan           wan_led;
-    void           prty_json(char* src, int srclen);
     NTPClient      ntp;
     time_t         timestamp=-1;
-    struct timeval time_sent, time_now;
 
     gettimeofday(&time_sent, NULL);
-    gettimeofday(&time_now, NULL);
+    encoders[ENC_JSON]    = &json_msg;
+    encoders[ENC_CBOR]    = &cbor_msg;
+    encoders[ENC_MSGPACK] = &msgpack_msg;
 
     status_led.action(Led::LED_ON,Led::RED);
     user_button.button_press_cb( button_press );
     boot_button.button_press_cb( bb_press );
 
-    while((i=getopt(argc,argv,"tuvr:?")) != -1 )
+    while((i=getopt(argc,argv,"tuvbaQr:n:w:m:d:e:q:s:p:i:l:C:T:R:c:g:B:L:I:H:U:M:?")) != -1 )
         switch(i) {
            case 't':
                printf("Testing OLED-B MicroE Click Board.\n");
                testOLED();
                exit(EXIT_SUCCESS);
 
+           case 'b':
+               bench_json(100000);
+               bench_encoders();
+               exit(EXIT_SUCCESS);
+
            case 'u':
                use_uart2 = true; 
                uart2_fd = open("/dev/ttyHSL0", O_RDWR | O_NOCTTY | O_NDELAY);
@@ -321,6 +746,119 @@ int main(int argc, char *argv[])
                printf(">> auto update every %d seconds ",report_period);
                printf("(reports in %dx second increments)\n",REPORT_PERIOD_RESOLUTION);
                break;
+           case 'n':
+               batch_samples = atoi(optarg);
+               break;
+           case 'w':
+               batch_window = atoi(optarg);
+               break;
+           case 'm':
+               batch_bytes = atoi(optarg);
+               break;
+           case 'd':
+               report.deadband_mode(atoi(optarg));
+               printf(">> deadband reporting, full report every %d reports\n", atoi(optarg));
+               break;
+           case 'e':
+               if( !strcmp(optarg, "cbor") )
+                   telemetry_enc = ENC_CBOR;
+               else if( !strcmp(optarg, "msgpack") )
+                   telemetry_enc = ENC_MSGPACK;
+               else if( !strcmp(optarg, "json") )
+                   telemetry_enc = ENC_JSON;
+               else {
+                   printf(">> unknown telemetry encoding '%s'\n", optarg);
+                   exit(EXIT_FAILURE);
+                   }
+               printf(">> telemetry sent as %s\n", encoders[telemetry_enc]->content_type());
+               break;
+           case 'a':
+               sensors.aggregate(true);
+               printf(">> report statistics of the readings taken during each report period\n");
+               break;
+           case 's':
+               sample_ms = atoi(optarg);
+               if( sample_ms < 100 )
+                   sample_ms = 100;
+               sensors.set_period(sample_ms);
+               printf(">> sample the sensors every %d ms\n", sample_ms);
+               break;
+           case 'p':
+               p = strchr(optarg, '=');
+               if( p != NULL )
+                   *p++ = '\0';
+               sample_ms = (p != NULL)? atoi(p) : 0;
+               if( sample_ms < 100 || !sensors.set_period(Sampler::source(optarg), sample_ms) ) {
+                   printf(">> expected -p sensor=ms (at least 100ms), see -?\n");
+                   exit(EXIT_FAILURE);
+                   }
+               printf(">> sample %s every %d ms\n", optarg, sample_ms);
+               break;
+           case 'q':
+               spool_kbytes = atoi(optarg);
+               break;
+           case 'Q':
+               spool_oldest = false;
+               break;
+           case 'i':
+               link_stats.set_window(atoi(optarg));
+               printf(">> up to %d messages waiting for confirmation\n", link_stats.window_size());
+               break;
+           case 'l':
+               stats_period = atoi(optarg);
+               printf(">> send link statistics every %d seconds\n", stats_period);
+               break;
+           case 'U':
+               usage_period = atoi(optarg);
+               printf(">> send data usage every %d seconds\n", usage_period);
+               break;
+           case 'C':
+               p = strchr(optarg, '=');
+               if( p != NULL )
+                   *p++ = '\0';
+               if( p == NULL || (cap_src=Capture::source(optarg)) < 0 || sscanf(p, "%d,%d", &cap_ms, &cap_secs) != 2 ) {
+                   printf(">> expected -C source=ms,seconds, see -?\n");
+                   exit(EXIT_FAILURE);
+                   }
+               printf(">> capture %s every %d ms for %d seconds\n", optarg, cap_ms, cap_secs);
+               break;
+           case 'T':
+               if( (iothub_transport=transport_id(optarg)) < 0 ) {
+                   printf(">> unknown transport '%s', see -?\n", optarg);
+                   exit(EXIT_FAILURE);
+                   }
+               xport_set = true;
+               break;
+           case 'R':
+               if( (retry_policy=retry_policy_id(optarg)) < 0 ) {
+                   printf(">> unknown retry policy '%s', see -?\n", optarg);
+                   exit(EXIT_FAILURE);
+                   }
+               break;
+           case 'c':
+               retry_cap = atoi(optarg);
+               if( retry_cap < RETRY_BASE_SECS )
+                   retry_cap = RETRY_BASE_SECS;
+               break;
+           case 'g':
+               retry_giveup = atoi(optarg);
+               printf(">> give up after %d seconds without a connection\n", retry_giveup);
+               break;
+           case 'B':
+               bench_hub = optarg;
+               break;
+           case 'L':
+               load_hub = optarg;
+               break;
+           case 'I':
+               idle_hub = optarg;
+               break;
+           case 'H':
+               check_hub = optarg;
+               break;
+           case 'M':
+               bench_mal(atoi(optarg));
+               exit(EXIT_SUCCESS);
            case '?':
                usage();
                exit(EXIT_SUCCESS);
@@ -329,6 +867,24 @@ int main(int argc, char *argv[])
                exit(EXIT_FAILURE);
            }
 
+    if( bench_hub != NULL ) {
+        if( xport_set )
+            bench_transports(bench_hub, iothub_transport, iothub_transport);
+        else
+            bench_transports(bench_hub, 0, XPORT_COUNT-1);
+        exit(EXIT_SUCCESS);
+        }
+    if( load_hub != NULL ) {
+        exit(bench_load(load_hub, iothub_transport)? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    if( idle_hub != NULL ) {
+        bench_idle(idle_hub, iothub_transport);
+        exit(EXIT_SUCCESS);
+        }
+    if( check_hub != NULL ) {
+        exit(hub_check(check_hub)? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+
     printf("\n\n");
     printf("     ****\r\n");
     printf("    **  **     Azure IoTClient Example, version %s\r\n", APP_VERSION);
@@ -337,11 +893,19 @@ int main(int argc, char *argv[])
     printf("\r\n");
     printf("This program uses the AT&T IoT Starter Kit, M18QWG (Global)/M18Q2FG-1 (North America) SoC \r\n");
     printf("and interacts with Azure IoTHub sending sensor data and receiving messeages.\r\n");
-    #ifdef USE_MQTT
-    printf(" >>using MQTT as the transport protocol<<\r\n");
-    #else
-    printf(" >>using HTTP as the transport protocol<<\r\n");
-    #endif
+    printf(" >>using %s as the transport protocol<<\r\n", transport_name(iothub_transport));
+    printf(" >>retry policy %s, reconnects at most %d seconds apart<<\r\n", retry_policy_name(retry_policy), retry_cap);
+    telemetry_fmt = encoders[telemetry_enc];
+    if( !batch.configure(telemetry_fmt, batch_samples, batch_window, batch_bytes) )
+        printf(" >>unable to allocate a %d byte batch, batching disabled<<\r\n", batch_bytes);
+    else if( batch.enabled() )
+        printf(" >>telemetry sent in batches of up to %d samples/%d seconds<<\r\n", batch.size(), batch_window);
+    if( spool_kbytes > 0 ) {
+        if( !spool.open(SPOOL_DEF_PATH, spool_kbytes*1024, spool_oldest) )
+            printf(" >>unable to open %s, telemetry is not stored while disconnected<<\r\n", SPOOL_DEF_PATH);
+        else if( !spool.empty() )
+            printf(" >>%d stored telemetry message(s) will be sent once connected<<\r\n", spool.count());
+        }
     printf("\r\n");
 
     status_led.action(Led::LED_BLINK,Led::RED);
@@ -354,6 +918,10 @@ int main(int argc, char *argv[])
 
     if( click_modules & BAROMETER_CLICK ) printf("Click-Barometer PRESENT!\n");
     if( click_modules & HTS221_CLICK ) printf(   "Click-Temp&Hum  PRESENT!\n\n");
+    if( !sensors.start(click_modules) ) {
+        printf("ERROR:unable to create the sensor sampling timers!\n");
+        exit(EXIT_FAILURE);
+        }
 
     status_led.set_interval(125);
     status_led.action(Led::LED_BLINK,Led::GREEN);
@@ -384,14 +952,17 @@ int main(int argc, char *argv[])
     status_led.set_interval(500);
     status_led.action(Led::LED_ON,Led::GREEN);
     verbose_output("Now, establish connection with Azure IoT Hub.\n\n");
-    IoTHub_client_ll_handle =setup_azure();
-    if( IoTHub_client_ll_handle == NULL ) {
-        printf("ERROR:couldn't connect to Azure!\n");
+    data_usage.start();
+    if( !start_reactor() || !transport.start(&reactor, transport_tick, transport_closing) ) {
+        printf("ERROR:unable to create the event loop!\n");
         exit(EXIT_FAILURE);
         }
 
     status_led.action(Led::LED_ON,Led::GREEN);
     lpm_enabled = NO_LPM;
+    sample_telemetry();
+    if( cap_src >= 0 && !capture.start(cap_src, cap_ms, cap_secs) )
+        printf("ERROR:unable to create %s!\n", CAPTURE_DEF_PATH);
 
     while( !done ) {
         switch (lpm_enabled) {
@@ -400,10 +971,12 @@ int main(int argc, char *argv[])
                 verbose_save = verbose;  //while in LPM, always output status messages...
                 verbose = true;
                 verbose_output("\nEnter Low Power Mode.\n");
+                send_batch();
+                transport.stop();        //sends what it can and destroys the client
+                store_refused();
                 gps.disable();
                 if( device.setLPM(true) == 0)
                     lpm_enabled = IN_LPM;
-                IoTHubClient_LL_Destroy(IoTHub_client_ll_handle);
                 status_led.set_interval(2000);
                 status_led.action(Led::LED_BLINK,Led::RED);
                 break;
@@ -415,15 +988,14 @@ int main(int argc, char *argv[])
                 while( timestamp == -1 ) {
                     timestamp=ntp.get_timestamp();
                     verbose_output("\rExit Low Power Mode, restart Cellular Connection (%d)",i++);
+                    if( spool.enabled() )
+                        sample_telemetry();
                     sleep(1);
                     }
                 verbose_output("\n\n");
                 stime(&timestamp);
-                IoTHub_client_ll_handle =setup_azure();
-                if( IoTHub_client_ll_handle == NULL ) {
-                    printf("ERROR:couldn't connect to Azure!\n");
-                    exit(EXIT_FAILURE);
-                    }
+                if( !transport.start(&reactor, transport_tick, transport_closing) )
+                    printf("ERROR:unable to start the transport worker!\n");
                 gps.enable();
                 if( device.setLPM(false) == 0 ) 
                     lpm_enabled = NO_LPM;
@@ -434,22 +1006,16 @@ int main(int argc, char *argv[])
             case IN_LPM:
                 verbose_output("Low Power Mode active, Sleeping (%3d seconds)\r",i++);
                 fflush(stdout);
+                if( spool.enabled() )
+                    sample_telemetry();
                 sleep(1);
                 break;
 
             case NO_LPM:
-                gettimeofday(&time_now, NULL);
-                if( difftime(time_now.tv_sec, time_sent.tv_sec) >= report_period ) {
-                    time_sent = time_now;
-                    status_led.action(Led::LED_ON,Led::BLUE);
-                    printf("(%04d)",msg_sent++);
-                    ptr = make_message(iccid, imei);
-                    sendMessage(IoTHub_client_ll_handle, ptr, strlen(ptr));
-                    prty_json(ptr,strlen(ptr));
-                    free(ptr);
-                    status_led.action(Led::LED_ON,Led::GREEN);
-                    }
-                IoTHubClient_LL_DoWork(IoTHub_client_ll_handle);
+                //sleeps until UART2, a timer, a button or the transport worker needs attention
+                reactor.run_once(-1);
+                run_commands();
+                store_refused();
                 break;
             }
         chk_uart2_input();
@@ -458,20 +1024,27 @@ int main(int argc, char *argv[])
     status_led.set_interval(125);
     status_led.action(Led::LED_BLINK,Led::RED);
 
+    capture.stop();
+    if( !lpm_enabled ) {
+        send_batch();
+        verbose_output("\nClosing connection to Azure IoT Hub...\n\n");
+        transport.stop();            //the worker may still start an upload, stop it before waiting
+        }
+    else
+        send_batch();                //goes to the spool
+    store_refused();
+    spool.close();
+    capture.wait();
+    sensors.terminate();
     gps.terminate();
     user_button.terminate();
     boot_button.terminate();
     mems.terminate();
 
-    if( !lpm_enabled ) {
-        verbose_output("\nClosing connection to Azure IoT Hub...\n\n");
-        IoTHubClient_LL_Destroy(IoTHub_client_ll_handle);
-        }
-
     status_led.terminate();
     wan_led.terminate();
 
     printf(" - - - - - - - ALL DONE - - - - - - -            \n");
-    exit(EXIT_SUCCESS);
+    exit(iothub_gave_up()? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
@@ -19,10 +19,21 @@
 
 #define APP_VERSION             "1.3"
 #define REPORT_PERIOD_RESOLUTION 10  //minimum reporting period in seconds 
+#define MSG_LEN                 1024 //largest telemetry/report message we build
 
 #define IOT_AGENT_OK CODEFIRST_OK  //Microsoft code bug...
 
-#define USE_MQTT                   //define USE_MQTT to use MQTT, otherwise it will use HTTP
+//IoT Hub transports, selected at run time (-T)
+#define XPORT_MQTT               0
+#define XPORT_MQTT_WS            1    //MQTT over WebSockets, port 443
+#define XPORT_AMQP               2
+#define XPORT_AMQP_WS            3    //AMQP over WebSockets, port 443
+#define XPORT_HTTP               4
+#define XPORT_COUNT              5
+
+//in-process reconnects, once the IoT Hub client has given up (-R, -c, -g)
+#define RETRY_BASE_SECS          2    //first wait, doubled on each failed attempt...
+#define RETRY_DEF_CAP            300  //...up to this many seconds
 
 #define BAROMETER_CLICK          0x01
 #define HTS221_CLICK             0x02
@@ -38,11 +49,17 @@
 
 #ifndef __AZIOTCLIENT_CPP__
 
+class Capture;                  //capture.hpp and transport.hpp, not every includer needs them
+class Transport;
+
 extern IOTHUB_CLIENT_LL_HANDLE  IoTHub_client_ll_handle;
 
 extern int          gps_to;
 extern int          report_period;
 extern bool         verbose;
+extern bool         iothub_work;
+extern uint32_t     iothub_generation;
+extern int          iothub_transport;
 extern char         imei[25];
 extern char         iccid[25];
 
@@ -52,6 +69,9 @@ extern Led          status_led;
 extern Barometer    barom;
 extern Hts221       humid;
 extern Wncgps       gps;
+extern Sampler      sensors;
+extern Capture      capture;
+extern Transport    transport;
 extern unsigned int click_modules;
 
 extern Led::Color  current_color;
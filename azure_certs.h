@@ -11,6 +11,9 @@ extern "C"
 
 	extern const char certificates[];
 
+	/* only the roots that the hub's certificate chains up to, certificates[] if the host isn't known */
+	const char* certificates_for_host(const char* hostname);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,121 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   batcher.hpp
+*   @brief  The Batcher class collects several telemetry samples and sends them to Azure as a single array
+*           message (a JSON array, or a CBOR/MessagePack array when a binary encoder is used).  Over cellular
+*           the per-message MQTT/HTTP and TLS overhead is larger than a ~400 byte report so grouping samples
+*           cuts the number of radio wake-ups and the bytes on the wire.  Each sample keeps its own TOD time
+*           stamp.  A batch is sent when it holds 'max_samples' samples, when the oldest sample in it is
+*           'window' seconds old, or when the next sample would make it larger than 'max_bytes'.
+*
+*           The buffer is allocated once when the batcher is configured, adding samples does no allocation.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#ifndef __BATCHER_HPP__
+#define __BATCHER_HPP__
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "encoder.hpp"
+
+#define BATCH_DEF_WINDOW       60       //default seconds a sample may wait in a batch
+#define BATCH_DEF_MAX_BYTES    4096     //default largest batch message
+#define BATCH_MAX_BYTES        65536    //IoT Hub allows 256KB but keep it reasonable for the M18Qx
+
+class Batcher {
+    private:
+        char            *buf;
+        const Encoder   *fmt;            //supplies the array header, separator and trailer
+        size_t           len;            //bytes of samples, they start at buf+Encoder::ARRAY_HDR_MAX
+        size_t           max_bytes;
+        int              max_samples;
+        int              window;
+        int              count;
+        struct timespec  first;          //when the oldest sample in the batch was added
+
+    public:
+        Batcher() : buf(NULL), fmt(NULL), len(0), max_bytes(0), max_samples(0), window(0), count(0) { }
+
+        ~Batcher() { free(buf); }
+
+        //returns false if the buffer could not be allocated, batching is disabled when samples < 2
+        bool configure(const Encoder *enc, int samples, int window_sec=BATCH_DEF_WINDOW, size_t bytes=BATCH_DEF_MAX_BYTES) {
+            free(buf);
+            fmt = enc;
+            buf = NULL;
+            max_samples = (samples > 1)? samples : 0;
+            window = window_sec;
+            max_bytes = (bytes > BATCH_MAX_BYTES)? BATCH_MAX_BYTES : bytes;
+            clear();
+            if( !max_samples )
+                return true;
+            buf = (char*)malloc(max_bytes);
+            if( buf == NULL )
+                max_samples = 0;
+            return buf != NULL;
+            }
+
+        bool enabled(void) { return max_samples != 0; }
+        int  samples(void) { return count; }
+        int  size(void)    { return max_samples; }
+
+        void clear(void) {
+            len = 0;
+            count = 0;
+            }
+
+        //true if a sample of 'n' bytes can be added without going over max_bytes (allowing for the array
+        //header, a separator and the trailer)
+        bool fits(size_t n) {
+            return Encoder::ARRAY_HDR_MAX + len + n + 2 <= max_bytes;
+            }
+
+        //add a sample; the caller must have checked fits() and sent the current batch if it didn't
+        bool add(const char *sample, size_t n) {
+            if( !fits(n) )
+                return false;
+            if( !count++ )
+                clock_gettime(CLOCK_MONOTONIC, &first);
+            char *p = buf + Encoder::ARRAY_HDR_MAX;
+            if( len )
+                len += fmt->array_separator((unsigned char*)p+len);
+            memcpy(p+len, sample, n);
+            len += n;
+            return true;
+            }
+
+        //true when the batch is full or its oldest sample has waited long enough
+        bool ready(void) {
+            struct timespec now;
+            if( !count )
+                return false;
+            if( count >= max_samples )
+                return true;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            return (now.tv_sec - first.tv_sec) >= window;
+            }
+
+        //wraps the samples in an array and returns its length, the batch stays valid until clear()
+        size_t finish(char **msg) {
+            unsigned char hdr[Encoder::ARRAY_HDR_MAX];
+            char  *p = buf + Encoder::ARRAY_HDR_MAX;
+            size_t h = fmt->array_header(hdr, count);
+            size_t t = fmt->array_trailer((unsigned char*)p+len);
+
+            memcpy(p-h, hdr, h);
+            *msg = p-h;
+            return h + len + t;
+            }
+};
+
+#endif // __BATCHER_HPP__
@@ -0,0 +1,606 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   bench.cpp
+*   @brief  small benchmarks that can be run on the M18Qx with the '-b' option.  They use fixed data so that
+*           only the code being measured is timed (no sensor, MAL or network access).  The transport benchmark
+*           ('-B'), the load sweep ('-L') and the idle CPU measurement ('-I') are the exception, they talk to a
+*           hub or a local stand-in for one, as does the hub check ('-H'), and so is the MAL benchmark ('-M')
+*           which talks to the MAL manager.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "jsonwriter.hpp"
+#include "binwriter.hpp"
+#include "report.hpp"
+#include "linkstats.hpp"
+#include "iothub_client_ll.h"
+#include "tlsio_socket.h"
+#include "mal.hpp"
+#include "reactor.hpp"
+#include "transport.hpp"
+#include "capture.hpp"
+
+#define BENCH_MSG_LEN     512
+
+#define BENCH_XPORT_MSGS        20       //messages sent over each transport
+#define BENCH_XPORT_TIMEOUT_MS  30000    //to wait for each confirmation
+#define BENCH_DOWORK_MS         5
+
+#define BENCH_LOAD_SECS         10       //each rate of the load sweep is offered this long
+#define BENCH_IDLE_SECS         30       //each way of servicing an idle client is measured this long
+#define BENCH_HUB_SECS          20       //the hub check runs this long
+#define BENCH_CAPTURE_PATH      "/tmp/azIoTClient-check.cap"
+#define BENCH_CAPTURE_ROWS      8192     //of 15 bytes, the upload takes 4 CAPTURE_BLOCKs
+
+IOTHUB_CLIENT_LL_HANDLE create_client(const char *connection_string, int xport, const TLSIO_SOCKET_WATCH *watch=NULL);
+const char *transport_name(int xport);
+bool sendMessage(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char* buffer, size_t size, 
+                 const char* content_type=NULL, const char* content_encoding=NULL, void *payload=NULL,
+                 bool reply=false);
+bool iothub_reconnect(void);
+void iothub_connection_string(const char *cs);
+void twin_update(void);
+void run_commands(void);
+extern LinkStats link_stats;
+extern int       iothub_transport;
+extern Transport transport;
+extern Capture   capture;
+extern IOTHUB_CLIENT_LL_HANDLE IoTHub_client_ll_handle;
+
+static const char *b_name   = "Avnet M18x LTE SOM Azure IoT Client";
+static const char *b_type   = "SensorData";
+static const char *b_vers   = "1.3";
+static const char *b_device = "M18QWG/M18Q2FG-1";
+static const char *b_iccid  = "89011703278100000000";
+static const char *b_imei   = "353087080010952";
+
+static double elapsed_ns(struct timespec *s, struct timespec *e)
+{
+    return (e->tv_sec - s->tv_sec)*1e9 + (e->tv_nsec - s->tv_nsec);
+}
+
+//
+// the report exactly as make_message() used to build it: malloc, snprintf of the whole format,
+// strcat of each click field then a strlen for the send and another for the pretty printer.
+//
+#define LEGACY_MSG_FORMAT          \
+   "{"                             \
+     "\"ObjectName\":\"%s\","      \
+     "\"ObjectType\":\"%s\","      \
+     "\"Version\":\"%s\","         \
+     "\"ReportingDevice\":\"%s\"," \
+     "\"DeviceICCID\":\"%s\","     \
+     "\"DeviceIMEI\":\"%s\","      \
+     "\"ADC_value\":%.02f,"        \
+     "\"last GPS fix\":\"%s\","    \
+     "\"lat\":%.02f,"              \
+     "\"long\":%.02f,"             \
+     "\"Temperature\":%.02f,"      \
+     "\"Board Moved\":%d,"         \
+     "\"Board Position\":%d,"      \
+     "\"Report Period\":%d,"       \
+     "\"TOD\":\"%s UTC\""
+
+static size_t legacy_message(struct tm *ptm, char *out)
+{
+    char   buffer[25], temp[25];
+    char*  ptr = (char*)malloc(BENCH_MSG_LEN);
+    size_t len;
+
+    strftime(buffer,sizeof(buffer),"%a %F %X",ptm);
+    strftime(temp,sizeof(temp),"%a %F %X",ptm);
+
+    snprintf(ptr, BENCH_MSG_LEN, LEGACY_MSG_FORMAT, b_name, b_type, b_vers, b_device, b_iccid, b_imei,
+             0.04, temp, 40.71, -74.00, 82.29, 0, 10, 10, buffer);
+
+    snprintf(temp, sizeof(temp), ",\"Barometer\":%.02f", 1020.20);
+    strcat(ptr,temp);
+    snprintf(temp, sizeof(temp), ",\"Humidity\":%.01f", 62.4);
+    strcat(ptr,temp);
+    strcat( ptr, "}");
+
+    len = strlen(ptr);              //sendMessage()
+    len = strlen(ptr);              //prty_json()
+    memcpy(out, ptr, len+1);
+    free(ptr);
+    return len;
+}
+
+static size_t writer_message(JsonWriter& jw, struct tm *ptm)
+{
+    jw.reset();
+    jw.begin_object()
+      .member("ObjectName",      b_name)
+      .member("ObjectType",      b_type)
+      .member("Version",         b_vers)
+      .member("ReportingDevice", b_device)
+      .member("DeviceICCID",     b_iccid)
+      .member("DeviceIMEI",      b_imei)
+      .member("ADC_value",       0.04, 2)
+      .member("last GPS fix",    ptm, "%a %F %X")
+      .member("lat",             40.71, 2)
+      .member("long",            -74.00, 2)
+      .member("Temperature",     82.29, 2)
+      .member("Board Moved",     0)
+      .member("Board Position",  10)
+      .member("Report Period",   10)
+      .member("TOD",             ptm, "%a %F %X UTC")
+      .member("Barometer",       1020.20, 2)
+      .member("Humidity",        62.4, 1)
+      .end_object();
+    return jw.length();
+}
+
+void bench_json(int iterations)
+{
+    char            legacy[BENCH_MSG_LEN], out[BENCH_MSG_LEN];
+    JsonWriter      jw(out, sizeof(out));
+    struct timespec s, e;
+    struct tm       t;
+    time_t          now = time(NULL);
+    size_t          llen=0, wlen=0;
+    double          lns, wns;
+
+    gmtime_r(&now, &t);
+
+    clock_gettime(CLOCK_MONOTONIC, &s);
+    for( int i=0; i<iterations; i++ )
+        llen = legacy_message(&t, legacy);
+    clock_gettime(CLOCK_MONOTONIC, &e);
+    lns = elapsed_ns(&s, &e) / iterations;
+
+    clock_gettime(CLOCK_MONOTONIC, &s);
+    for( int i=0; i<iterations; i++ )
+        wlen = writer_message(jw, &t);
+    clock_gettime(CLOCK_MONOTONIC, &e);
+    wns = elapsed_ns(&s, &e) / iterations;
+
+    printf("JSON report serializer, %d iterations\n", iterations);
+    printf("  malloc/snprintf/strcat : %8.0f ns/report, %d bytes\n", lns, (int)llen);
+    printf("  JsonWriter             : %8.0f ns/report, %d bytes\n", wns, (int)wlen);
+    printf("  speedup                : %8.2fx\n", lns/wns);
+    if( llen != wlen || memcmp(legacy, out, llen) )
+        printf("  WARNING: outputs differ!\n  %s\n  %s\n", legacy, out);
+}
+
+static void fill_report(Report& r, time_t now)
+{
+    r.clear();
+    r.set(RF_OBJECT_NAME,  b_name);
+    r.set(RF_OBJECT_TYPE,  b_type);
+    r.set(RF_VERSION,      b_vers);
+    r.set(RF_DEVICE,       b_device);
+    r.set(RF_ICCID,        b_iccid);
+    r.set(RF_IMEI,         b_imei);
+    r.set(RF_ADC,          0.04);
+    r.set(RF_GPS_FIX,      now);
+    r.set(RF_LAT,          40.71);
+    r.set(RF_LONG,         -74.00);
+    r.set(RF_TEMPERATURE,  82.29);
+    r.set(RF_MOVED,        0);
+    r.set(RF_POSITION,     10);
+    r.set(RF_PERIOD,       10);
+    r.set(RF_TOD,          now);
+    r.set(RF_BAROMETER,    1020.20);
+    r.set(RF_HUMIDITY,     62.4);
+}
+
+//
+// size and encode time of the same complete report in each of the telemetry encodings
+//
+void bench_encoders(void)
+{
+    const int       iterations = 100000;
+    char            out[BENCH_MSG_LEN];
+    JsonWriter      json(out, sizeof(out));
+    CborWriter      cbor(out, sizeof(out));
+    MsgpackWriter   msgpack(out, sizeof(out));
+    Encoder        *enc[] = { &json, &cbor, &msgpack };
+    Report          r;
+    struct timespec s, e;
+    time_t          now = time(NULL);
+    size_t          jlen = 0;
+
+    fill_report(r, now);
+    printf("Telemetry encodings, %d iterations\n", iterations);
+    for( unsigned int i=0; i<sizeof(enc)/sizeof(enc[0]); i++ ) {
+        clock_gettime(CLOCK_MONOTONIC, &s);
+        for( int n=0; n<iterations; n++ ) {
+            enc[i]->reset();
+            r.write(*enc[i]);
+            }
+        clock_gettime(CLOCK_MONOTONIC, &e);
+        if( i == 0 )
+            jlen = enc[i]->length();
+        printf("  %-22s : %8.0f ns/report, %3d bytes (%.2fx smaller)\n", enc[i]->content_type(),
+               elapsed_ns(&s, &e) / iterations, (int)enc[i]->length(), (double)jlen/enc[i]->length());
+        }
+}
+
+//------------------------------------------------------------------
+// The same workload over each transport: BENCH_XPORT_MSGS reports are sent one at a time, each waiting for
+// its confirmation, so the latency is that of the transport and not of a queue.  Connect time runs from
+// creating the client to the end of the first TLS handshake (DNS, TCP and TLS); the byte counts are what
+// went over the sockets, connect, keep-alives and disconnect included.
+//
+
+static struct timespec xport_open;
+
+static void bench_socket(int, int events, void *)
+{
+    if( (events & TLSIO_OPEN) && !xport_open.tv_sec )
+        clock_gettime(CLOCK_MONOTONIC, &xport_open);
+}
+
+// runs the client until the message just sent has been confirmed, false if it took too long
+static bool bench_confirm(IOTHUB_CLIENT_LL_HANDLE h)
+{
+    struct timespec naptime = { 0, BENCH_DOWORK_MS*1000000L };
+
+    for( int ms=0; link_stats.pending() && ms<BENCH_XPORT_TIMEOUT_MS; ms+=BENCH_DOWORK_MS ) {
+        IoTHubClient_LL_DoWork(h);
+        nanosleep(&naptime, NULL);
+        }
+    return !link_stats.pending();
+}
+
+//
+// benchmarks transports 'first' to 'last' (XPORT_ values)
+//
+void bench_transports(const char *connection_string, int first, int last)
+{
+    char            out[BENCH_MSG_LEN];
+    JsonWriter      json(out, sizeof(out));
+    Report          r;
+    struct timespec s;
+    uint64_t        tx, rx;
+    int             sent;
+    TLSIO_SOCKET_WATCH watch = { bench_socket, NULL };
+
+    fill_report(r, time(NULL));
+    r.write(json);
+    printf("IoT Hub transports, %d messages of %d bytes each\n", BENCH_XPORT_MSGS, (int)json.length());
+    printf("  %-8s  %10s  %9s  %9s  %9s  %10s  %10s  %s\n", "", "connect ms", "tx bytes", "rx bytes", "bytes/msg",
+           "mean ms", "max ms", "ok");
+    link_stats.set_window(1);
+    for( int x=first; x<=last; x++ ) {
+        IOTHUB_CLIENT_LL_HANDLE h;
+
+        link_stats.clear();
+        tlsio_mbedtls_forget_sessions();        //every transport starts with a full handshake
+        tlsio_mbedtls_reset_wire_bytes();
+        memset(&xport_open, 0x00, sizeof(xport_open));
+        clock_gettime(CLOCK_MONOTONIC, &s);
+        if( (h=create_client(connection_string, x, &watch)) == NULL ) {
+            printf("  %-8s  unable to create the client\n", transport_name(x));
+            continue;
+            }
+        for( sent=0; sent<BENCH_XPORT_MSGS; sent++ ) {
+            fill_report(r, time(NULL));
+            json.reset();
+            r.write(json);
+            if( !sendMessage(h, out, json.length(), json.content_type(), json.content_encoding()) || !bench_confirm(h) )
+                break;
+            }
+        IoTHubClient_LL_Destroy(h);
+        tlsio_mbedtls_get_wire_bytes(&tx, &rx);
+
+        printf("  %-8s  %10.1f  %9llu  %9llu  %9llu  %10.1f  %10.1f  %u/%d\n", transport_name(x),
+               xport_open.tv_sec? elapsed_ns(&s, &xport_open)/1e6 : -1.0, (unsigned long long)tx, (unsigned long long)rx,
+               link_stats.count(SEND_OK)? (unsigned long long)(tx+rx)/link_stats.count(SEND_OK) : 0ULL,
+               link_stats.mean_ms(), link_stats.max_ms(), (unsigned)link_stats.count(SEND_OK), BENCH_XPORT_MSGS);
+        }
+}
+
+//------------------------------------------------------------------
+// The load sweep: one connected client is offered reports at each of bench_rates[] for BENCH_LOAD_SECS, up to
+// the in-flight window (-i) at a time.  For each rate it prints the messages/s that were acknowledged, the
+// p50/p99 send-to-acknowledge latency, the messages refused because the window was full, the CPU time used
+// as a percentage of the wall time, and the resident set size at the end.  Reports that can't be sent are
+// not retried, the point where the acknowledged rate stops following the offered one is the limit.
+//
+
+static const int bench_rates[] = { 1, 2, 5, 10, 20, 50, 100 };
+
+static double cpu_secs(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec)/1e6;
+}
+
+static long rss_kbytes(void)
+{
+    FILE *fp = fopen("/proc/self/statm", "r");
+    long  size, resident = 0;
+
+    if( fp != NULL ) {
+        if( fscanf(fp, "%ld %ld", &size, &resident) != 2 )
+            resident = 0;
+        fclose(fp);
+        }
+    return resident * (sysconf(_SC_PAGESIZE)/1024);
+}
+
+// runs the client until every message sent has been confirmed or 'ms' have passed
+static void bench_settle(IOTHUB_CLIENT_LL_HANDLE h, int ms)
+{
+    struct timespec naptime = { 0, BENCH_DOWORK_MS*1000000L };
+
+    for( ; link_stats.pending() && ms > 0; ms -= BENCH_DOWORK_MS ) {
+        IoTHubClient_LL_DoWork(h);
+        nanosleep(&naptime, NULL);
+        }
+}
+
+//
+// sweeps the offered message rate over transport 'xport', false if the client couldn't be created or nothing
+// was acknowledged at the first rate
+//
+bool bench_load(const char *connection_string, int xport)
+{
+    char            out[BENCH_MSG_LEN];
+    JsonWriter      json(out, sizeof(out));
+    Report          r;
+    struct timespec s, e, next, naptime = { 0, BENCH_DOWORK_MS*1000000L };
+    IOTHUB_CLIENT_LL_HANDLE h;
+    double          cpu, secs;
+    uint32_t        offered, refused;
+    bool            ok = false;
+
+    if( (h=create_client(connection_string, xport)) == NULL ) {
+        printf("unable to create the %s client\n", transport_name(xport));
+        return false;
+        }
+    fill_report(r, time(NULL));
+    r.write(json);
+    printf("Load sweep over %s, %d byte reports, %d s per rate\n", transport_name(xport), (int)json.length(), BENCH_LOAD_SECS);
+
+    //the first message carries the connect, it isn't part of any rate
+    if( sendMessage(h, out, json.length(), json.content_type(), json.content_encoding()) )
+        bench_settle(h, BENCH_XPORT_TIMEOUT_MS);
+
+    printf("  %8s  %8s  %8s  %8s  %8s  %8s  %6s  %8s\n", "offered", "msgs/s", "p50 ms", "p99 ms", "max ms", "refused",
+           "cpu %", "rss KB");
+    for( unsigned int i=0; i<sizeof(bench_rates)/sizeof(bench_rates[0]); i++ ) {
+        long step_ns = 1000000000L / bench_rates[i];
+
+        link_stats.clear();
+        offered = refused = 0;
+        cpu = cpu_secs();
+        clock_gettime(CLOCK_MONOTONIC, &s);
+        next = s;
+        for( ;; ) {
+            clock_gettime(CLOCK_MONOTONIC, &e);
+            if( elapsed_ns(&s, &e) >= BENCH_LOAD_SECS*1e9 )
+                break;
+            //sends on schedule, a late step is sent at once rather than skipped
+            while( elapsed_ns(&next, &e) >= 0 && elapsed_ns(&s, &next) < BENCH_LOAD_SECS*1e9 ) {
+                fill_report(r, time(NULL));
+                json.reset();
+                r.write(json);
+                offered++;
+                if( !sendMessage(h, out, json.length(), json.content_type(), json.content_encoding()) )
+                    refused++;
+                next.tv_nsec += step_ns;
+                if( next.tv_nsec >= 1000000000L ) {
+                    next.tv_sec++;
+                    next.tv_nsec -= 1000000000L;
+                    }
+                }
+            IoTHubClient_LL_DoWork(h);
+            nanosleep(&naptime, NULL);
+            }
+        bench_settle(h, BENCH_XPORT_TIMEOUT_MS);
+        clock_gettime(CLOCK_MONOTONIC, &e);
+        secs = elapsed_ns(&s, &e)/1e9;
+        cpu  = cpu_secs() - cpu;
+
+        printf("  %8d  %8.1f  %8.0f  %8.0f  %8.0f  %8u  %6.1f  %8ld\n", bench_rates[i],
+               link_stats.count(SEND_OK)/secs, link_stats.percentile_ms(50.0), link_stats.percentile_ms(99.0),
+               link_stats.max_ms(), (unsigned)refused, 100.0*cpu/secs, rss_kbytes());
+        if( i == 0 )
+            ok = link_stats.count(SEND_OK) > 0;
+        if( offered && link_stats.count(SEND_OK) == 0 )
+            break;                                 //nothing is getting through, higher rates won't either
+        }
+    IoTHubClient_LL_Destroy(h);
+    return ok;
+}
+
+//------------------------------------------------------------------
+// Idle CPU: a connected client with nothing to send is serviced for BENCH_IDLE_SECS the way the main loop
+// used to (IoTHubClient_LL_DoWork() over and over) and then the way the transport worker does (waiting in
+// epoll on the socket and a XPORT_TICK_MS tick).  For each, the CPU time used as a percentage of the wall
+// time and the number of times the client was run per second are printed.
+//
+
+static Reactor                 idle_loop;
+static IOTHUB_CLIENT_LL_HANDLE idle_client;
+static uint32_t                idle_runs;
+
+static void idle_ready(int, uint32_t, void *)
+{
+    IoTHubClient_LL_DoWork(idle_client);
+    idle_runs++;
+}
+
+static void idle_socket(int fd, int events, void *)
+{
+    uint32_t ev = ((events & TLSIO_WANT_READ)? EPOLLIN : 0) | ((events & TLSIO_WANT_WRITE)? EPOLLOUT : 0);
+
+    if( !ev )
+        idle_loop.remove(fd);
+    else if( !idle_loop.modify(fd, ev) )
+        idle_loop.add(fd, ev, idle_ready);
+}
+
+//
+// measures the idle CPU use over transport 'xport'
+//
+void bench_idle(const char *connection_string, int xport)
+{
+    static const char *modes[] = { "polled", "reactor" };
+    char            out[BENCH_MSG_LEN];
+    JsonWriter      json(out, sizeof(out));
+    Report          r;
+    struct timespec s, e;
+    double          cpu, secs;
+    int             tick = -1;
+    TLSIO_SOCKET_WATCH watch = { idle_socket, NULL };
+
+    if( !idle_loop.open() ) {
+        printf("unable to open the reactor\n");
+        return;
+        }
+    if( (idle_client=create_client(connection_string, xport, &watch)) == NULL ) {
+        printf("unable to create the %s client\n", transport_name(xport));
+        idle_loop.close();
+        return;
+        }
+
+    //one message to get connected, then nothing but keep-alives
+    fill_report(r, time(NULL));
+    r.write(json);
+    if( sendMessage(idle_client, out, json.length(), json.content_type(), json.content_encoding()) )
+        bench_settle(idle_client, BENCH_XPORT_TIMEOUT_MS);
+
+    printf("Idle CPU over %s, %d s each\n", transport_name(xport), BENCH_IDLE_SECS);
+    printf("  %-8s  %6s  %10s\n", "", "cpu %", "runs/s");
+    for( int m=0; m<2; m++ ) {
+        if( m == 1 && (tick=idle_loop.add_timer(XPORT_TICK_MS, idle_ready)) < 0 ) {
+            printf("  %-8s  unable to create the tick\n", modes[m]);
+            break;
+            }
+        idle_runs = 0;
+        cpu = cpu_secs();
+        clock_gettime(CLOCK_MONOTONIC, &s);
+        do {
+            if( m == 0 )
+                idle_ready(-1, 0, NULL);
+            else
+                idle_loop.run_once(-1);
+            clock_gettime(CLOCK_MONOTONIC, &e);
+            } while( elapsed_ns(&s, &e) < BENCH_IDLE_SECS*1e9 );
+        secs = elapsed_ns(&s, &e)/1e9;
+        cpu  = cpu_secs() - cpu;
+        printf("  %-8s  %6.1f  %10.1f\n", modes[m], 100.0*cpu/secs, idle_runs/secs);
+        }
+    if( tick >= 0 )
+        idle_loop.remove_timer(tick);
+    IoTHubClient_LL_Destroy(idle_client);
+    idle_loop.close();
+}
+
+//------------------------------------------------------------------
+// The hub check: the client runs as the application runs it, on the transport worker with the device twin,
+// C2D commands and direct methods, for BENCH_HUB_SECS so the hub (hubstub in 'make check') can send it some.
+// The sensors aren't started, only the commands that don't need them are answered properly.  A capture of
+// numbered rows is made up and uploaded as soon as the client is there.
+//
+static void hub_tick(void)
+{
+    iothub_reconnect();
+    if( IoTHub_client_ll_handle != NULL && capture.upload_requested() && !capture.upload(IoTHub_client_ll_handle) )
+        printf("(----)capture upload not started\n");
+    twin_update();
+}
+
+static void hub_closing(void)
+{
+    if( capture.status() == CAP_UPLOADING )
+        capture.wait();
+}
+
+static bool hub_capture(void)
+{
+    FILE *fp = fopen(BENCH_CAPTURE_PATH, "w");
+
+    if( fp == NULL )
+        return false;
+    for( unsigned int i=0; i<BENCH_CAPTURE_ROWS; i++ )
+        fprintf(fp, "%08u,check\n", i);
+    return fclose(fp) == 0 && capture.load(CAP_ACCEL, BENCH_CAPTURE_PATH);
+}
+
+bool hub_check(const char *connection_string)
+{
+    Reactor         loop;
+    struct timespec s, e;
+
+    iothub_connection_string(connection_string);
+    if( hub_capture() )
+        capture.request_upload();
+    else
+        printf("unable to make %s\n", BENCH_CAPTURE_PATH);
+    if( !loop.open() || !transport.start(&loop, hub_tick, hub_closing) ) {
+        printf("unable to start the transport worker\n");
+        loop.close();
+        return false;
+        }
+    printf("Hub check over %s for %d s\n", transport_name(iothub_transport), BENCH_HUB_SECS);
+    clock_gettime(CLOCK_MONOTONIC, &s);
+    do {
+        loop.run_once(1000);
+        run_commands();
+        clock_gettime(CLOCK_MONOTONIC, &e);
+        } while( elapsed_ns(&s, &e) < BENCH_HUB_SECS*1e9 );
+    transport.stop();
+    capture.wait();
+    printf("Capture %s\n", Capture::state_name(capture.status()));
+    unlink(BENCH_CAPTURE_PATH);
+    loop.close();
+    return true;
+}
+
+//------------------------------------------------------------------
+// The same MAL command with one connection per command, with connections kept open and answered from the
+// cache: the mean and worst round trip, the connects and system calls each command cost and how many were
+// answered without asking the MAL manager.
+//
+void bench_mal(int commands)
+{
+    static const char *modes[] = { "one per command", "kept connection", "cached" };
+    Mal      *mal = Mal::get_mal();
+    bool      keep = mal->persistent();
+    bool      cache = mal->caching();
+    mal_stats st;
+    char      rstr[100];
+    char      jcmd[] = "{ \"action\" : \"get_operating_mode\" }";
+
+    if( commands < 1 )
+        commands = 1;
+    printf("MAL get_operating_mode, %d commands\n", commands);
+    printf("  %-16s  %8s  %8s  %9s  %9s  %7s  %s\n", "", "mean ms", "max ms", "connects", "syscalls", "cached", "ok");
+    for( int m=0; m<3; m++ ) {
+        mal->set_persistent(m > 0);
+        mal->set_caching(m == 2);
+        mal->send_mal_command(jcmd, rstr, sizeof(rstr), true);     //opens the kept connection
+        mal->clear_stats();
+        for( int i=0; i<commands; i++ )
+            mal->send_mal_command(jcmd, rstr, sizeof(rstr), true);
+        mal->get_stats(&st);
+        printf("  %-16s  %8.3f  %8.3f  %9.2f  %9.2f  %7u  %u/%u\n", modes[m],
+               st.sum_ms/st.commands, st.max_ms, (double)st.connects/st.commands, (double)st.syscalls/st.commands,
+               (unsigned)(st.cached+st.coalesced), (unsigned)(st.commands-st.failed), (unsigned)st.commands);
+        if( m > 0 && !mal->persistent() )
+            printf("  (the MAL manager closed the kept connections)\n");
+        }
+    mal->set_persistent(keep);
+    mal->set_caching(cache);
+}
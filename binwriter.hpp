@@ -0,0 +1,229 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   binwriter.hpp
+*   @brief  Compact binary encoders for the telemetry reports, CBOR (RFC 7049) and MessagePack.  Keys are written
+*           as small integer field IDs (see the report field table) instead of strings, floats are written as
+*           32-bit IEEE values and times as epoch seconds (CBOR tag 1, MessagePack timestamp extension).  Like
+*           JsonWriter they write into a caller owned buffer and latch an overflow flag instead of overrunning it.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#ifndef __BINWRITER_HPP__
+#define __BINWRITER_HPP__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "encoder.hpp"
+
+class BinWriter : public Encoder {
+    protected:
+        unsigned char *buf;
+        size_t         size;
+        size_t         len;
+        bool           ovfl;
+
+        inline void put(uint8_t b) {
+            if( ovfl || len+1 > size ) {
+                ovfl = true;
+                return;
+                }
+            buf[len++] = b;
+            }
+
+        inline void put(const void *p, size_t n) {
+            if( ovfl || len+n > size ) {
+                ovfl = true;
+                return;
+                }
+            memcpy(buf+len, p, n);
+            len += n;
+            }
+
+        inline void put16(uint16_t v) { put(v>>8); put(v&0xff); }
+
+        inline void put32(uint32_t v) { put16(v>>16); put16(v&0xffff); }
+
+        static uint32_t float_bits(float f) {
+            uint32_t u;
+            memcpy(&u, &f, sizeof(u));
+            return u;
+            }
+
+    public:
+        BinWriter(void *b, size_t s) : buf((unsigned char*)b), size(s), len(0), ovfl(false) { }
+
+        void        reset(void) override          { len = 0; ovfl = false; }
+        const char* data(void) const override     { return (const char*)buf; }
+        size_t      length(void) const override   { return len; }
+        size_t      capacity(void) const override { return size; }
+        bool        overflow(void) const override { return ovfl; }
+
+        const char* content_encoding(void) const override { return NULL; }
+        bool        is_text(void) const override          { return false; }
+
+        BinWriter& end_map(void) override { return *this; }
+
+        size_t array_separator(unsigned char *) const override { return 0; }
+        size_t array_trailer(unsigned char *) const override   { return 0; }
+};
+
+class CborWriter : public BinWriter {
+    private:
+        //CBOR major type + argument, using the shortest form
+        void head(uint8_t major, uint32_t v) {
+            major <<= 5;
+            if( v < 24 )
+                put(major | v);
+            else if( v < 0x100 ) {
+                put(major | 24);
+                put(v);
+                }
+            else if( v < 0x10000 ) {
+                put(major | 25);
+                put16(v);
+                }
+            else {
+                put(major | 26);
+                put32(v);
+                }
+            }
+
+    public:
+        CborWriter(void *b, size_t s) : BinWriter(b, s) { }
+
+        const char* content_type(void) const override { return "application/cbor"; }
+
+        CborWriter& begin_map(int count) override      { head(5, count); return *this; }
+        CborWriter& key(int id, const char *) override { head(0, id); return *this; }
+
+        CborWriter& value(const char *s) override {
+            size_t n = strlen(s);
+            head(3, n);
+            put(s, n);
+            return *this;
+            }
+
+        CborWriter& value(int v) override {
+            if( v < 0 )
+                head(1, (uint32_t)(-1-v));
+            else
+                head(0, v);
+            return *this;
+            }
+
+        CborWriter& value(double v, int) override {
+            put(0xfa);                         //single precision float
+            put32(float_bits((float)v));
+            return *this;
+            }
+
+        CborWriter& value(time_t t, const char *) override {
+            head(6, 1);                        //tag 1, epoch based date/time
+            return value((int)t);
+            }
+
+        size_t array_header(unsigned char *out, int count) const override {
+            if( count < 24 ) {
+                out[0] = 0x80 | count;
+                return 1;
+                }
+            if( count < 0x100 ) {
+                out[0] = 0x98;
+                out[1] = count;
+                return 2;
+                }
+            out[0] = 0x99;
+            out[1] = count>>8;
+            out[2] = count&0xff;
+            return 3;
+            }
+};
+
+class MsgpackWriter : public BinWriter {
+    public:
+        MsgpackWriter(void *b, size_t s) : BinWriter(b, s) { }
+
+        const char* content_type(void) const override { return "application/x-msgpack"; }
+
+        MsgpackWriter& begin_map(int count) override {
+            if( count < 16 )
+                put(0x80 | count);
+            else {
+                put(0xde);
+                put16(count);
+                }
+            return *this;
+            }
+
+        MsgpackWriter& key(int id, const char *) override { return value(id); }
+
+        MsgpackWriter& value(const char *s) override {
+            size_t n = strlen(s);
+            if( n < 32 )
+                put(0xa0 | n);
+            else if( n < 0x100 ) {
+                put(0xd9);
+                put(n);
+                }
+            else {
+                put(0xda);
+                put16(n);
+                }
+            put(s, n);
+            return *this;
+            }
+
+        MsgpackWriter& value(int v) override {
+            if( v >= 0 && v < 128 )
+                put(v);                        //positive fixint
+            else if( v < 0 && v >= -32 )
+                put((uint8_t)v);               //negative fixint
+            else if( v >= -128 && v < 128 ) {
+                put(0xd0);
+                put((uint8_t)v);
+                }
+            else if( v >= -32768 && v < 32768 ) {
+                put(0xd1);
+                put16((uint16_t)v);
+                }
+            else {
+                put(0xd2);
+                put32((uint32_t)v);
+                }
+            return *this;
+            }
+
+        MsgpackWriter& value(double v, int) override {
+            put(0xca);                         //float 32
+            put32(float_bits((float)v));
+            return *this;
+            }
+
+        MsgpackWriter& value(time_t t, const char *) override {
+            put(0xd6);                         //fixext 4, type -1 is the timestamp extension
+            put(0xff);
+            put32((uint32_t)t);
+            return *this;
+            }
+
+        size_t array_header(unsigned char *out, int count) const override {
+            if( count < 16 ) {
+                out[0] = 0x90 | count;
+                return 1;
+                }
+            out[0] = 0xdc;
+            out[1] = count>>8;
+            out[2] = count&0xff;
+            return 3;
+            }
+};
+
+#endif // __BINWRITER_HPP__
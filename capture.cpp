@@ -0,0 +1,326 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   capture.cpp
+*   @brief  member functions for the Capture class.  record_task writes one CSV row per period until the
+*           capture time is up, upload_task streams the finished file to IoT Hub file upload a block at a time.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+
+#include "capture.hpp"
+
+static const struct {
+    const char *name;
+    const char *header;
+    } sources[CAP_SOURCES] = {
+    { "accel", "ms,x_mg,y_mg,z_mg\n" },
+    { "gps",   "ms,lat,lng,fix\n"    },
+    };
+
+static const char *state_names[CAP_STATES] = { "Idle", "Recording", "Recorded", "Uploading", "Uploaded", "Failed" };
+
+const char *Capture::source_name(int s)
+{
+    return (s >= 0 && s < CAP_SOURCES)? sources[s].name : "?";
+}
+
+int Capture::source(const char *name)
+{
+    for( int i=0; i<CAP_SOURCES; i++ )
+        if( !strcmp(name, sources[i].name) )
+            return i;
+    return -1;
+}
+
+const char *Capture::state_name(int s)
+{
+    return (s >= 0 && s < CAP_STATES)? state_names[s] : "?";
+}
+
+static double elapsed_ms(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec)*1000.0 + (to->tv_nsec - from->tv_nsec)/1e6;
+}
+
+// with capture_mutex held, the thread is about to end or already has
+void Capture::join(void)
+{
+    if( joinable ) {
+        pthread_join(thread, NULL);
+        joinable = false;
+        }
+}
+
+bool Capture::start(int s, int ms, int secs, const char *file)
+{
+    bool ok;
+
+    pthread_mutex_lock(&capture_mutex);
+    ok = start_recording(s, ms, secs, file);
+    pthread_mutex_unlock(&capture_mutex);
+    return ok;
+}
+
+// the blob is named after the source and the time
+void Capture::name_blob(void)
+{
+    char   stamp[20];
+    time_t now = time(NULL);
+
+    strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%S", gmtime(&now));
+    snprintf(blob, sizeof(blob), "%s-%s.csv", source_name(src), stamp);
+}
+
+bool Capture::start_recording(int s, int ms, int secs, const char *file)
+{
+    if( busy() || s < 0 || s >= CAP_SOURCES )
+        return false;
+    join();
+
+    src       = s;
+    period_ms = (ms < CAPTURE_MIN_MS)? CAPTURE_MIN_MS : ms;
+    seconds   = (secs < 1)? 1 : (secs > CAPTURE_MAX_SECS)? CAPTURE_MAX_SECS : secs;
+    snprintf(path, sizeof(path), "%s", file);
+    name_blob();
+
+    if( fbuf == NULL && (fbuf = (char*)malloc(CAPTURE_FILE_BUF)) == NULL )
+        return false;
+    if( (fp = fopen(path, "w")) == NULL )
+        return false;
+    setvbuf(fp, fbuf, _IOFBF, CAPTURE_FILE_BUF);
+    fputs(sources[src].header, fp);
+
+    rows = file_bytes = sent_bytes = 0;
+    stop_req = false;
+    state = CAP_RECORDING;
+    if( pthread_create(&thread, NULL, record_task, (void*)this) ) {
+        fclose(fp);
+        fp = NULL;
+        state = CAP_FAILED;
+        return false;
+        }
+    joinable = true;
+    return true;
+}
+
+void Capture::stop(void)
+{
+    stop_req = true;
+}
+
+bool Capture::load(int s, const char *file)
+{
+    struct stat st;
+    bool        ok = false;
+
+    pthread_mutex_lock(&capture_mutex);
+    if( !busy() && s >= 0 && s < CAP_SOURCES && stat(file, &st) == 0 && st.st_size > 0 ) {
+        join();
+        src = s;
+        snprintf(path, sizeof(path), "%s", file);
+        name_blob();
+        rows       = 0;            //not counted, only recordings are
+        file_bytes = (uint32_t)st.st_size;
+        sent_bytes = 0;
+        state      = CAP_RECORDED;
+        ok = true;
+        }
+    pthread_mutex_unlock(&capture_mutex);
+    return ok;
+}
+
+void Capture::wait(void)
+{
+    pthread_t t;
+    bool      running;
+
+    //joined without the lock, an upload can take minutes and write() needs it meanwhile
+    pthread_mutex_lock(&capture_mutex);
+    running  = joinable;
+    t        = thread;
+    joinable = false;
+    pthread_mutex_unlock(&capture_mutex);
+    if( running )
+        pthread_join(t, NULL);
+}
+
+void Capture::record_row(void)
+{
+    struct timespec now;
+    float           x, y, z;
+    gpsstatus      *loc;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if( rows == 0 )
+        rec_start = now;
+    switch( src ) {
+        case CAP_ACCEL:
+            mems->lis2dw12_getAccel(&x, &y, &z);
+            fprintf(fp, "%.0f,%.1f,%.1f,%.1f\n", elapsed_ms(&rec_start, &now), x, y, z);
+            break;
+
+        case CAP_GPS:
+            loc = gps->getLocation();
+            fprintf(fp, "%.0f,%f,%f,%ld\n", elapsed_ms(&rec_start, &now), loc->last_pos.lat, loc->last_pos.lng, (long)loc->last_good);
+            break;
+        }
+    rows++;
+}
+
+void *Capture::record_task(void *obj)
+{
+    Capture          *self = static_cast<Capture *>(obj);
+    struct itimerspec its;
+    struct pollfd     pfd;
+    struct stat       st;
+    uint64_t          expired;
+    uint32_t          total = (uint32_t)((int64_t)self->seconds*1000 / self->period_ms);
+
+    pfd.fd     = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    pfd.events = POLLIN;
+    its.it_interval.tv_sec  = self->period_ms / 1000;
+    its.it_interval.tv_nsec = (self->period_ms % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+    if( pfd.fd >= 0 && !timerfd_settime(pfd.fd, 0, &its, NULL) ) {
+        //a period that was missed isn't caught up, the ms column shows the gap
+        while( !self->stop_req && self->rows < total ) {
+            if( poll(&pfd, 1, 500) <= 0 )
+                continue;
+            if( read(pfd.fd, &expired, sizeof(expired)) == sizeof(expired) )
+                self->record_row();
+            }
+        }
+    if( pfd.fd >= 0 )
+        close(pfd.fd);
+
+    fclose(self->fp);
+    self->fp = NULL;
+    self->file_bytes = (stat(self->path, &st) == 0)? (uint32_t)st.st_size : 0;
+    self->state = self->rows? CAP_RECORDED : CAP_FAILED;
+    return NULL;
+}
+
+bool Capture::upload(IOTHUB_CLIENT_LL_HANDLE h)
+{
+    bool ok;
+
+    pthread_mutex_lock(&capture_mutex);
+    ok = start_upload(h);
+    pthread_mutex_unlock(&capture_mutex);
+    return ok;
+}
+
+bool Capture::start_upload(IOTHUB_CLIENT_LL_HANDLE h)
+{
+    int s = state;
+
+    if( h == NULL || path[0] == '\0' || (s != CAP_RECORDED && s != CAP_UPLOADED && s != CAP_FAILED) )
+        return false;
+    join();
+
+    if( block == NULL && (block = (unsigned char*)malloc(CAPTURE_BLOCK)) == NULL )
+        return false;
+    if( (fp = fopen(path, "r")) == NULL )
+        return false;
+    client     = h;
+    sent_bytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &up_start);
+    up_end = up_start;
+    state  = CAP_UPLOADING;
+    if( pthread_create(&thread, NULL, upload_task, (void*)this) ) {
+        fclose(fp);
+        fp = NULL;
+        state = CAP_FAILED;
+        return false;
+        }
+    joinable = true;
+    return true;
+}
+
+//
+// called by the upload for each block, and once more with data == NULL when the blob is committed
+//
+IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_RESULT Capture::next_block(IOTHUB_CLIENT_FILE_UPLOAD_RESULT result,
+                                                              unsigned char const **data, size_t *size, void *ctx)
+{
+    Capture *self = static_cast<Capture *>(ctx);
+    size_t   n;
+
+    if( data == NULL || size == NULL ) {
+        clock_gettime(CLOCK_MONOTONIC, &self->up_end);
+        self->state = (result == FILE_UPLOAD_OK)? CAP_UPLOADED : CAP_FAILED;
+        return IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_OK;
+        }
+    if( result != FILE_UPLOAD_OK )
+        return IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_ABORT;
+
+    n = fread(self->block, 1, CAPTURE_BLOCK, self->fp);
+    *data = n? self->block : NULL;             //a 0 size block ends the upload
+    *size = n;
+    self->sent_bytes += (uint32_t)n;
+    return IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_OK;
+}
+
+void *Capture::upload_task(void *obj)
+{
+    Capture *self = static_cast<Capture *>(obj);
+
+    if( IoTHubClient_LL_UploadMultipleBlocksToBlobEx(self->client, self->blob, next_block, self) != IOTHUB_CLIENT_OK ) {
+        clock_gettime(CLOCK_MONOTONIC, &self->up_end);
+        self->state = CAP_FAILED;
+        }
+    else if( self->state == CAP_UPLOADING )       //no final callback
+        self->state = CAP_UPLOADED;
+    fclose(self->fp);
+    self->fp = NULL;
+    return NULL;
+}
+
+size_t Capture::write(JsonWriter& jw)
+{
+    struct timespec now;
+    int             s;
+    double          secs;
+
+    pthread_mutex_lock(&capture_mutex);
+    s = state;
+    if( s == CAP_UPLOADING )
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    else
+        now = up_end;
+    secs = (s >= CAP_UPLOADING)? elapsed_ms(&up_start, &now)/1000.0 : 0.0;
+
+    jw.reset();
+    jw.begin_object()
+      .member("ObjectName", "Capture")
+      .member("State",      state_name(s));
+    if( s != CAP_IDLE )
+        jw.member("Source",   source_name(src))
+          .member("PeriodMs", period_ms)
+          .member("Rows",     (int)rows)
+          .member("Bytes",    (int)file_bytes)
+          .member("Blob",     blob);
+    if( s >= CAP_UPLOADING )
+        jw.member("Uploaded", (int)sent_bytes)
+          .member("Percent",  file_bytes? 100.0*sent_bytes/file_bytes : 0.0, 0)
+          .member("Seconds",  secs, 1)
+          .member("KBps",     secs > 0.0? sent_bytes/1024.0/secs : 0.0, 1);
+    jw.end_object();
+    pthread_mutex_unlock(&capture_mutex);
+
+    return jw.overflow()? 0 : jw.length();
+}
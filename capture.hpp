@@ -0,0 +1,156 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   capture.hpp
+*   @brief  The Capture class records a sensor at a high rate (LIS2DW12 acceleration bursts, GPS tracks) into a
+*           local CSV file and then uploads the whole file to the storage account linked to the IoT Hub, so a
+*           large data set goes up as one blob instead of thousands of telemetry messages.
+*
+*           Recording runs in its own thread on a periodic CLOCK_MONOTONIC timerfd, like the Sampler, and rows
+*           are written through a large stdio buffer so the flash sees few writes.  The upload also runs in its
+*           own thread: IoTHubClient_LL_UploadMultipleBlocksToBlobEx() blocks until the file is up and uses its
+*           own HTTPS connection, the SDK's IoTHubClient_UploadToBlobAsync() runs it next to DoWork the same
+*           way.  The file is handed over CAPTURE_BLOCK bytes at a time, each block counts towards the progress
+*           and throughput reported by write().
+*
+*           start() runs on the application thread and upload() on the transport worker, so they, wait() and
+*           write() take capture_mutex for the thread handle and the capture's settings.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#ifndef __CAPTURE_HPP__
+#define __CAPTURE_HPP__
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+
+#include "iothub_client_ll.h"
+
+#include "lis2dw12.hpp"
+#include "gps.hpp"
+#include "jsonwriter.hpp"
+
+#define CAPTURE_DEF_PATH     "/CUSTAPP/azIoTClient.cap"
+#define CAPTURE_MIN_MS       10            //fastest recording period
+#define CAPTURE_MAX_SECS     3600
+#define CAPTURE_BLOCK        (32*1024)     //bytes handed to the blob upload at a time
+#define CAPTURE_FILE_BUF     (16*1024)     //stdio buffer of the recording
+
+//what can be recorded
+typedef enum capture_source_t {
+    CAP_ACCEL=0,                   //LIS2DW12 x/y/z in mg
+    CAP_GPS,                       //latitude/longitude
+    CAP_SOURCES
+    } capture_source;
+
+typedef enum capture_state_t {
+    CAP_IDLE=0,
+    CAP_RECORDING,
+    CAP_RECORDED,                  //waiting to be uploaded
+    CAP_UPLOADING,
+    CAP_UPLOADED,
+    CAP_FAILED,
+    CAP_STATES
+    } capture_state;
+
+class Capture {
+    private:
+        Lis2dw12          *mems;
+        Wncgps            *gps;
+
+        pthread_mutex_t    capture_mutex;
+        pthread_t          thread;
+        bool               joinable;
+        std::atomic<int>   state;
+        volatile bool      stop_req;
+        std::atomic<bool>  upload_req;
+
+        char               path[64];
+        char               blob[64];
+        int                src;
+        int                period_ms;
+        int                seconds;
+        FILE              *fp;
+        char              *fbuf;
+
+        std::atomic<uint32_t> rows;
+        std::atomic<uint32_t> file_bytes;
+        std::atomic<uint32_t> sent_bytes;     //handed to the upload so far
+        struct timespec    rec_start;         //CLOCK_MONOTONIC
+        struct timespec    up_start, up_end;
+
+        IOTHUB_CLIENT_LL_HANDLE client;
+        unsigned char     *block;
+
+        static void *record_task(void *obj);
+        static void *upload_task(void *obj);
+        static IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_RESULT next_block(IOTHUB_CLIENT_FILE_UPLOAD_RESULT result,
+                                                                    unsigned char const **data, size_t *size, void *ctx);
+        void record_row(void);
+        void name_blob(void);
+        void join(void);
+        bool start_recording(int src, int ms, int secs, const char *file);
+        bool start_upload(IOTHUB_CLIENT_LL_HANDLE h);
+
+    public:
+        Capture(Lis2dw12 *m, Wncgps *g) :
+            mems(m),
+            gps(g),
+            joinable(false),
+            state(CAP_IDLE),
+            stop_req(false),
+            upload_req(false),
+            fp(NULL),
+            fbuf(NULL),
+            rows(0),
+            file_bytes(0),
+            sent_bytes(0),
+            client(NULL),
+            block(NULL)
+            {
+            pthread_mutex_init(&capture_mutex, NULL);
+            path[0] = blob[0] = '\0';
+            memset(&up_start, 0x00, sizeof(up_start));
+            up_end = up_start;
+            }
+
+        ~Capture() { stop(); wait(); pthread_mutex_destroy(&capture_mutex); }
+
+        //starts recording 'src' every 'ms' milliseconds for 'secs' seconds, false if a capture is already
+        //recording or uploading or the file can't be created
+        bool start(int src, int ms, int secs, const char *file=CAPTURE_DEF_PATH);
+        //ends a recording early, what was recorded can still be uploaded
+        void stop(void);
+        //takes 'file', recorded earlier from 'src', as the capture to upload(), false while a capture is
+        //recording or uploading or if the file is empty
+        bool load(int src, const char *file);
+
+        //uploads the recorded file as a blob named after the source and start time, false if there is nothing
+        //to upload.  The client must not be destroyed until the upload is over, see wait()
+        bool upload(IOTHUB_CLIENT_LL_HANDLE h);
+        //asks whoever owns the IoT Hub client to call upload(), see upload_requested()
+        void request_upload(void)   { upload_req = true; }
+        bool upload_requested(void) { return upload_req.exchange(false); }
+        //waits for the recording or upload thread to finish
+        void wait(void);
+
+        capture_state status(void) { return (capture_state)state.load(); }
+        bool          busy(void)   { int s = state; return s == CAP_RECORDING || s == CAP_UPLOADING; }
+
+        size_t        write(JsonWriter& jw);
+
+        static const char *source_name(int s);
+        static int         source(const char *name);      //-1 if there is no source called 'name'
+        static const char *state_name(int s);
+};
+
+#endif // __CAPTURE_HPP__
@@ -0,0 +1,68 @@
+#!/bin/sh
+#
+# make check: runs the -L load sweep over MQTT and then HTTP against hubstub, a loopback stand-in for the
+# hub, with a certificate made for the run.  Over MQTT the -H hub check follows: hubstub is told (SIGUSR1)
+# to send a command, a direct method and a twin update and the device has to answer all three, and the
+# capture the device uploads has to arrive with its blocks in order.  The programs are run through
+# $CHECK_RUNNER when it is set, e.g. CHECK_RUNNER="qemu-arm" for the cross compiled ones.  HTTP and the
+# capture upload have to use port 443, they are skipped when hubstub can't listen there.
+#
+hub="HostName=localhost;DeviceId=check;SharedAccessKey=c3R1Yg=="
+
+dir=$(mktemp -d) || exit 99
+trap 'rm -rf "$dir"' EXIT
+if ! openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj /CN=localhost \
+             -keyout "$dir/key.pem" -out "$dir/cert.pem" >/dev/null 2>&1; then
+    echo "check_load: openssl is needed to make the stand-in's certificate"
+    exit 99
+fi
+export AZIOT_TRUSTED_CERTS="$dir/cert.pem"
+
+# starts hubstub on ports $1 and $2, false if it didn't stay up
+start_stub() {
+    $CHECK_RUNNER ./hubstub "$dir/cert.pem" "$dir/key.pem" $1 $2 >"$dir/stub.log" 2>&1 &
+    stub=$!
+    sleep 1
+    kill -0 $stub 2>/dev/null && return 0
+    cat "$dir/stub.log"
+    return 1
+}
+
+status=0
+for xport in mqtt http; do
+    https=443
+    if [ $xport = mqtt ]; then
+        if ! start_stub 8883 443; then
+            https=0
+            echo "check_load: SKIP capture upload"
+            start_stub 8883 0 || { status=1; continue; }
+        fi
+    elif ! start_stub 0 443; then
+        echo "check_load: SKIP $xport"
+        continue
+    fi
+    $CHECK_RUNNER ./azIoTClient -T $xport -L "$hub" || status=1
+    if [ $xport = mqtt ]; then
+        $CHECK_RUNNER ./azIoTClient -T $xport -H "$hub" &
+        client=$!
+        sleep 5
+        kill -USR1 $stub
+        wait $client || status=1
+    fi
+    kill $stub
+    wait $stub
+    cat "$dir/stub.log"
+    if [ $xport = mqtt ]; then
+        reactions="command reply|method response 200|reported ReportPeriod 60"
+        [ $https = 0 ] || reactions="$reactions|blob .* in order"
+        IFS='|'
+        for reaction in $reactions; do
+            if ! grep -q "hubstub: $reaction" "$dir/stub.log"; then
+                echo "check_load: FAIL no $reaction from the device"
+                status=1
+            fi
+        done
+        unset IFS
+    fi
+done
+exit $status
@@ -0,0 +1,211 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   datausage.cpp
+*   @brief  member functions for the DataUsage class.  The classifier is called by the tlsio on whichever
+*           thread services the connection (the transport worker, or the capture upload thread).
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#include <string.h>
+
+#include "datausage.hpp"
+
+#define CLASSIFY_SCAN   256      //bytes of an HTTP request searched for its path
+
+//how the reply property shows in an MQTT topic and as an HTTP header
+#define REPLY_TOPIC     "&" REPLY_PROPERTY "="
+#define REPLY_HEADER    "iothub-app-" REPLY_PROPERTY ":"
+
+static const char *class_names[TLSIO_CLASSES] = { "Other", "Handshake", "Telemetry", "C2D", "Twin", "KeepAlive",
+                                                  "Polling", "Upload" };
+
+const char *DataUsage::class_name(int c)
+{
+    return (c >= 0 && c < TLSIO_CLASSES)? class_names[c] : "?";
+}
+
+static bool has(const unsigned char *buf, size_t len, const char *s)
+{
+    return memmem(buf, len, s, strlen(s)) != NULL;
+}
+
+static bool starts(const unsigned char *buf, size_t len, const char *s)
+{
+    size_t n = strlen(s);
+    return len >= n && !memcmp(buf, s, n);
+}
+
+//
+// the class of the MQTT packet at 'buf' and its full length, 0 if the fixed header isn't all there
+//
+static int mqtt_packet(int tx, const unsigned char *buf, size_t len, size_t *pkt_len)
+{
+    size_t   hdr = 1, rem = 0, tlen;
+    unsigned shift = 0;
+
+    do {
+        if( hdr >= len || hdr > 4 ) {
+            *pkt_len = 0;
+            return TLSIO_CLASS_OTHER;
+            }
+        rem |= (size_t)(buf[hdr] & 0x7f) << shift;
+        shift += 7;
+        } while( buf[hdr++] & 0x80 );
+    *pkt_len = hdr + rem;
+
+    switch( buf[0] >> 4 ) {
+        case 3:                                    //PUBLISH, by its topic
+            if( hdr+2 > len )
+                return TLSIO_CLASS_OTHER;
+            tlen = (buf[hdr] << 8) | buf[hdr+1];
+            buf += hdr+2;
+            if( tlen > len-hdr-2 )
+                tlen = len-hdr-2;
+            if( has(buf, tlen, "$iothub/twin/") )
+                return TLSIO_CLASS_TWIN;
+            if( has(buf, tlen, "$iothub/methods/") )
+                return TLSIO_CLASS_C2D;
+            if( tx && has(buf, tlen, "/messages/events") )
+                return has(buf, tlen, REPLY_TOPIC)? TLSIO_CLASS_C2D : TLSIO_CLASS_TELEMETRY;
+            if( !tx && has(buf, tlen, "/messages/devicebound") )
+                return TLSIO_CLASS_C2D;
+            return TLSIO_CLASS_OTHER;
+
+        case 4:                                    //PUBACK, of a C2D message or of our telemetry
+            return tx? TLSIO_CLASS_C2D : TLSIO_CLASS_TELEMETRY;
+
+        case 12:                                   //PINGREQ
+        case 13:                                   //PINGRESP
+            return TLSIO_CLASS_KEEPALIVE;
+        }
+    return TLSIO_CLASS_OTHER;
+}
+
+//
+// a read can end part way through a packet, or hold several; it is counted against the packet it starts with
+// and rx_left remembers how much of the last one is still to come.  So the packets that follow the first in
+// the same read are charged to its class, e.g. a PINGRESP that arrives with a telemetry PUBACK is counted as
+// Telemetry.  They are a few bytes each, the TLS record around them is most of what a read costs.
+//
+static int mqtt_read(TLSIO_FLOW *flow, const unsigned char *buf, size_t len)
+{
+    size_t pos = 0, pkt_len;
+    int    cls = flow->rx_class;
+
+    if( flow->rx_left >= len ) {
+        flow->rx_left -= len;
+        return cls;
+        }
+    if( flow->rx_left ) {
+        pos = flow->rx_left;
+        flow->rx_left = 0;
+        }
+    else
+        cls = mqtt_packet(0, buf, len, &pkt_len);
+
+    while( pos < len ) {
+        mqtt_packet(0, buf+pos, len-pos, &pkt_len);
+        if( pkt_len == 0 )
+            break;                                 //the header is split, lose track until the next read
+        if( pos + pkt_len > len ) {
+            flow->rx_left = (uint32_t)(pos + pkt_len - len);
+            break;
+            }
+        pos += pkt_len;
+        }
+    return cls;
+}
+
+//
+// an HTTP request by its method and path, the rest of the request (headers sent separately, the body) and the
+// response belong to the same class
+//
+static int http_request(TLSIO_FLOW *flow, const unsigned char *buf, size_t len)
+{
+    size_t scan = (len > CLASSIFY_SCAN)? CLASSIFY_SCAN : len;
+
+    //the answer to a command is only told apart from telemetry by its headers, which can come in a later send
+    if( !starts(buf, len, "GET ") && !starts(buf, len, "POST ") && !starts(buf, len, "PUT ") &&
+        !starts(buf, len, "DELETE ") && !starts(buf, len, "PATCH ") )
+        return (flow->tx_class == TLSIO_CLASS_TELEMETRY && has(buf, len, REPLY_HEADER))? TLSIO_CLASS_C2D :
+               flow->tx_class;
+
+    if( starts(buf, scan, "PUT ") || has(buf, scan, "/files") )
+        return TLSIO_CLASS_UPLOAD;
+    if( has(buf, scan, "/messages/events") )
+        return has(buf, len, REPLY_HEADER)? TLSIO_CLASS_C2D : TLSIO_CLASS_TELEMETRY;
+    if( has(buf, scan, "/messages/devicebound") || has(buf, scan, "/messages/deviceBound") )
+        return starts(buf, scan, "GET ")? TLSIO_CLASS_POLLING : TLSIO_CLASS_C2D;
+    return TLSIO_CLASS_OTHER;
+}
+
+int DataUsage::classify(TLSIO_FLOW *flow, int tx, const unsigned char *buf, size_t len, void *)
+{
+    size_t pkt_len;
+    int    cls = TLSIO_CLASS_OTHER;
+
+    if( flow->port == MQTT_PORT )
+        cls = tx? mqtt_packet(1, buf, len, &pkt_len) : mqtt_read(flow, buf, len);
+    else if( flow->port == HTTPS_PORT )
+        cls = tx? http_request(flow, buf, len) : flow->tx_class;
+    //AMQP, and the WebSocket framing after the upgrade request, are counted as Other
+
+    if( tx )
+        flow->tx_class = cls;
+    else
+        flow->rx_class = cls;
+    return cls;
+}
+
+void DataUsage::start(void)
+{
+    tlsio_mbedtls_reset_wire_bytes();
+    tlsio_mbedtls_set_classify_callback(classify, this);
+    clock_gettime(CLOCK_MONOTONIC, &since);
+}
+
+double DataUsage::seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since.tv_sec) + (now.tv_nsec - since.tv_nsec)/1e9;
+}
+
+size_t DataUsage::write(JsonWriter& jw)
+{
+    uint64_t tx[TLSIO_CLASSES], rx[TLSIO_CLASSES], tx_sum = 0, rx_sum = 0;
+    double   secs = seconds();
+    double   month = (secs > 0.0)? DATA_MONTH_SECS/secs/1e6 : 0.0;     //bytes so far to MB per month
+
+    tlsio_mbedtls_get_class_bytes(tx, rx);
+    for( int i=0; i<TLSIO_CLASSES; i++ ) {
+        tx_sum += tx[i];
+        rx_sum += rx[i];
+        }
+
+    jw.reset();
+    jw.begin_object()
+      .member("ObjectName", "Data-Usage")
+      .member("Seconds",    (int)secs)
+      .member("TxBytes",    (double)tx_sum, 0)
+      .member("RxBytes",    (double)rx_sum, 0)
+      .member("MonthlyMB",  (tx_sum+rx_sum)*month, 1)
+      .key("Classes").begin_object();
+    for( int i=0; i<TLSIO_CLASSES; i++ )
+        jw.key(class_names[i]).begin_object()
+          .member("Tx",        (double)tx[i], 0)
+          .member("Rx",        (double)rx[i], 0)
+          .member("MonthlyMB", (tx[i]+rx[i])*month, 2)
+          .end_object();
+    jw.end_object().end_object();
+
+    return jw.overflow()? 0 : jw.length();
+}
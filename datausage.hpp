@@ -0,0 +1,58 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   datausage.hpp
+*   @brief  The DataUsage class accounts for the cellular data the client uses.  It registers a classifier
+*           with the tlsio layer (tlsio_socket.h) that looks at each MQTT packet or HTTP request going over a
+*           connection and says what it is for: telemetry, cloud-to-device messages and methods, the twin,
+*           keep-alives, HTTP polling or file upload.  The tlsio counts the wire bytes, TLS records and
+*           handshakes included, against that class.
+*
+*           write() reports the bytes sent and received in each class and what they come to over a month at
+*           the rate seen since start(), which is what the carrier bills.
+*
+*           Only MQTT (port 8883) and HTTPS are classified.  AMQP, and MQTT or AMQP over WebSockets, are all
+*           counted as Other.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#ifndef __DATAUSAGE_HPP__
+#define __DATAUSAGE_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "jsonwriter.hpp"
+#include "tlsio_socket.h"
+
+#define DATA_MONTH_SECS     (30*24*3600)
+#define MQTT_PORT           8883
+#define HTTPS_PORT          443
+#define REPLY_PROPERTY      "reply"      //set on the answers to commands, they go to /messages/events too
+
+class DataUsage {
+    private:
+        struct timespec  since;          //CLOCK_MONOTONIC
+
+        static int classify(TLSIO_FLOW *flow, int tx, const unsigned char *buf, size_t len, void *ctx);
+
+    public:
+        DataUsage() { since.tv_sec = since.tv_nsec = 0; }
+
+        //starts counting, the counts before are cleared
+        void   start(void);
+        double seconds(void);
+
+        size_t write(JsonWriter& jw);
+
+        static const char *class_name(int c);
+};
+
+#endif // __DATAUSAGE_HPP__
@@ -8,10 +8,25 @@
 
 #include "mal.hpp"
 
+//
+// the replies are decoded on the MAL I/O thread while the caller waits for them
+//
 class Devinfo {
     private:
         Mal*        malptr;
-        json_keyval om[12];
+
+        static void on_imei(int result, const MalReply *reply, void *ctx) {
+            static_cast<DeviceIds *>(ctx)->decode_imei(result, reply);
+            }
+        static void on_iccid(int result, const MalReply *reply, void *ctx) {
+            static_cast<DeviceIds *>(ctx)->decode_iccid(result, reply);
+            }
+        static void on_status(int result, const MalReply *reply, void *ctx) {
+            static_cast<MalStatus *>(ctx)->decode(result, reply);
+            }
+        static void on_mode(int result, const MalReply *reply, void *ctx) {
+            static_cast<WwanStatus *>(ctx)->decode_mode(result, reply);
+            }
 
     public:
         Devinfo() {
@@ -22,68 +37,52 @@ class Devinfo {
 
         ~Devinfo() {;}
 
+        //retried until the MAL has no error, 0 if a reply can't be decoded
         int getIMEI(char*str,int len) {
-            json_keyval om[12];
-            char        rstr[100];
-            char        jcmd[] = "{ \"action\" : \"get_system_imei\" }";
-            int         done = 0;
-        
-            while( !done ) {
-                malptr->send_mal_command(jcmd, rstr, sizeof(rstr), true);
-                int i = malptr->parse_maljson (rstr, om, sizeof(om));
-                if( i < 0 )  //parse failed
+            DeviceIds ids;
+            char      jcmd[] = "{ \"action\" : \"get_system_imei\" }";
+
+            do {
+                malptr->call(jcmd, on_imei, &ids);
+                if( ids.err < 0 )
                     return 0;
-                if( atoi(om[1].value) == 0 ){  // no errors
-                    done = 1;
-                    strncpy(str, om[3].value, len);
-                    }
-                }
-            return done;
+                } while( ids.err );
+            strncpy(str, ids.imei, len);
+            return 1;
             }
 
         int getICCID(char *str, int len) {
-            json_keyval om[12];
-            char        rstr[100];
-            char        jcmd[] = "{ \"action\" : \"get_system_iccid\" }";
-            int         done = 0;
-        
-            while( !done ) {
-                malptr->send_mal_command(jcmd, rstr, sizeof(rstr), true);
-                int i = malptr->parse_maljson (rstr, om, sizeof(om));
-                if( i < 0 )  //parse failed
+            DeviceIds ids;
+            char      jcmd[] = "{ \"action\" : \"get_system_iccid\" }";
+
+            do {
+                malptr->call(jcmd, on_iccid, &ids);
+                if( ids.err < 0 )
                     return 0;
-                if( atoi(om[1].value) == 0 ){  // no error?
-                    done = 1;
-                    strncpy( str, om[3].value, len);
-                    }
-                }
-            return done;
+                } while( ids.err );
+            strncpy(str, ids.iccid, len);
+            return 1;
             }
 
         int setLPM(bool on) {
-            int         done;
-            json_keyval om[12];
-            char        rstr[100];
+            MalStatus   st;
+            WwanStatus  mode;
             char        setLPM[] = "{ \"action\" : \"set_operating_mode\", \"args\": { \"operating_mode\":1 }}";
             char        clrLPM[] = "{ \"action\" : \"set_operating_mode\", \"args\": { \"operating_mode\":0 }}";
             char        getLPM[] = "{ \"action\" : \"get_operating_mode\" }";
 
             if( on ) {
-                malptr->send_mal_command(setLPM, rstr, sizeof(rstr), true);
-                done = malptr->parse_maljson (rstr, om, sizeof(om));
-                if( done < 0 )  //parse failed
+                malptr->call(setLPM, on_status, &st);
+                if( st.err < 0 )  //no reply
                     return -1000;
-                done =atoi(om[1].value);
-                return (done==0)? 0:-done;
+                return (st.err==0)? 0:-st.err;
                 }
             else{
-                malptr->send_mal_command(clrLPM, rstr, sizeof(rstr), true);
+                malptr->call(clrLPM, on_status, &st);
                 sleep(1);
-                while( !done ) {
-                    malptr->send_mal_command(getLPM, rstr, sizeof(rstr), true);
-                    done = malptr->parse_maljson (rstr, om, sizeof(om));
-                    done = ( done>0 && atoi(om[1].value) == 0); 
-                    }
+                do {
+                    malptr->call(getLPM, on_mode, &mode);
+                    } while( mode.err );
                 return 0;
                 }
         }
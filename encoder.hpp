@@ -0,0 +1,60 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   encoder.hpp
+*   @brief  The Encoder class is the interface the report builder writes through.  JsonWriter produces the
+*           normal JSON reports, CborWriter and MsgpackWriter (binwriter.hpp) produce compact binary reports
+*           that use integer field IDs instead of key strings.  Every encoder writes into a caller owned buffer
+*           and latches an overflow flag instead of writing past its end.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#ifndef __ENCODER_HPP__
+#define __ENCODER_HPP__
+
+#include <stddef.h>
+#include <time.h>
+
+class Encoder {
+    public:
+        virtual ~Encoder() { }
+
+        virtual void        reset(void) = 0;
+        virtual const char* data(void) const = 0;
+        virtual size_t      length(void) const = 0;
+        virtual size_t      capacity(void) const = 0;
+        virtual bool        overflow(void) const = 0;
+
+        //values used for the IoT Hub message system properties, encoding may be NULL
+        virtual const char* content_type(void) const = 0;
+        virtual const char* content_encoding(void) const = 0;
+        //true if the output is printable text
+        virtual bool        is_text(void) const = 0;
+
+        //binary encoders need the number of entries up front
+        virtual Encoder& begin_map(int count) = 0;
+        virtual Encoder& end_map(void) = 0;
+
+        //binary encoders write the id, text encoders write the name
+        virtual Encoder& key(int id, const char *name) = 0;
+
+        virtual Encoder& value(const char *s) = 0;
+        virtual Encoder& value(int v) = 0;
+        virtual Encoder& value(double v, int prec) = 0;
+        virtual Encoder& value(time_t t, const char *fmt) = 0;
+
+        //used by the Batcher to wrap several encoded reports into one array; the header is written into
+        //'out' (at most ARRAY_HDR_MAX bytes) and its length returned.
+        enum { ARRAY_HDR_MAX = 5 };
+        virtual size_t array_header(unsigned char *out, int count) const = 0;
+        virtual size_t array_separator(unsigned char *out) const = 0;
+        virtual size_t array_trailer(unsigned char *out) const = 0;
+};
+
+#endif // __ENCODER_HPP__
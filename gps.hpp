@@ -10,12 +10,15 @@
 #include <time.h>
 #include <math.h>
 #include <sys/time.h>
+#include <atomic>
 #include <chrono>
 
 #include "mal.hpp"
 
 #include <nettle/nettle-stdint.h>
 
+#define GPS_FIX_TIMEOUT_MS   5000     //a position request not answered by then is tried again
+
 typedef struct latlong_t {
     float lat, lng;
     } latlong;
@@ -36,16 +39,18 @@ class Wncgps {
         latlong         loc;
         pthread_mutex_t gps_mutex;
         Mal*            malptr;
+        std::atomic<bool> fix_pending;    //a position request is out
 
         static void *gps_task(void *thread);
-        int getGPSlocation(json_keyval *kv, int kvsize);
+        static void  on_location(int result, const MalReply *reply, void *ctx);
 
     public:
         Wncgps() : 
             gps_good(false),
             enable_acq(false),
             gps_on(true),
-            gps_mutex(PTHREAD_MUTEX_INITIALIZER)
+            gps_mutex(PTHREAD_MUTEX_INITIALIZER),
+            fix_pending(false)
             {
             loc.lat = loc.lng = 0.0;
             gps_stat.last_pos = loc;
@@ -0,0 +1,589 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   hubstub.cpp
+*   @brief  a loopback stand-in for the IoT Hub that 'make check' runs the -L load sweep and the -H check
+*           against.
+*
+*           It accepts TLS connections on 127.0.0.1 and answers just enough of the protocols:
+*             MQTT  (8883) CONNACK, SUBACK, UNSUBACK, PINGRESP, a PUBACK for every QoS 1 PUBLISH, the whole
+*                          twin for a twin GET and 204 for a reported properties PATCH
+*             HTTPS (443)  a blob upload: the SAS URI for a POST to /files, 201 for each block PUT and the
+*                          block list PUT, and 204 for the notification.  204 No Content for every other
+*                          request, events POSTs and deviceBound GETs alike.
+*           AMQP and the WebSocket transports are not answered.
+*
+*           SIGUSR1 sends every MQTT device a C2D STUB_COMMAND, the direct method STUB_COMMAND and a desired
+*           ReportPeriod of STUB_PERIOD.  What the device does about them is printed as it arrives: "command
+*           reply", "method response <status>" and "reported ReportPeriod <period>".
+*
+*           hubstub cert.pem key.pem [mqtt-port [https-port]]     a port of 0 is not listened on
+*
+*           When a blob's block list is committed the stand-in prints whether it lists the blocks in the order
+*           they arrived with their ids increasing: "... in order" or "... OUT OF ORDER".
+*
+*           It runs until SIGINT/SIGTERM and then prints what it saw.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "mbedtls/config.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+
+#define STUB_MAX_CONNS     8           //the sweep uses one, the -B benchmark one per transport
+#define STUB_BUF_LEN       (64*1024)   //largest MQTT packet or HTTP request (headers and body) taken, the
+                                       //capture upload PUTs 32K blocks
+#define STUB_MAX_BLOCKS    1024        //of a blob upload
+#define STUB_PUB_LEN       1024        //largest PUBLISH sent
+
+#define STUB_COMMAND       "GET-DEV-INFO"   //answered by the device without its sensors
+#define STUB_PERIOD        "60"             //the device's own default is 10
+#define STUB_TWIN          "{\"desired\":{\"$version\":1},\"reported\":{\"$version\":1}}"
+
+typedef struct {
+    mbedtls_net_context net;           //fd < 0 when the slot is free
+    mbedtls_ssl_context ssl;
+    bool                mqtt;          //else HTTPS
+    bool                shook;         //handshake done
+    char                device[64];    //the MQTT client id, "" until CONNECT
+    size_t              len;
+    unsigned char       in[STUB_BUF_LEN+1];
+    } Conn;
+
+static mbedtls_ssl_config       conf;
+static mbedtls_x509_crt         cert;
+static mbedtls_pk_context       key;
+static mbedtls_entropy_context  entropy;
+static mbedtls_ctr_drbg_context ctr_drbg;
+
+static mbedtls_net_context      mqtt_listen, http_listen;
+static Conn                     conns[STUB_MAX_CONNS];
+
+static volatile sig_atomic_t    stop, inject;
+static unsigned int             accepted, refused, publishes, requests, dropped, injected;
+static uint16_t                 next_pid = 1;
+static int                      twin_version = 1;
+
+static struct {                                //the blob being uploaded, one at a time
+    char          name[128];
+    char          ids[STUB_MAX_BLOCKS][16];    //base64 block ids in the order the blocks arrived
+    int           blocks;
+    unsigned long bytes;
+    } blob;
+
+static void on_signal(int sig)
+{
+    if( sig == SIGUSR1 )
+        inject = 1;
+    else
+        stop = 1;
+}
+
+// writes all of 'len' bytes, the packets are small so a socket that is full is simply retried
+static bool send_all(Conn *c, const unsigned char *buf, size_t len)
+{
+    int ret;
+
+    while( len > 0 ) {
+        ret = mbedtls_ssl_write(&c->ssl, buf, len);
+        if( ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_WANT_READ ) {
+            poll(NULL, 0, 1);
+            continue;
+            }
+        if( ret <= 0 )
+            return false;
+        buf += ret;
+        len -= ret;
+        }
+    return true;
+}
+
+// sends a PUBLISH of 'payload' to 'topic'
+static bool publish(Conn *c, const char *topic, const char *payload, int qos)
+{
+    unsigned char pkt[STUB_PUB_LEN];
+    size_t        tlen = strlen(topic), plen = strlen(payload);
+    size_t        rem = 2 + tlen + (qos? 2 : 0) + plen, n = 1;
+
+    if( rem + 5 > sizeof(pkt) )
+        return false;
+    pkt[0] = 0x30 | (qos << 1);
+    do {                                       //the remaining length, 7 bits a byte
+        pkt[n] = rem & 0x7f;
+        rem >>= 7;
+        if( rem )
+            pkt[n] |= 0x80;
+        n++;
+        } while( rem );
+    pkt[n++] = tlen >> 8;
+    pkt[n++] = tlen & 0xff;
+    memcpy(pkt+n, topic, tlen);
+    n += tlen;
+    if( qos ) {
+        pkt[n++] = next_pid >> 8;
+        pkt[n++] = next_pid & 0xff;
+        if( ++next_pid == 0 )
+            next_pid = 1;
+        }
+    memcpy(pkt+n, payload, plen);
+    return send_all(c, pkt, n+plen);
+}
+
+//
+// what the device published: the twin requests are answered, and what it does about inject_all() is printed
+//
+static bool device_publish(Conn *c, const char *topic, const unsigned char *payload, size_t len)
+{
+    char        rid[16] = "", resp[96];
+    const char *p;
+    bool        ok = true;
+
+    if( (p=strstr(topic, "$rid=")) != NULL )
+        sscanf(p+5, "%15[^&]", rid);
+    if( !strncmp(topic, "$iothub/twin/GET/", 17) ) {
+        snprintf(resp, sizeof(resp), "$iothub/twin/res/200/?$rid=%s", rid);
+        ok = publish(c, resp, STUB_TWIN, 0);
+        }
+    else if( !strncmp(topic, "$iothub/twin/PATCH/properties/reported/", 39) ) {
+        if( memmem(payload, len, "\"ReportPeriod\":" STUB_PERIOD, 15 + strlen(STUB_PERIOD)) != NULL )
+            printf("hubstub: reported ReportPeriod %s\n", STUB_PERIOD);
+        snprintf(resp, sizeof(resp), "$iothub/twin/res/204/?$rid=%s&$version=%d", rid, ++twin_version);
+        ok = publish(c, resp, "", 0);
+        }
+    else if( !strncmp(topic, "$iothub/methods/res/", 20) )
+        printf("hubstub: method response %d\n", atoi(topic+20));
+    else if( strstr(topic, "/messages/events/") != NULL && strstr(topic, "reply=") != NULL )
+        printf("hubstub: command reply\n");
+    fflush(stdout);
+    return ok;
+}
+
+//
+// answers the MQTT packet at the start of c->in, returns the bytes it used, 0 if it isn't all there yet or
+// -1 to close the connection
+//
+static int mqtt_packet(Conn *c)
+{
+    size_t         n, t, rem = 0;
+    unsigned char *v, ack[4 + 2*32];
+    char           topic[256];
+    int            count, qos;
+
+    for( n=1; ; n++ ) {                        //the remaining length, 7 bits a byte, up to 4 bytes
+        if( n >= c->len )
+            return 0;
+        rem |= (size_t)(c->in[n] & 0x7f) << (7*(n-1));
+        if( !(c->in[n] & 0x80) )
+            break;
+        if( n == 4 )
+            return -1;
+        }
+    n++;
+    if( n + rem > STUB_BUF_LEN )
+        return -1;
+    if( c->len < n + rem )
+        return 0;
+    v = c->in + n;
+
+    switch( c->in[0] >> 4 ) {
+        case 1:                                //CONNECT, accepted whatever the credentials
+            if( rem >= 12 && (t = 2 + ((v[0] << 8) | v[1]) + 4) + 2 <= rem ) {     //protocol, level, flags,
+                size_t id = (v[t] << 8) | v[t+1];                                  //keep-alive, client id
+                if( id < sizeof(c->device) && t + 2 + id <= rem ) {
+                    memcpy(c->device, v+t+2, id);
+                    c->device[id] = '\0';
+                    }
+                }
+            ack[0] = 0x20; ack[1] = 2; ack[2] = 0; ack[3] = 0;
+            return send_all(c, ack, 4)? (int)(n+rem) : -1;
+        case 3:                                //PUBLISH
+            publishes++;
+            qos = (c->in[0] >> 1) & 3;
+            if( rem < 2 || (t = 2 + ((v[0] << 8) | v[1])) + (qos? 2 : 0) > rem )
+                return -1;
+            snprintf(topic, sizeof(topic), "%.*s", (int)(t-2), (const char*)v+2);
+            if( qos == 1 ) {
+                ack[0] = 0x40; ack[1] = 2; ack[2] = v[t]; ack[3] = v[t+1];
+                if( !send_all(c, ack, 4) )
+                    return -1;
+                }
+            t += qos? 2 : 0;
+            return device_publish(c, topic, v+t, rem-t)? (int)(n+rem) : -1;
+        case 8:                                //SUBSCRIBE, every filter granted QoS 1 at most
+            if( rem < 2 )
+                return -1;
+            ack[0] = 0x90; ack[2] = v[0]; ack[3] = v[1];
+            count = 0;
+            for( size_t i=2; i+2 < rem && count < 32; count++ ) {
+                i += 2 + ((v[i] << 8) | v[i+1]);
+                if( i >= rem )
+                    return -1;
+                ack[4+count] = v[i++] > 0? 1 : 0;
+                }
+            ack[1] = 2 + count;
+            return send_all(c, ack, 4+count)? (int)(n+rem) : -1;
+        case 10:                               //UNSUBSCRIBE
+            if( rem < 2 )
+                return -1;
+            ack[0] = 0xb0; ack[1] = 2; ack[2] = v[0]; ack[3] = v[1];
+            return send_all(c, ack, 4)? (int)(n+rem) : -1;
+        case 12:                               //PINGREQ
+            ack[0] = 0xd0; ack[1] = 0;
+            return send_all(c, ack, 2)? (int)(n+rem) : -1;
+        case 14:                               //DISCONNECT
+            return -1;
+        default:
+            return n+rem;
+        }
+}
+
+// the value of 'name=' in the query of 'path', %XX decoded, "" if there isn't one
+static void query_value(const char *path, const char *name, char *out, size_t size)
+{
+    const char *p = strstr(path, name);
+    size_t      n = 0;
+    unsigned    x;
+
+    if( p != NULL )
+        for( p += strlen(name); *p && *p != '&' && n+1 < size; p++ ) {
+            if( *p == '%' && sscanf(p+1, "%2x", &x) == 1 ) {
+                out[n++] = (char)x;
+                p += 2;
+                }
+            else
+                out[n++] = *p;
+            }
+    out[n] = '\0';
+}
+
+// the base64 block id the blob upload makes from its "%6u" block number, -1 if it isn't one
+static long block_number(const char *id)
+{
+    static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char              num[16];
+    const char       *d;
+    unsigned long     bits = 0;
+    int               nbits = 0;
+    size_t            n = 0;
+
+    for( ; *id && *id != '=' && n+1 < sizeof(num); id++ ) {
+        if( (d=strchr(b64, *id)) == NULL )
+            return -1;
+        bits = (bits << 6) | (d - b64);
+        if( (nbits += 6) >= 8 ) {
+            nbits -= 8;
+            num[n++] = (bits >> nbits) & 0xff;
+            }
+        }
+    num[n] = '\0';
+    return n? strtol(num, NULL, 10) : -1;
+}
+
+// the PUT of the block list: are the blocks listed as they arrived, with their numbers increasing?
+static void commit_blob(const char *list)
+{
+    const char *p = list;
+    char        id[16];
+    long        last = -1, num;
+    int         n = 0;
+    bool        ordered = true;
+
+    while( (p=strstr(p, "<Latest>")) != NULL ) {
+        p += 8;
+        if( sscanf(p, "%15[^<]", id) != 1 || n >= blob.blocks || strcmp(id, blob.ids[n]) ||
+            (num=block_number(id)) <= last )
+            ordered = false;
+        else
+            last = num;
+        n++;
+        }
+    printf("hubstub: blob %s committed %d blocks, %lu bytes, %s\n", blob.name, n, blob.bytes,
+           (ordered && n == blob.blocks)? "in order" : "OUT OF ORDER");
+    fflush(stdout);
+}
+
+//
+// answers the HTTP request at the start of c->in, returns the bytes it used, 0 if it isn't all there yet or
+// -1 to close the connection
+//
+static int http_request(Conn *c)
+{
+    static const char created[] = "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+    static const char reply[]   = "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n";
+    char   *hdr = (char*)c->in, *end, *p, *data, saved;
+    char    method[8], path[512], resp[512], sas[256];
+    size_t  body = 0, used;
+    bool    ok;
+
+    c->in[c->len] = '\0';
+    if( (end=strstr(hdr, "\r\n\r\n")) == NULL )
+        return c->len < STUB_BUF_LEN? 0 : -1;
+    *end = '\0';
+    if( (p=strcasestr(hdr, "\r\nContent-Length:")) != NULL )
+        body = strtoul(p+17, NULL, 10);
+    *end = '\r';
+    if( (size_t)(end + 4 - hdr) + body > STUB_BUF_LEN )
+        return -1;
+    if( c->len < (size_t)(end + 4 - hdr) + body )
+        return 0;
+
+    requests++;
+    data  = end + 4;
+    used  = (data - hdr) + body;
+    saved = c->in[used];                      //the body as a string
+    c->in[used] = '\0';
+    if( sscanf(hdr, "%7s %511s", method, path) != 2 )
+        method[0] = path[0] = '\0';
+    if( !strcmp(method, "POST") && strstr(path, "/files/notifications") != NULL ) {
+        printf("hubstub: upload notification %s\n", strstr(data, "\"isSuccess\":true")? "success" : "failure");
+        fflush(stdout);
+        ok = send_all(c, (const unsigned char*)reply, sizeof(reply)-1);
+        }
+    else if( !strcmp(method, "POST") && strstr(path, "/files") != NULL ) {
+        if( (p=strstr(data, "\"blobName\"")) == NULL || sscanf(p+10, " : \"%127[^\"]", blob.name) != 1 )
+            snprintf(blob.name, sizeof(blob.name), "check");
+        blob.blocks = 0;
+        blob.bytes  = 0;
+        snprintf(sas, sizeof(sas), "{\"correlationId\":\"check\",\"hostName\":\"localhost\",\"containerName\":\"check\","
+                 "\"blobName\":\"%s\",\"sasToken\":\"?sv=check\"}", blob.name);
+        snprintf(resp, sizeof(resp), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                 "Content-Length: %u\r\n\r\n%s", (unsigned)strlen(sas), sas);
+        ok = send_all(c, (const unsigned char*)resp, strlen(resp));
+        }
+    else if( !strcmp(method, "PUT") && strstr(path, "comp=blocklist") != NULL ) {
+        commit_blob(data);
+        ok = send_all(c, (const unsigned char*)created, sizeof(created)-1);
+        }
+    else if( !strcmp(method, "PUT") && strstr(path, "comp=block") != NULL ) {
+        if( blob.blocks < STUB_MAX_BLOCKS )
+            query_value(path, "blockid=", blob.ids[blob.blocks++], sizeof(blob.ids[0]));
+        blob.bytes += body;
+        ok = send_all(c, (const unsigned char*)created, sizeof(created)-1);
+        }
+    else
+        ok = send_all(c, (const unsigned char*)reply, sizeof(reply)-1);
+    c->in[used] = saved;
+    return ok? (int)used : -1;
+}
+
+static void drop(Conn *c)
+{
+    mbedtls_ssl_free(&c->ssl);
+    mbedtls_net_free(&c->net);
+    c->net.fd = -1;
+}
+
+// SIGUSR1: a C2D command, a direct method and a desired property change for every MQTT device
+static void inject_all(void)
+{
+    char topic[128];
+
+    for( int i=0; i<STUB_MAX_CONNS; i++ ) {
+        Conn *c = &conns[i];
+
+        if( c->net.fd < 0 || !c->mqtt || !c->shook || c->device[0] == '\0' )
+            continue;
+        snprintf(topic, sizeof(topic), "devices/%s/messages/devicebound/", c->device);
+        if( !publish(c, topic, STUB_COMMAND, 1) ||
+            !publish(c, "$iothub/methods/POST/" STUB_COMMAND "/?$rid=1", "\"\"", 0) ||
+            !publish(c, "$iothub/twin/PATCH/properties/desired/?$version=2",
+                     "{\"ReportPeriod\":" STUB_PERIOD ",\"$version\":2}", 0) ) {
+            drop(c);
+            continue;
+            }
+        injected++;
+        printf("hubstub: injected a command, a method and a twin update into %s\n", c->device);
+        }
+    fflush(stdout);
+}
+
+static void accept_conn(mbedtls_net_context *listener, bool mqtt)
+{
+    mbedtls_net_context net;
+    Conn               *c = NULL;
+
+    mbedtls_net_init(&net);
+    if( mbedtls_net_accept(listener, &net, NULL, 0, NULL) )
+        return;
+    for( int i=0; i<STUB_MAX_CONNS && c == NULL; i++ )
+        if( conns[i].net.fd < 0 )
+            c = &conns[i];
+    if( c == NULL || mbedtls_net_set_nonblock(&net) ) {
+        mbedtls_net_free(&net);
+        refused++;
+        return;
+        }
+    mbedtls_ssl_init(&c->ssl);
+    if( mbedtls_ssl_setup(&c->ssl, &conf) ) {
+        mbedtls_ssl_free(&c->ssl);
+        mbedtls_net_free(&net);
+        refused++;
+        return;
+        }
+    c->net   = net;
+    c->mqtt  = mqtt;
+    c->shook = false;
+    c->len   = 0;
+    c->device[0] = '\0';
+    mbedtls_ssl_set_bio(&c->ssl, &c->net, mbedtls_net_send, mbedtls_net_recv, NULL);
+    accepted++;
+}
+
+// runs the handshake and answers whatever has arrived, the connection is dropped on any error
+static void service(Conn *c)
+{
+    int ret, used;
+
+    if( !c->shook ) {
+        ret = mbedtls_ssl_handshake(&c->ssl);
+        if( ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE )
+            return;
+        if( ret ) {
+            dropped++;
+            drop(c);
+            return;
+            }
+        c->shook = true;
+        }
+
+    //until the socket and the TLS record buffer are both empty
+    for( ;; ) {
+        ret = mbedtls_ssl_read(&c->ssl, c->in + c->len, STUB_BUF_LEN - c->len);
+        if( ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE )
+            return;
+        if( ret <= 0 ) {
+            drop(c);
+            return;
+            }
+        c->len += ret;
+        while( c->len > 0 && (used=c->mqtt? mqtt_packet(c) : http_request(c)) != 0 ) {
+            if( used < 0 ) {
+                drop(c);
+                return;
+                }
+            memmove(c->in, c->in + used, c->len - used);
+            c->len -= used;
+            }
+        if( c->len == STUB_BUF_LEN ) {
+            drop(c);
+            return;
+            }
+        }
+}
+
+static bool listen_on(mbedtls_net_context *listener, const char *port)
+{
+    mbedtls_net_init(listener);
+    if( !strcmp(port, "0") )
+        return true;
+    if( mbedtls_net_bind(listener, "127.0.0.1", port, MBEDTLS_NET_PROTO_TCP) ||
+        mbedtls_net_set_nonblock(listener) ) {
+        fprintf(stderr, "hubstub: can't listen on port %s\n", port);
+        return false;
+        }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const char         *mqtt_port = argc > 3? argv[3] : "8883";
+    const char         *http_port = argc > 4? argv[4] : "443";
+    struct pollfd       fds[2 + STUB_MAX_CONNS];
+    Conn               *who[2 + STUB_MAX_CONNS];
+    struct sigaction    sa;
+    int                 n;
+
+    if( argc < 3 ) {
+        fprintf(stderr, "usage: hubstub cert.pem key.pem [mqtt-port [https-port]]\n");
+        return EXIT_FAILURE;
+        }
+
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_x509_crt_init(&cert);
+    mbedtls_pk_init(&key);
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&ctr_drbg);
+    if( mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, (const unsigned char*)"hubstub", 7) ||
+        mbedtls_x509_crt_parse_file(&cert, argv[1]) || mbedtls_pk_parse_keyfile(&key, argv[2], NULL) ||
+        mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT) ||
+        mbedtls_ssl_conf_own_cert(&conf, &cert, &key) ) {
+        fprintf(stderr, "hubstub: can't load %s/%s\n", argv[1], argv[2]);
+        return EXIT_FAILURE;
+        }
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &ctr_drbg);
+
+    for( int i=0; i<STUB_MAX_CONNS; i++ )
+        conns[i].net.fd = -1;
+    if( !listen_on(&mqtt_listen, mqtt_port) || !listen_on(&http_listen, http_port) )
+        return EXIT_FAILURE;
+
+    memset(&sa, 0x00, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    printf("hubstub: listening on 127.0.0.1, mqtt %s, https %s\n", mqtt_port, http_port);
+    fflush(stdout);
+
+    while( !stop ) {
+        if( inject ) {
+            inject = 0;
+            inject_all();
+            }
+        n = 0;
+        fds[n].fd = mqtt_listen.fd;  fds[n++].events = POLLIN;
+        fds[n].fd = http_listen.fd;  fds[n++].events = POLLIN;
+        for( int i=0; i<STUB_MAX_CONNS; i++ )
+            if( conns[i].net.fd >= 0 ) {
+                who[n] = &conns[i];
+                fds[n].fd = conns[i].net.fd;
+                fds[n++].events = POLLIN;
+                }
+        if( poll(fds, n, 1000) < 0 ) {
+            if( errno == EINTR )
+                continue;
+            break;
+            }
+        if( fds[0].revents & POLLIN )
+            accept_conn(&mqtt_listen, true);
+        if( fds[1].revents & POLLIN )
+            accept_conn(&http_listen, false);
+        for( int i=2; i<n; i++ )
+            if( fds[i].revents )
+                service(who[i]);
+        }
+
+    for( int i=0; i<STUB_MAX_CONNS; i++ )
+        if( conns[i].net.fd >= 0 )
+            drop(&conns[i]);
+    mbedtls_net_free(&mqtt_listen);
+    mbedtls_net_free(&http_listen);
+    printf("hubstub: %u connections (%u refused, %u failed the handshake), %u publishes, %u requests, "
+           "%u injected\n", accepted, refused, dropped, publishes, requests, injected);
+    mbedtls_ssl_config_free(&conf);
+    mbedtls_x509_crt_free(&cert);
+    mbedtls_pk_free(&key);
+    mbedtls_ctr_drbg_free(&ctr_drbg);
+    mbedtls_entropy_free(&entropy);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,242 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   jsonwriter.hpp
+*   @brief  A small streaming JSON writer.  It appends into a caller owned buffer, keeps track of the current
+*           length so nothing ever has to re-scan the string (no strcat/strlen), and checks every write against
+*           the end of the buffer.  If the buffer is too small the writer latches an overflow flag and stops
+*           writing; the contents are still '\0' terminated.  No heap memory is used.  It is also the default
+*           Encoder used for the telemetry reports.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#ifndef __JSONWRITER_HPP__
+#define __JSONWRITER_HPP__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "encoder.hpp"
+
+#define JSONW_MAX_DEPTH   16
+
+class JsonWriter : public Encoder {
+    private:
+        char     *buf;
+        size_t    size;
+        size_t    len;
+        bool      ovfl;
+        int       depth;
+        uint32_t  has_items;      //bit n set when the container at depth n already holds an item
+
+        inline void put(char c) {
+            if( ovfl || len+1 >= size ) {
+                ovfl = true;
+                return;
+                }
+            buf[len++] = c;
+            buf[len] = '\0';
+            }
+
+        inline void put(const char *s, size_t n) {
+            if( ovfl || len+n >= size ) {
+                ovfl = true;
+                return;
+                }
+            memcpy(buf+len, s, n);
+            len += n;
+            buf[len] = '\0';
+            }
+
+        void put_escaped(const char *s) {
+            static const char hex[] = "0123456789abcdef";
+            const char *run = s;
+
+            for( ; *s; s++ ) {
+                unsigned char c = (unsigned char)*s;
+                if( c >= 0x20 && c != '"' && c != '\\' )
+                    continue;
+                put(run, s-run);
+                put('\\');
+                switch( c ) {
+                    case '"':  put('"');  break;
+                    case '\\': put('\\'); break;
+                    case '\n': put('n');  break;
+                    case '\r': put('r');  break;
+                    case '\t': put('t');  break;
+                    default:
+                        put("u00",3);
+                        put(hex[c>>4]);
+                        put(hex[c&0x0f]);
+                        break;
+                    }
+                run = s+1;
+                }
+            put(run, s-run);
+            }
+
+        //called before every value/key, inserts the ',' between items of the same container
+        inline void separator(void) {
+            if( has_items & (1u<<depth) )
+                put(',');
+            has_items |= (1u<<depth);
+            }
+
+        inline void open(char c) {
+            separator();
+            put(c);
+            if( depth < JSONW_MAX_DEPTH-1 )
+                depth++;
+            has_items &= ~(1u<<depth);
+            }
+
+        inline void close(char c) {
+            put(c);
+            if( depth > 0 )
+                depth--;
+            }
+
+    public:
+        JsonWriter(char *b, size_t s) : buf(b), size(s) { reset(); }
+
+        void reset(void) override {
+            len = 0;
+            ovfl = (size == 0);
+            depth = 0;
+            has_items = 0;
+            if( size )
+                buf[0] = '\0';
+            }
+
+        const char* c_str(void)  const { return buf; }
+        const char* data(void)   const override { return buf; }
+        size_t      length(void) const override { return len; }
+        size_t      capacity(void) const override { return size; }
+        bool        overflow(void) const override { return ovfl; }
+
+        const char* content_type(void) const override     { return "application/json"; }
+        const char* content_encoding(void) const override { return "utf-8"; }
+        bool        is_text(void) const override          { return true; }
+
+        JsonWriter& begin_object(void) { open('{');  return *this; }
+        JsonWriter& end_object(void)   { close('}'); return *this; }
+        JsonWriter& begin_map(int) override { open('{');  return *this; }
+        JsonWriter& end_map(void) override  { close('}'); return *this; }
+        JsonWriter& begin_array(void)  { open('[');  return *this; }
+        JsonWriter& end_array(void)    { close(']'); return *this; }
+
+        //keys are written as-is (they are compile time constants), the ':' is appended and the following
+        //value must not emit another separator.
+        JsonWriter& key(const char *k) {
+            separator();
+            put('"');
+            put(k, strlen(k));
+            put("\":",2);
+            has_items &= ~(1u<<depth);
+            return *this;
+            }
+
+        JsonWriter& key(int, const char *k) override { return key(k); }
+
+        JsonWriter& value(const char *s) override {
+            separator();
+            put('"');
+            put_escaped(s);
+            put('"');
+            return *this;
+            }
+
+        JsonWriter& value(int v) override {
+            char  tmp[12];
+            char *p = tmp+sizeof(tmp);
+            unsigned int u = (v<0)? -(unsigned int)v : (unsigned int)v;
+
+            separator();
+            do {
+                *--p = '0' + (u%10);
+                u /= 10;
+                } while( u );
+            if( v < 0 )
+                *--p = '-';
+            put(p, tmp+sizeof(tmp)-p);
+            return *this;
+            }
+
+        JsonWriter& value(bool v) {
+            separator();
+            if( v )
+                put("true",4);
+            else
+                put("false",5);
+            return *this;
+            }
+
+        //prec is the number of digits after the decimal point, same as printf("%.*f")
+        JsonWriter& value(double v, int prec) override {
+            separator();
+            if( isnan(v) || isinf(v) ) {
+                put("null",4);
+                return *this;
+                }
+            if( ovfl )
+                return *this;
+            int n = snprintf(buf+len, size-len, "%.*f", prec, v);
+            if( n < 0 || (size_t)n >= size-len ) {
+                buf[len] = '\0';
+                ovfl = true;
+                }
+            else
+                len += n;
+            return *this;
+            }
+
+        //writes the time as a JSON string using a strftime format, e.g. "%a %F %X"
+        JsonWriter& value(const struct tm *t, const char *fmt) {
+            separator();
+            put('"');
+            if( !ovfl ) {
+                size_t n = strftime(buf+len, size-len, fmt, t);
+                if( !n ) {
+                    buf[len] = '\0';
+                    ovfl = true;
+                    }
+                else
+                    len += n;
+                }
+            put('"');
+            return *this;
+            }
+
+        JsonWriter& value(time_t t, const char *fmt) override {
+            struct tm tm;
+            gmtime_r(&t, &tm);
+            return value(&tm, fmt);
+            }
+
+        JsonWriter& raw(const char *s, size_t n) {
+            separator();
+            put(s, n);
+            return *this;
+            }
+
+        JsonWriter& member(const char *k, const char *s)              { return key(k).value(s); }
+        JsonWriter& member(const char *k, int v)                      { return key(k).value(v); }
+        JsonWriter& member(const char *k, bool v)                     { return key(k).value(v); }
+        JsonWriter& member(const char *k, double v, int prec)         { return key(k).value(v,prec); }
+        JsonWriter& member(const char *k, const struct tm *t, const char *fmt) { return key(k).value(t,fmt); }
+
+        size_t array_header(unsigned char *out, int) const override { *out = '['; return 1; }
+        size_t array_separator(unsigned char *out) const override   { *out = ','; return 1; }
+        size_t array_trailer(unsigned char *out) const override     { *out = ']'; return 1; }
+};
+
+#endif // __JSONWRITER_HPP__
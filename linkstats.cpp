@@ -0,0 +1,225 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   linkstats.cpp
+*   @brief  member functions for the LinkStats class.  The confirmations are delivered from within
+*           IoTHubClient_LL_DoWork() so everything here runs on the thread that owns the IoT Hub client.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#include <string.h>
+
+#include "linkstats.hpp"
+#include "tlsio_socket.h"
+
+static const char *result_names[SEND_RESULTS] = { "OK", "Error", "Timeout", "Cancelled" };
+
+void LinkStats::clear(void)
+{
+    memset(slots, 0x00, sizeof(slots));
+    memset(results, 0x00, sizeof(results));
+    memset(hist, 0x00, sizeof(hist));
+    in_flight  = replies = 0;
+    next_seq   = 1;
+    refused    = 0;
+    lat_sum_ms = 0.0;
+    lat_max_ms = 0.0;
+
+    up          = false;
+    reason      = "None";
+    connects    = drops = recreates = outages = 0;
+    down_sum_ms = down_max_ms = 0.0;
+    clock_gettime(CLOCK_MONOTONIC, &down_since);
+}
+
+LinkStats::msg_slot *LinkStats::begin(bool reply)
+{
+    if( reply? replies_full() : window_full() ) {
+        refused++;
+        return NULL;
+        }
+    for( int i=0; i<INFLIGHT_MAX+REPLY_INFLIGHT; i++ )
+        if( !slots[i].busy ) {
+            slots[i].busy    = true;
+            slots[i].reply   = reply;
+            slots[i].seq     = next_seq++;
+            slots[i].payload = NULL;
+            clock_gettime(CLOCK_MONOTONIC, &slots[i].queued);
+            if( reply )
+                replies++;
+            else
+                in_flight++;
+            return &slots[i];
+            }
+    refused++;
+    return NULL;
+}
+
+void LinkStats::cancel(msg_slot *m)
+{
+    if( m == NULL || !m->busy )
+        return;
+    m->busy = false;
+    if( m->reply )
+        replies--;
+    else
+        in_flight--;
+}
+
+void LinkStats::complete(msg_slot *m, send_result r)
+{
+    struct timespec now;
+    double          ms;
+    int             b;
+
+    if( m == NULL || !m->busy )
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ms = (now.tv_sec - m->queued.tv_sec)*1000.0 + (now.tv_nsec - m->queued.tv_nsec)/1e6;
+
+    results[r]++;
+    if( r == SEND_OK ) {
+        for( b=0; b<LAT_BUCKETS-1 && ms >= (LAT_BUCKET0_MS << b); b++ )
+            /* find the bucket */;
+        hist[b]++;
+        lat_sum_ms += ms;
+        if( ms > lat_max_ms )
+            lat_max_ms = ms;
+        }
+    m->busy = false;
+    if( m->reply )
+        replies--;
+    else
+        in_flight--;
+}
+
+double LinkStats::percentile_ms(double pct)
+{
+    uint32_t n = results[SEND_OK], want, seen = 0;
+    double   lo, hi, ms;
+
+    if( n == 0 )
+        return 0.0;
+    want = (uint32_t)(pct/100.0*n + 0.5);
+    if( want < 1 )
+        want = 1;
+    for( int b=0; b<LAT_BUCKETS; b++ ) {
+        if( seen + hist[b] >= want ) {
+            lo = b? (LAT_BUCKET0_MS << (b-1)) : 0;
+            hi = (b < LAT_BUCKETS-1)? (LAT_BUCKET0_MS << b) : lat_max_ms;
+            ms = lo + (hi-lo)*(want-seen)/hist[b];
+            return (ms > lat_max_ms)? lat_max_ms : ms;
+            }
+        seen += hist[b];
+        }
+    return lat_max_ms;
+}
+
+static double ms_since(const struct timespec *t)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - t->tv_sec)*1000.0 + (now.tv_nsec - t->tv_nsec)/1e6;
+}
+
+void LinkStats::connection(bool authenticated, const char *why)
+{
+    double ms;
+
+    reason = why;
+    if( authenticated == up )
+        return;
+    up = authenticated;
+    if( !up ) {
+        drops++;
+        clock_gettime(CLOCK_MONOTONIC, &down_since);
+        return;
+        }
+    if( connects++ ) {                     //the first connect isn't a reconnect
+        ms = ms_since(&down_since);
+        outages++;
+        down_sum_ms += ms;
+        if( ms > down_max_ms )
+            down_max_ms = ms;
+        }
+}
+
+double LinkStats::down_ms(void)
+{
+    return up? 0.0 : ms_since(&down_since);
+}
+
+void LinkStats::closed(void)
+{
+    up     = false;
+    reason = "Closed";
+}
+
+void LinkStats::restarted(void)
+{
+    if( !up )
+        clock_gettime(CLOCK_MONOTONIC, &down_since);
+}
+
+const char *LinkStats::result_name(send_result r)
+{
+    return (r < SEND_RESULTS)? result_names[r] : "?";
+}
+
+size_t LinkStats::write(JsonWriter& jw)
+{
+    TLSIO_HANDSHAKE_STATS hs;
+
+    tlsio_mbedtls_get_handshake_stats(&hs);
+    jw.reset();
+    jw.begin_object()
+      .member("ObjectName", "Link-Stats")
+      .member("Sent",       (int)(next_seq-1))
+      .member("InFlight",   in_flight)
+      .member("Window",     window)
+      .member("Refused",    (int)refused);
+    for( int i=0; i<SEND_RESULTS; i++ )
+        jw.member(result_names[i], (int)results[i]);
+
+    jw.key("Latency").begin_object()
+      .member("MeanMs",    mean_ms(), 0)
+      .member("MaxMs",     lat_max_ms, 0)
+      .member("P50Ms",     percentile_ms(50.0), 0)
+      .member("P99Ms",     percentile_ms(99.0), 0)
+      .member("Bucket0Ms", LAT_BUCKET0_MS)
+      .key("Buckets").begin_array();
+    for( int i=0; i<LAT_BUCKETS; i++ )
+        jw.value((int)hist[i]);
+    jw.end_array().end_object();
+
+    //the full/resumed handshake averages show what session resumption saves on each reconnect
+    jw.key("Handshakes").begin_object()
+      .member("Full",         (int)hs.full_count)
+      .member("FullMs",       hs.full_count? (double)hs.full_ms/hs.full_count : 0.0, 0)
+      .member("FullBytes",    hs.full_count? (int)(hs.full_bytes/hs.full_count) : 0)
+      .member("Resumed",      (int)hs.resumed_count)
+      .member("ResumedMs",    hs.resumed_count? (double)hs.resumed_ms/hs.resumed_count : 0.0, 0)
+      .member("ResumedBytes", hs.resumed_count? (int)(hs.resumed_bytes/hs.resumed_count) : 0)
+      .member("Failed",       (int)hs.failed_count)
+      .member("CertParses",   (int)hs.trust_store_parses)
+      .end_object();
+
+    jw.key("Connection").begin_object()
+      .member("State",           up? "Connected" : "Disconnected")
+      .member("Reason",          reason)
+      .member("Connects",        (int)connects)
+      .member("Drops",           (int)drops)
+      .member("Recreated",       (int)recreates)
+      .member("ReconnectMeanMs", outages? down_sum_ms/outages : 0.0, 0)
+      .member("ReconnectMaxMs",  down_max_ms, 0)
+      .end_object().end_object();
+
+    return jw.overflow()? 0 : jw.length();
+}
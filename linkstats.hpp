@@ -0,0 +1,115 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   linkstats.hpp
+*   @brief  The LinkStats class tracks the messages handed to the IoT Hub client until their send confirmation
+*           arrives.  Each message gets a sequence number and the time it was queued; when the confirmation
+*           comes back the result is counted and the queued-to-acknowledged latency is added to a histogram.
+*           It also limits the number of messages in flight, when the window is full new messages are refused
+*           (telemetry then goes to the spool until the backlog clears).  Replies to commands have a few slots
+*           of their own so a backlog of telemetry doesn't hold them up, nor do they take the telemetry's.
+*
+*           Latency bucket n counts acknowledgements that took less than LAT_BUCKET0_MS << n, the last bucket
+*           counts everything slower.
+*
+*           The connection state reported by the IoT Hub client is kept here as well: how often the link dropped,
+*           how often the client had to be created again, and how long each outage lasted until the client was
+*           authenticated again.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#ifndef __LINKSTATS_HPP__
+#define __LINKSTATS_HPP__
+
+#include <stdint.h>
+#include <time.h>
+
+#include "jsonwriter.hpp"
+
+#define INFLIGHT_DEF      8        //default messages waiting for a confirmation
+#define INFLIGHT_MAX      32
+#define REPLY_INFLIGHT    4        //command replies waiting for a confirmation, outside the window
+#define SEND_TIMEOUT_MS   60000    //the IoT Hub client times a message out after this long
+#define LAT_BUCKET0_MS    50
+#define LAT_BUCKETS       10       //<50ms, <100ms ... <12.8s, >=12.8s
+
+typedef enum send_result_t { SEND_OK=0, SEND_ERROR, SEND_TIMEOUT, SEND_CANCELLED, SEND_RESULTS } send_result;
+
+class LinkStats {
+    public:
+        typedef struct msg_slot_t {
+            bool            busy;
+            uint32_t        seq;
+            bool            reply;
+            struct timespec queued;       //CLOCK_MONOTONIC
+            void           *payload;      //the sender's, handed back with the result (see sendMessage)
+            } msg_slot;
+
+    private:
+        msg_slot  slots[INFLIGHT_MAX+REPLY_INFLIGHT];
+        int       window;
+        int       in_flight;              //not counting the replies...
+        int       replies;                //...which are counted here
+        uint32_t  next_seq;
+        uint32_t  refused;                //messages not sent because the window was full
+        uint32_t  results[SEND_RESULTS];
+        uint32_t  hist[LAT_BUCKETS];
+        double    lat_sum_ms;             //of the SEND_OK confirmations
+        double    lat_max_ms;
+
+        bool            up;
+        const char     *reason;           //of the last connection status change
+        uint32_t        connects;         //times the client was authenticated
+        uint32_t        drops;
+        uint32_t        recreates;        //times the client was destroyed and created again
+        uint32_t        outages;          //drops that ended in a reconnect
+        struct timespec down_since;       //CLOCK_MONOTONIC
+        double          down_sum_ms;
+        double          down_max_ms;
+
+    public:
+        LinkStats() { clear(); window = INFLIGHT_DEF; }
+
+        void clear(void);
+        void set_window(int n) { window = (n < 1)? 1 : (n > INFLIGHT_MAX)? INFLIGHT_MAX : n; }
+        int  window_size(void) { return window; }
+        int  pending(void)     { return in_flight + replies; }
+        bool window_full(void) { return in_flight >= window; }
+        bool replies_full(void){ return replies >= REPLY_INFLIGHT; }
+
+        uint32_t count(send_result r) { return results[r]; }
+        double   mean_ms(void)        { return results[SEND_OK]? lat_sum_ms/results[SEND_OK] : 0.0; }
+        double   max_ms(void)         { return lat_max_ms; }
+        //estimated from the histogram, linear within the bucket the percentile falls in
+        double   percentile_ms(double pct);
+
+        //claims a slot for a new message, NULL when the in-flight window (or the replies' slots) are full
+        msg_slot *begin(bool reply=false);
+        //the client refused the message, it will never be confirmed
+        void      cancel(msg_slot *m);
+        //the send confirmation arrived
+        void      complete(msg_slot *m, send_result r);
+
+        //the IoT Hub client's connection status callback
+        void      connection(bool authenticated, const char *why);
+        void      recreated(void)  { recreates++; }
+        //the client was destroyed on purpose (stop, LPM), the link is down but didn't drop...
+        void      closed(void);
+        //...and the time to reconnect runs from when the next client is started, not from the close
+        void      restarted(void);
+        bool      connected(void)  { return up; }
+        //how long the link has been down, 0 while connected
+        double    down_ms(void);
+
+        size_t    write(JsonWriter& jw);
+
+        static const char *result_name(send_result r);
+};
+
+#endif // __LINKSTATS_HPP__
@@ -39,6 +39,16 @@ float Lis2dw12::lis2dw12_getTemp( void )
     return tempF;
 }
 
+void Lis2dw12::lis2dw12_getAccel(float *x, float *y, float *z)
+{
+    uint8_t hp = lis2dw12_read_byte(0x20) & 0x04; //get performance setting
+    float   mg = hp? 0.244 : 0.976;               //per LSB at +/-2g, 14-bit or 12-bit
+
+    *x = byte2int(lis2dw12_read_byte(0x29), lis2dw12_read_byte(0x28), hp) * mg;   // OUT_X_H/L
+    *y = byte2int(lis2dw12_read_byte(0x2b), lis2dw12_read_byte(0x2a), hp) * mg;   // OUT_Y_H/L
+    *z = byte2int(lis2dw12_read_byte(0x2d), lis2dw12_read_byte(0x2c), hp) * mg;   // OUT_Z_H/L
+}
+
 void *Lis2dw12::lis2dw12_int1_thread(void* obj)
 {
     Lis2dw12      *data = static_cast<Lis2dw12 *>(obj);
@@ -59,6 +59,7 @@ class Lis2dw12 {
             }
 
         float lis2dw12_getTemp( void );
+        void  lis2dw12_getAccel(float *x, float *y, float *z);     //in mg, the latest output of the 25Hz conversions
         position lis2dw12_getPosition(void) {
             return last_position;
             }
@@ -7,12 +7,20 @@
 *   @file   mal.cpp
 *   @brief  the modem abstraction layer (mal) is used to control the radio functioinallity of the WNC device. Similar
 *           to the i2c interface, there is only one that can be used so it is created as a singleton class.
+*           The MAL I/O thread runs the requests, everything marked I/O thread below is only touched by it.
 *
 *   @author James Flynn
 *
 *   @date   1-Oct-2018
 */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
 #include "jsmn.h"
 #include "mal.hpp"
 
@@ -21,11 +29,649 @@ bool Mal::mal_started = false;
 
 #define JSON_SOCKET_ADDR	"/tmp/cgi-2-sys"
 
-static pthread_mutex_t mal_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define MAL_CMD_TOKENS	32
+
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+//replies kept for other callers and how long they hold
+static const struct {
+    const char *action;
+    int         ttl_ms;
+    } cached_actions[MAL_CACHE_ACTIONS] = {
+    { "get_system_imei",                MAL_TTL_FOREVER },
+    { "get_system_iccid",               MAL_TTL_FOREVER },
+    { "get_operating_mode",             1000 },
+    { "get_wwan_ipv4_network_ip",       1000 },
+    { "get_wwan_serving_system_status", 1000 },
+    };
+
+static double ms_between(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec)*1000.0 + (to->tv_nsec - from->tv_nsec)/1e6;
+}
+
+//------------------------------------------------------------------
+// connections, I/O thread only
+//
+
+//
+// a new connection to the MAL manager, <0 if it can't be made.  The connect is blocking (a local socket
+// answers at once), the connection is non-blocking after it.
+//
+int Mal::open_conn(void)
+{
+    int                fd;
+    struct sockaddr_un addr;
+
+    strcpy(addr.sun_path, JSON_SOCKET_ADDR);    // max 108 bytes
+    addr.sun_family = AF_UNIX;
+
+    io_syscalls++;
+    if( (fd=socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 )
+        return MAL_ERR_SOCKET;
+    io_syscalls += 2;
+    if( connect(fd, (struct sockaddr*) &addr, SUN_LEN(&addr)) < 0 || fcntl(fd, F_SETFL, O_NONBLOCK) < 0 ) {
+        close_conn(fd);
+        return MAL_ERR_CONNECT;
+        }
+    io_connects++;
+    return fd;
+}
+
+void Mal::close_conn(int fd)
+{
+    io_syscalls++;
+    close(fd);
+}
+
+//
+// a kept connection can be used if the manager hasn't closed it and nothing is waiting to be read on it
+// (the rest of a reply that didn't fit would otherwise be read as the answer to the next command)
+//
+bool Mal::conn_alive(int fd)
+{
+    struct pollfd pfd = { fd, POLLIN | POLLRDHUP, 0 };
+
+    io_syscalls++;
+    return poll(&pfd, 1, 0) == 0;
+}
+
+int Mal::get_conn(bool *reused)
+{
+    int fd;
+
+    if( !persist ) {
+        reuse_fails = 0;
+        while( idle_count )
+            close_conn(idle[--idle_count]);
+        }
+    while( idle_count ) {
+        fd = idle[--idle_count];
+        if( conn_alive(fd) ) {
+            reuse_fails = 0;
+            *reused = true;
+            return fd;
+            }
+        close_conn(fd);
+        if( ++reuse_fails >= MAL_REUSE_FAILS && persist ) {
+            printf("MAL manager closes its connections, using one per command.\n");
+            persist = false;
+            }
+        }
+    *reused = false;
+    return open_conn();
+}
+
+void Mal::put_conn(int fd, bool ok)
+{
+    if( ok && persist && idle_count < MAL_POOL )
+        idle[idle_count++] = fd;
+    else
+        close_conn(fd);
+}
+
+void Mal::get_stats(mal_stats *s)
+{
+    while( pthread_mutex_trylock(&stats_mutex) )
+        pthread_yield();
+    *s = stats;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void Mal::clear_stats(void)
+{
+    while( pthread_mutex_trylock(&stats_mutex) )
+        pthread_yield();
+    memset(&stats, 0x00, sizeof(stats));
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+//------------------------------------------------------------------
+// the cache, I/O thread only
+//
+
+//
+// the cache entry of a command, -1 if it isn't cached (it has arguments, or isn't one of cached_actions).
+// 'changes' is set for anything but a get_, an unreadable command included.
+//
+static int action_of(const char *cmd, size_t len, bool *changes)
+{
+    jsmn_parser p;
+    jsmntok_t   t[MAL_CMD_TOKENS];
+    mal_str     a;
+    int         n;
+
+    *changes = true;
+    jsmn_init(&p);
+    if( (n=jsmn_parse(&p, cmd, len, t, MAL_CMD_TOKENS)) < 1 )
+        return -1;
+    MalReply c(cmd, len, t, n);
+    if( !c.str(c.find("action"), &a) )
+        return -1;
+    *changes = (a.len < 4 || memcmp(a.p, "get_", 4));
+    if( c.find("args") >= 0 )
+        return -1;
+    for( int i=0; i<MAL_CACHE_ACTIONS; i++ )
+        if( (int)strlen(cached_actions[i].action) == a.len && !memcmp(cached_actions[i].action, a.p, a.len) )
+            return i;
+    return -1;
+}
+
+void Mal::drop_cache(bool all)
+{
+    for( int i=0; i<MAL_CACHE_ACTIONS; i++ )
+        if( all || cached_actions[i].ttl_ms != MAL_TTL_FOREVER ) {
+            free(cache[i].resp);
+            free(cache[i].tok);
+            cache[i].resp = NULL;
+            cache[i].tok  = NULL;
+            cache[i].leader = NULL;              //a request that is out won't be kept, nor followed
+            }
+}
+
+void Mal::store(mal_cache *e, const mal_req *r)
+{
+    int        n = r->parser.toknext;
+    char      *resp = (char*)malloc(r->resp_len+1);
+    jsmntok_t *tok = (jsmntok_t*)malloc(n*sizeof(jsmntok_t));
+
+    if( resp == NULL || tok == NULL ) {
+        free(resp);
+        free(tok);
+        return;
+        }
+    memcpy(resp, r->resp, r->resp_len+1);
+    memcpy(tok, r->tok, n*sizeof(jsmntok_t));
+    free(e->resp);
+    free(e->tok);
+    e->resp     = resp;
+    e->resp_len = r->resp_len;
+    e->tok      = tok;
+    e->ntok     = n;
+    clock_gettime(CLOCK_MONOTONIC, &e->stored);
+}
+
+//
+// a new request for a cached action: answered from the cache, or following the one that is already out
+// (true either way), or else it leads and is started
+//
+bool Mal::answer(mal_req *r)
+{
+    mal_cache      *e = &cache[r->action];
+    int             ttl = cached_actions[r->action].ttl_ms;
+    struct timespec now;
+    mal_req       **pp;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if( e->resp != NULL && (ttl == MAL_TTL_FOREVER || ms_between(&e->stored, &now) < ttl) ) {
+        MalReply reply(e->resp, e->resp_len, e->tok, e->ntok);
+        done(r, MAL_OK, &reply, &stats.cached);
+        release(r);
+        return true;
+        }
+    if( e->leader != NULL ) {
+        for( pp=&e->leader->followers; *pp != NULL; pp=&(*pp)->next )
+            /* to the end */;
+        *pp = r;
+        return true;
+        }
+    e->leader = r;
+    return false;
+}
+
+//
+// fails the followers whose time is up, the leader may still be waiting for its reply
+//
+void Mal::expire(mal_req *leader, const struct timespec *now)
+{
+    mal_req *f, **pp;
+
+    for( pp=&leader->followers; (f=*pp) != NULL; )
+        if( ms_between(&f->deadline, now) >= 0 ) {
+            *pp = f->next;
+            done(f, MAL_ERR_TIMEOUT, NULL, NULL);
+            release(f);
+            }
+        else
+            pp = &f->next;
+}
+
+//------------------------------------------------------------------
+// the request engine
+//
+
+bool Mal::submit(const char *json_cmd, bool wait_resp, int timeout_ms, mal_cb cb, void *ctx)
+{
+    mal_req *r = (mal_req*)malloc(sizeof(mal_req));
+    size_t   len = strlen(json_cmd);
+
+    if( r == NULL || (r->cmd = (char*)malloc(len)) == NULL ) {
+        free(r);
+        return false;
+        }
+    memcpy(r->cmd, json_cmd, len);
+    r->len       = len;
+    r->wait_resp = wait_resp;
+    r->cb        = cb;
+    r->ctx       = ctx;
+    r->fd        = -1;
+    r->reused    = false;
+    r->tries     = 0;
+    r->resp      = NULL;
+    r->resp_len  = 0;
+    r->resp_cap  = 0;
+    r->action    = action_of(json_cmd, len, &r->changes);
+    r->followers = NULL;
+    r->next      = NULL;
+    if( !wait_resp || !cache_on )
+        r->action = -1;
+    clock_gettime(CLOCK_MONOTONIC, &r->submitted);
+    r->deadline  = r->submitted;
+    r->deadline.tv_sec  += timeout_ms / 1000;
+    r->deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if( r->deadline.tv_nsec >= 1000000000L ) {
+        r->deadline.tv_sec++;
+        r->deadline.tv_nsec -= 1000000000L;
+        }
+
+    if( !submitted.push(r) ) {
+        free(r->cmd);
+        free(r);
+        return false;
+        }
+    io.wake();
+    return true;
+}
+
+//
+// counts the request and hands it the result, 'counter' is the stat of how it was answered (or NULL)
+//
+void Mal::done(mal_req *r, int result, const MalReply *reply, uint32_t *counter)
+{
+    struct timespec now;
+    double          ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ms = ms_between(&r->submitted, &now);
+    while( pthread_mutex_trylock(&stats_mutex) )
+        pthread_yield();
+    stats.commands++;
+    stats.syscalls += io_syscalls;                //what the I/O thread counted since the last command
+    stats.connects += io_connects;
+    io_syscalls = io_connects = 0;
+    stats.failed   += (result < 0);
+    stats.timeouts += (result == MAL_ERR_TIMEOUT);
+    stats.reused   += (result == MAL_OK && r->reused);
+    if( (uint32_t)r->resp_len > stats.max_reply )
+        stats.max_reply = r->resp_len;
+    stats.sum_ms   += ms;
+    if( ms > stats.max_ms )
+        stats.max_ms = ms;
+    if( counter != NULL )
+        (*counter)++;
+    pthread_mutex_unlock(&stats_mutex);
+
+    if( r->cb != NULL )
+        r->cb(result, reply, r->ctx);
+}
+
+void Mal::release(mal_req *r)
+{
+    free(r->resp);
+    free(r->cmd);
+    free(r);
+}
+
+//
+// the request is over: kept if it is still its action's leader, handed to its callback and its followers'
+// and freed.  If its time ran out, the followers still have theirs (expire() has run) and the first of them
+// takes over as the leader, at the head of the line.
+//
+void Mal::finish(mal_req *r, int result)
+{
+    bool       ok = (result == MAL_OK && r->resp != NULL);
+    MalReply   reply(r->resp, r->resp_len, r->tok, ok? r->parser.toknext : 0);
+    MalStatus  st;
+    mal_req   *f;
+
+    for( int i=0; i<MAL_MAX_INFLIGHT; i++ )
+        if( active[i] == r )
+            active[i] = NULL;
+
+    if( r->action >= 0 && cache[r->action].leader == r ) {
+        cache[r->action].leader = NULL;
+        if( ok && st.decode(result, &reply) )
+            store(&cache[r->action], r);
+        }
+    if( result == MAL_ERR_TIMEOUT && (f=r->followers) != NULL ) {
+        r->followers = NULL;
+        f->followers = f->next;
+        if( r->action >= 0 && cache[r->action].leader == NULL )
+            cache[r->action].leader = f;
+        if( (f->next=waiting) == NULL )
+            waiting_tail = f;
+        waiting = f;
+        }
+    if( r->changes )
+        drop_cache(false);
+
+    done(r, result, ok? &reply : NULL, NULL);
+    while( (f=r->followers) != NULL ) {
+        r->followers = f->next;
+        done(f, result, ok? &reply : NULL, &stats.coalesced);
+        release(f);
+        }
+    release(r);
+}
+
+//
+// the connection failed: a kept one the manager has just closed fails the write or reads nothing, so the
+// command is tried once more on a new connection
+//
+void Mal::fail(mal_req *r, int result)
+{
+    if( r->fd >= 0 ) {
+        io.remove(r->fd);
+        close_conn(r->fd);
+        r->fd = -1;
+        }
+    if( r->reused && r->resp_len == 0 && r->tries++ == 0 )
+        start(r);
+    else
+        finish(r, result);
+}
+
+void Mal::start(mal_req *r)
+{
+    int slot;
+
+    for( slot=0; slot<MAL_MAX_INFLIGHT && active[slot] != NULL && active[slot] != r; slot++ )
+        /* find a free slot */;
+    if( slot == MAL_MAX_INFLIGHT ) {               //all are out, it goes back to the head of the line
+        if( (r->next=waiting) == NULL )
+            waiting_tail = r;
+        waiting = r;
+        return;
+        }
+    active[slot] = r;
+
+    //a command that isn't answered gets a connection of its own, closed once it is sent
+    r->fd = r->wait_resp? get_conn(&r->reused) : open_conn();
+    if( r->fd < 0 ) {
+        int err = r->fd;
+        r->reused = false;
+        finish(r, err);
+        return;
+        }
+    io_syscalls++;
+    if( send(r->fd, r->cmd, r->len, MSG_NOSIGNAL) != (ssize_t)r->len ) {     //no SIGPIPE if the manager has closed it
+        fail(r, MAL_ERR_WRITE);
+        return;
+        }
+    if( !r->wait_resp ) {
+        close_conn(r->fd);
+        finish(r, MAL_OK);
+        return;
+        }
+    jsmn_init(&r->parser);
+    if( !io.add(r->fd, EPOLLIN, on_readable, r) )
+        fail(r, MAL_ERR_READ);
+}
+
+bool Mal::grow(mal_req *r)
+{
+    int   cap = r->resp_cap? r->resp_cap*2 : MAL_RESP_INIT;
+    char *p;
+
+    if( r->resp_cap >= MAL_RESP_MAX || (p=(char*)realloc(r->resp, cap)) == NULL )
+        return false;
+    r->resp     = p;
+    r->resp_cap = cap;
+    return true;
+}
+
+//
+// feeds what has been read to jsmn, 1 once the top-level object is complete, 0 while more is to come.  A
+// primitive at the end of the data may still be growing, jsmn would take it as finished, so the data is
+// only fed up to the last delimiter (a string split over reads is left for later by jsmn itself).
+//
+int Mal::feed(mal_req *r)
+{
+    size_t len = r->resp_len;
+    int    rc;
+
+    while( len > r->parser.pos && !strchr(" \t\r\n,:]}\"", r->resp[len-1]) )
+        len--;
+    rc = jsmn_parse(&r->parser, r->resp, len, r->tok, MAL_TOKENS);
+    if( rc == JSMN_ERROR_PART || (rc >= 0 && r->parser.toknext == 0) )
+        return 0;
+    if( rc < 0 || r->tok[0].type != JSMN_OBJECT )
+        return MAL_ERR_PARSE;
+    return r->tok[0].end != -1;
+}
+
+void Mal::on_readable(int fd, uint32_t, void *ctx)
+{
+    Mal     *self = mal_ptr;
+    mal_req *r = static_cast<mal_req *>(ctx);
+    int      n, rc;
+    bool     tail;
+
+    //reads all there is, the socket is non-blocking
+    for( ;; ) {
+        if( r->resp_len+1 >= r->resp_cap && !grow(r) ) {
+            self->fail(r, MAL_ERR_READ);
+            return;
+            }
+        self->io_syscalls++;
+        n = read(fd, r->resp + r->resp_len, r->resp_cap - r->resp_len - 1);
+        if( n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+            break;
+        if( n <= 0 ) {
+            self->fail(r, MAL_ERR_READ);
+            return;
+            }
+        r->resp_len += n;
+        r->resp[r->resp_len] = '\0';
+        }
+
+    if( (rc=feed(r)) == 0 )
+        return;
+    if( rc < 0 ) {
+        self->fail(r, rc);
+        return;
+        }
+    //anything but white space after the object would be read as the next reply, don't keep the connection
+    tail = false;
+    for( int i=r->tok[0].end; i<r->resp_len; i++ )
+        tail |= !strchr(" \t\r\n", r->resp[i]);
+    self->io.remove(fd);
+    self->put_conn(fd, !tail);
+    r->fd = -1;
+    self->finish(r, MAL_OK);
+}
+
+//
+// fails the requests whose time is up, waiting or out
+//
+void Mal::on_tick(int, uint32_t, void *ctx)
+{
+    Mal            *self = static_cast<Mal *>(ctx);
+    struct timespec now;
+    mal_req        *r, **pp;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for( int i=0; i<MAL_MAX_INFLIGHT; i++ )
+        if( self->active[i] != NULL )
+            self->expire(self->active[i], &now);
+    for( r=self->waiting; r != NULL; r=r->next )
+        self->expire(r, &now);
+    for( int i=0; i<MAL_MAX_INFLIGHT; i++ )
+        if( (r=self->active[i]) != NULL && ms_between(&r->deadline, &now) >= 0 ) {
+            r->reused = false;                    //don't try again
+            self->fail(r, MAL_ERR_TIMEOUT);
+            }
+    for( pp=&self->waiting; (r=*pp) != NULL; )
+        if( ms_between(&r->deadline, &now) >= 0 ) {
+            *pp = r->next;
+            self->finish(r, MAL_ERR_TIMEOUT);
+            }
+        else
+            pp = &r->next;
+    for( self->waiting_tail=self->waiting; self->waiting_tail && self->waiting_tail->next; )
+        self->waiting_tail = self->waiting_tail->next;
+}
+
+//
+// takes the new submissions and starts as many waiting requests as there are free slots
+//
+void Mal::dispatch(void)
+{
+    mal_req *r;
+    int      busy = 0;
+
+    if( !cache_on )
+        drop_cache(true);
+    while( submitted.pop(r) ) {
+        if( r->changes )
+            drop_cache(false);
+        if( r->action >= 0 && answer(r) )
+            continue;
+        if( waiting_tail != NULL )
+            waiting_tail->next = r;
+        else
+            waiting = r;
+        waiting_tail = r;
+        }
+    for( int i=0; i<MAL_MAX_INFLIGHT; i++ )
+        busy += (active[i] != NULL);
+    while( busy < MAL_MAX_INFLIGHT && (r=waiting) != NULL ) {
+        if( (waiting=r->next) == NULL )
+            waiting_tail = NULL;
+        r->next = NULL;
+        start(r);
+        busy = 0;
+        for( int i=0; i<MAL_MAX_INFLIGHT; i++ )
+            busy += (active[i] != NULL);
+        }
+}
+
+void *Mal::io_task(void *obj)
+{
+    Mal *self = static_cast<Mal *>(obj);
+
+    for( ;; ) {
+        self->dispatch();
+        self->io.run_once(-1);
+        }
+    return NULL;
+}
+
+bool Mal::start_io(void)
+{
+    if( !io.open() || io.add_timer(MAL_TICK_MS, on_tick, this) < 0 )
+        return false;
+    return pthread_create(&io_thread, NULL, io_task, (void*)this) == 0;
+}
+
+//------------------------------------------------------------------
+// the blocking forms
+//
+
+typedef struct mal_wait_t {
+    pthread_mutex_t  mutex;
+    pthread_cond_t   cond;
+    bool             done;
+    int              result;
+    mal_cb           cb;
+    void            *ctx;
+    } mal_wait;
+
+static void wake_waiter(int result, const MalReply *reply, void *ctx)
+{
+    mal_wait *w = static_cast<mal_wait *>(ctx);
+
+    if( w->cb != NULL )
+        w->cb(result, reply, w->ctx);
+    pthread_mutex_lock(&w->mutex);
+    w->result = result;
+    w->done = true;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->mutex);
+}
+
+static int wait_for(Mal *mal, const char *json_cmd, bool wait_resp, int timeout_ms, mal_cb cb, void *ctx)
+{
+    mal_wait w;
+
+    pthread_mutex_init(&w.mutex, NULL);
+    pthread_cond_init(&w.cond, NULL);
+    w.done   = false;
+    w.result = MAL_ERR_BUSY;
+    w.cb     = cb;
+    w.ctx    = ctx;
+
+    if( mal->submit(json_cmd, wait_resp, timeout_ms, wake_waiter, &w) ) {
+        pthread_mutex_lock(&w.mutex);
+        while( !w.done )
+            pthread_cond_wait(&w.cond, &w.mutex);
+        pthread_mutex_unlock(&w.mutex);
+        }
+    else if( cb != NULL )
+        cb(w.result, NULL, ctx);
+    pthread_cond_destroy(&w.cond);
+    pthread_mutex_destroy(&w.mutex);
+    return w.result;
+}
+
+int Mal::call(const char *json_cmd, mal_cb cb, void *ctx, int timeout_ms)
+{
+    return wait_for(this, json_cmd, true, timeout_ms, cb, ctx);
+}
+
+typedef struct mal_copy_t {
+    char *resp;
+    int   len;
+    int   result;
+    } mal_copy;
+
+static void copy_reply(int result, const MalReply *reply, void *ctx)
+{
+    mal_copy *c = static_cast<mal_copy *>(ctx);
+
+    c->result = result;
+    if( reply == NULL || c->resp == NULL )
+        return;
+    if( reply->length() > c->len )
+        c->result = MAL_ERR_READ;
+    memcpy(c->resp, reply->json(), (c->len > reply->length())? reply->length() : c->len);
+    if( c->len > reply->length() )
+        c->resp[reply->length()] = '\0';
+}
 
 // 
-// This function opens a socket to the MAL manager and then sends the JSON command to it.  It will
-// then wait for a response, close the socketl, and return.
+// This function sends the JSON command to the MAL manager and, if asked to, waits for the response.  Only
+// this caller waits, other threads' commands go ahead on their own connections.
 //
 // Inputs:
 //     json_cmd     : json string with command to be sent to the MAL manager
@@ -38,46 +684,167 @@ static pthread_mutex_t mal_mutex = PTHREAD_MUTEX_INITIALIZER;
         
 int Mal::send_mal_command(char *json_cmd, char *json_resp, int len_json_resp, uint8_t wait_resp) 
 {
-    int client_socket;
-    socklen_t addr_length;
-    struct sockaddr_un addr;
+    mal_copy c = { json_resp, len_json_resp, MAL_ERR_BUSY };
 
-    while( pthread_mutex_trylock(&mal_mutex) ) 
-        pthread_yield();
+    wait_for(this, json_cmd, wait_resp, MAL_DEF_TIMEOUT_MS, copy_reply, &c);
+    return c.result;
+}
 
-    strcpy(addr.sun_path, JSON_SOCKET_ADDR);    // max 108 bytes
-    addr.sun_family = AF_UNIX;
-    addr_length = SUN_LEN(&addr);
+//------------------------------------------------------------------
+// replies
+//
 
-    if ((client_socket=socket(AF_UNIX, SOCK_STREAM, 0)) < 0)  {
-        pthread_mutex_unlock(&mal_mutex);
-        return -1;
+//FNV-1a
+uint32_t MalReply::key_hash(const char *s, int len)
+{
+    uint32_t h = 2166136261u;
+
+    while( len-- > 0 )
+        h = (h ^ (uint8_t)*s++) * 16777619u;
+    return h;
+}
+
+int MalReply::skip(int t) const
+{
+    int n = tok[t].size;
+
+    for( t++; n-- > 0 && t < ntok; )
+        t = skip(t);
+    return t;
+}
+
+MalReply::MalReply(const char *json, int len, const jsmntok_t *t, int n) :
+    js(json), js_len(len), tok(t), ntok(n), members(0)
+{
+    int k = 1;
+
+    if( ntok < 1 || tok[0].type != JSMN_OBJECT )
+        return;
+    for( int m=0; m<tok[0].size && members<MAL_INDEX && k+1<ntok; m++ ) {
+        hash[members]  = key_hash(js+tok[k].start, tok[k].end-tok[k].start);
+        value[members] = k+1;
+        members++;
+        k = skip(k);                       //the key's value is its only child
+        }
+}
+
+int MalReply::find(const char *key) const
+{
+    int      len = strlen(key);
+    uint32_t h = key_hash(key, len);
+
+    for( int m=0; m<members; m++ ) {
+        const jsmntok_t *k = &tok[value[m]-1];
+        if( hash[m] == h && k->end-k->start == len && !memcmp(js+k->start, key, len) )
+            return value[m];
         }
+    return -1;
+}
+
+bool MalReply::str(int t, mal_str *s) const
+{
+    if( t < 0 )
+        return false;
+    s->p   = js + tok[t].start;
+    s->len = tok[t].end - tok[t].start;
+    return true;
+}
+
+//the value is followed by a delimiter or its closing quote, so it can be converted where it is
+bool MalReply::integer(int t, int *v) const
+{
+    char *end;
 
-    if (connect(client_socket, (struct sockaddr*) &addr, addr_length) < 0) {
-        close(client_socket);
-        pthread_mutex_unlock(&mal_mutex);
-        return -2;
+    if( t < 0 || tok[t].end == tok[t].start )
+        return false;
+    *v = (int)strtol(js+tok[t].start, &end, 0);
+    return end != js+tok[t].start;
+}
+
+bool MalReply::number(int t, double *v) const
+{
+    char *end;
+
+    if( t < 0 || tok[t].end == tok[t].start )
+        return false;
+    *v = strtod(js+tok[t].start, &end);
+    return end != js+tok[t].start;
+}
+
+bool MalReply::copy(int t, char *dst, size_t n) const
+{
+    mal_str s;
+
+    if( n == 0 || !str(t, &s) )
+        return false;
+    if( (size_t)s.len >= n )
+        s.len = n-1;
+    memcpy(dst, s.p, s.len);
+    dst[s.len] = '\0';
+    return true;
+}
+
+bool MalStatus::decode(int result, const MalReply *r)
+{
+    msg.p   = "";
+    msg.len = 0;
+    if( (err=result) != MAL_OK || r == NULL ) {
+        err = (err == MAL_OK)? MAL_ERR_PARSE : err;
+        return false;
         }
-    if (write(client_socket, json_cmd, strlen(json_cmd)) < 0) {
-        close(client_socket);
-        pthread_mutex_unlock(&mal_mutex);
-        return -3;
+    if( !r->integer(r->field("errno", 0), &err) )
+        err = MAL_ERR_PARSE;
+    r->str(r->field("errmsg", 1), &msg);
+    return err == 0;
+}
+
+bool GpsFix::decode(int result, const MalReply *r)
+{
+    double la, lo;
+
+    if( !MalStatus::decode(result, r) || !r->number(r->find("latitude"), &la) || !r->number(r->find("longitude"), &lo) )
+        return false;
+    lat = (float)la;
+    lng = (float)lo;
+    return true;
+}
+
+bool WwanStatus::decode_ip(int result, const MalReply *r)
+{
+    return MalStatus::decode(result, r) && r->str(r->field("ip", 2), &ip);
+}
+
+bool WwanStatus::decode_mode(int result, const MalReply *r)
+{
+    return MalStatus::decode(result, r) && r->integer(r->field("operating_mode", 2), &mode);
+}
+
+bool WwanStatus::decode_serving(int result, const MalReply *r)
+{
+    //the name of this one isn't known, it has always been the sixth member
+    return MalStatus::decode(result, r) && r->integer(r->member(5), &service);
+}
+
+bool DeviceIds::decode_imei(int result, const MalReply *r)
+{
+    if( !MalStatus::decode(result, r) )
+        return false;
+    if( !r->copy(r->field("imei", 2), imei, sizeof(imei)) ) {
+        err = MAL_ERR_PARSE;
+        return false;
         }
-        
-    if (wait_resp) {
-        char tresp[1024];                       
-        int bytes_read = read(client_socket, tresp, sizeof(tresp)-1);
-        if (bytes_read <= 0 || bytes_read > len_json_resp) {
-            close(client_socket);
-            pthread_mutex_unlock(&mal_mutex);
-            return -4;
-            }
-        memcpy(json_resp, tresp, (len_json_resp>bytes_read)? bytes_read:len_json_resp);
+    return true;
+}
+
+bool DeviceIds::decode_iccid(int result, const MalReply *r)
+{
+    if( !MalStatus::decode(result, r) )
+        return false;
+    if( !r->copy(r->field("iccid", 2), iccid, sizeof(iccid)) ) {
+        err = MAL_ERR_PARSE;
+        return false;
         }
-    close(client_socket);
-    pthread_mutex_unlock(&mal_mutex);
-    return 0;
+    return true;
 }
 
 #define VALUE   0
@@ -7,6 +7,15 @@
 *   @file   mal.hpp
 *   @brief  class definition for the modem abstraction layer (mal).
 *
+*           Commands run on a single I/O thread, up to MAL_MAX_INFLIGHT at once over kept connections, and
+*           fail with MAL_ERR_TIMEOUT when their time is up.  send_mal_command() is the blocking form.
+*
+*           Replies are read into a buffer that grows up to MAL_RESP_MAX until jsmn sees the top-level
+*           object close.
+*
+*           MalReply indexes the reply's members by key for the typed decoders.  A few get_ replies are
+*           cached and shared by requests for the same action (cached_actions in mal.cpp).
+*
 *   @author James Flynn
 *
 *   @date   1-Oct-2018
@@ -16,10 +25,13 @@
 #ifndef __MAL_HPP__
 #define __MAL_HPP__
 
+#include <pthread.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/un.h>
 #include <sys/socket.h>
+#include <atomic>
 #include <thread>
 
 #ifndef __HWLIB__
@@ -28,6 +40,121 @@ extern "C" {
 }
 #endif
 
+#include "jsmn.h"
+#include "reactor.hpp"
+#include "mpsc.hpp"
+
+#define MAL_POOL          3       //idle connections kept open
+#define MAL_REUSE_FAILS   3       //kept connections found closed in a row before giving up on reuse
+#define MAL_MAX_INFLIGHT  3       //commands out at once, one connection each
+#define MAL_QUEUE_LEN     16      //submitted, not yet picked up by the I/O thread
+#define MAL_RESP_INIT     512     //reply buffer, doubled as needed...
+#define MAL_RESP_MAX      16384   //...up to this
+#define MAL_TOKENS        256     //jsmn tokens of a reply
+#define MAL_TICK_MS       100     //timeouts are checked this often
+#define MAL_DEF_TIMEOUT_MS 10000
+#define MAL_INDEX         32      //members of a reply's top-level object that can be looked up
+#define MAL_CACHE_ACTIONS 5       //actions whose replies are kept, see cached_actions in mal.cpp
+#define MAL_TTL_FOREVER   -1
+
+//results passed to the callbacks and returned by send_mal_command()
+#define MAL_OK             0
+#define MAL_ERR_SOCKET    -1
+#define MAL_ERR_CONNECT   -2
+#define MAL_ERR_WRITE     -3
+#define MAL_ERR_READ      -4      //the connection closed before the reply was complete, or it doesn't fit
+#define MAL_ERR_TIMEOUT   -5
+#define MAL_ERR_BUSY      -6      //the submission queue is full
+#define MAL_ERR_PARSE     -7      //the reply isn't a JSON object
+
+//a string in a reply, not NUL terminated and only valid until the callback returns
+typedef struct _mal_str {
+    const char *p;
+    int         len;
+    } mal_str;
+
+class MalReply {
+    private:
+        const char      *js;
+        int              js_len;
+        const jsmntok_t *tok;
+        int              ntok;
+        int              members;
+        uint32_t         hash[MAL_INDEX];    //of each member's key...
+        int              value[MAL_INDEX];   //...and the token of its value, in the order they came
+
+        static uint32_t key_hash(const char *s, int len);
+        int             skip(int t) const;   //the token after 't' and everything in it
+
+    public:
+        MalReply(const char *json, int len, const jsmntok_t *t, int n);
+
+        const char *json(void) const   { return js; }
+        int         length(void) const { return js_len; }
+        int         size(void) const   { return members; }
+
+        //the token of a member's value, -1 if there is none: by key, by position, by key or else position
+        int         find(const char *key) const;
+        int         member(int n) const { return (n >= 0 && n < members)? value[n] : -1; }
+        int         field(const char *key, int n) const { int t = find(key); return (t >= 0)? t : member(n); }
+
+        //false if 't' is -1
+        bool        str(int t, mal_str *s) const;
+        bool        integer(int t, int *v) const;
+        bool        number(int t, double *v) const;
+        bool        copy(int t, char *dst, size_t n) const;      //NUL terminated, truncated to fit
+};
+
+//every reply starts with the MAL's errno and errmsg; err is that errno, or the MAL_ERR_ the request failed with
+struct MalStatus {
+    int     err;
+    mal_str msg;
+
+    bool decode(int result, const MalReply *r);
+};
+
+struct GpsFix : MalStatus {            //get_loc_position_info
+    float   lat, lng;
+
+    bool decode(int result, const MalReply *r);
+};
+
+struct WwanStatus : MalStatus {
+    mal_str ip;                        //get_wwan_ipv4_network_ip, "0.0.0.0" without a data connection
+    int     mode;                      //get_operating_mode, 0 = on-line
+    int     service;                   //get_wwan_serving_system_status, non-zero with a serving system
+
+    bool decode_ip(int result, const MalReply *r);
+    bool decode_mode(int result, const MalReply *r);
+    bool decode_serving(int result, const MalReply *r);
+};
+
+struct DeviceIds : MalStatus {
+    char    imei[20];                  //get_system_imei
+    char    iccid[24];                 //get_system_iccid
+
+    bool decode_imei(int result, const MalReply *r);
+    bool decode_iccid(int result, const MalReply *r);
+};
+
+//run on the MAL I/O thread: keep it short, never call send_mal_command() or call() from it (submit() is fine).
+//'reply' is NULL unless result is MAL_OK and a reply was asked for.
+typedef void (*mal_cb)(int result, const MalReply *reply, void *ctx);
+
+typedef struct _mal_stats {
+    uint32_t commands;
+    uint32_t failed;
+    uint32_t timeouts;
+    uint32_t connects;
+    uint32_t reused;            //commands sent on a kept connection
+    uint32_t syscalls;          //socket, connect, poll, write, read and close
+    double   sum_ms;            //submit to reply
+    double   max_ms;
+    uint32_t max_reply;         //bytes
+    uint32_t cached;            //answered from the cache...
+    uint32_t coalesced;         //...or by a request for the same action that was already out
+    } mal_stats;
+
 typedef struct _json_keyval {
     char key[50];
     char value[50];
@@ -35,15 +162,91 @@ typedef struct _json_keyval {
 
 class Mal {
     private:
+        typedef struct mal_req_t {
+            char              *cmd;
+            size_t             len;
+            bool               wait_resp;
+            mal_cb             cb;
+            void              *ctx;
+            int                fd;
+            bool               reused;
+            int                tries;
+            struct timespec    submitted;      //CLOCK_MONOTONIC
+            struct timespec    deadline;
+            char              *resp;           //NUL terminated, grows as the reply comes in
+            int                resp_len;
+            int                resp_cap;
+            jsmn_parser        parser;         //fed each read, resumes where it left off
+            jsmntok_t          tok[MAL_TOKENS];
+            int                action;         //its entry in the cache, -1 if it isn't cached
+            bool               changes;        //not a get_, what is cached may no longer hold
+            struct mal_req_t  *followers;      //asked for the same action while this one was out
+            struct mal_req_t  *next;           //waiting to be started, or the next follower
+            } mal_req;
+
+        typedef struct mal_cache_t {
+            char              *resp;           //the last good reply, NULL if there is none
+            int                resp_len;
+            jsmntok_t         *tok;
+            int                ntok;
+            struct timespec    stored;         //CLOCK_MONOTONIC
+            mal_req           *leader;         //out for this action, NULL if none
+            } mal_cache;
+
         static Mal* mal_ptr;
         static bool mal_started;
         int start_mal(bool);
-        Mal() {;}
+        Mal() : waiting(NULL), waiting_tail(NULL), idle_count(0), persist(true), reuse_fails(0), cache_on(true),
+                io_syscalls(0), io_connects(0) {
+            memset(&stats, 0x00, sizeof(stats));
+            memset(active, 0x00, sizeof(active));
+            memset(cache, 0x00, sizeof(cache));
+            }
+
+        //everything below is the I/O thread's, except persist, cache_on, stats (under stats_mutex) and submitted
+        Reactor     io;
+        pthread_t   io_thread;
+        MpscQueue<mal_req*, MAL_QUEUE_LEN> submitted;
+        mal_req    *active[MAL_MAX_INFLIGHT];
+        mal_req    *waiting, *waiting_tail;
+
+        int         idle[MAL_POOL];
+        int         idle_count;
+        std::atomic<bool> persist;    //connections are kept for reuse
+        int         reuse_fails;
+        mal_cache   cache[MAL_CACHE_ACTIONS];
+        std::atomic<bool> cache_on;
+        mal_stats   stats;
+        uint32_t    io_syscalls, io_connects;  //counted without the lock, added to stats as each command is done
+
+        bool start_io(void);
+        static void *io_task(void *obj);
+        static void  on_readable(int fd, uint32_t events, void *ctx);
+        static void  on_tick(int fd, uint32_t events, void *ctx);
+        void dispatch(void);
+        void start(mal_req *r);
+        void finish(mal_req *r, int result);
+        void fail(mal_req *r, int result);
+        void done(mal_req *r, int result, const MalReply *reply, uint32_t *counter);
+        static void release(mal_req *r);
+        bool answer(mal_req *r);
+        void store(mal_cache *e, const mal_req *r);
+        void drop_cache(bool all);
+        void expire(mal_req *leader, const struct timespec *now);
+        static bool grow(mal_req *r);
+        static int  feed(mal_req *r);
+
+        int  open_conn(void);
+        void close_conn(int fd);
+        bool conn_alive(int fd);
+        int  get_conn(bool *reused);
+        void put_conn(int fd, bool ok);
 
     public:
         static Mal* get_mal( void ) {
             if( !mal_ptr ) {
                 mal_ptr = (Mal*)new Mal;
+                mal_ptr->start_io();
                 mal_ptr->start_mal(false);
                 mal_ptr->mal_started = true;
                 }
@@ -51,8 +254,23 @@ class Mal {
              }
 
         bool  mal_running(void);
+        //queues the command, 'cb' gets the reply (or the error) within timeout_ms; false if it couldn't be
+        //queued, the callback isn't called then
+        bool  submit(const char *json_cmd, bool wait_resp, int timeout_ms, mal_cb cb, void *ctx);
+        //runs 'cb' on the reply and returns once it has, the result is passed to 'cb' and returned
+        int   call(const char *json_cmd, mal_cb cb, void *ctx, int timeout_ms=MAL_DEF_TIMEOUT_MS);
+        //waits for the reply, <0 (MAL_ERR_...) if an error occurs, otherwise 0
         int   send_mal_command(char *json_cmd, char *json_resp, int len_json_resp, uint8_t wait_resp);
         int   parse_maljson(char *jstr, json_keyval rslts[], int s);
+
+        //keeping connections can be turned off (and back on) to compare the two
+        void  set_persistent(bool on) { persist = on; }
+        bool  persistent(void) { return persist; }
+        //so is the cache, turning it off drops what is kept
+        void  set_caching(bool on) { cache_on = on; }
+        bool  caching(void) { return cache_on; }
+        void  get_stats(mal_stats *s);
+        void  clear_stats(void);
 };
 
 #endif // __MAL_HPP__
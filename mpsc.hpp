@@ -0,0 +1,83 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   mpsc.hpp
+*   @brief  A bounded lock-free queue for any number of producer threads and one consumer thread.  Each cell
+*           carries a sequence number: a producer claims a cell by advancing the tail with a CAS, fills it and
+*           then publishes it by bumping the cell's sequence; the consumer only takes a cell once it has been
+*           published, so a producer that is part way through writing never exposes a torn entry.  push() and
+*           pop() never block, push() returns false when the queue is full and the caller decides what to do
+*           with the item (store it, drop it, answer with an error).
+*
+*           N must be a power of two.  T is copied in and out, keep it small (pointers and lengths).
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#ifndef __MPSC_HPP__
+#define __MPSC_HPP__
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, unsigned N>
+class MpscQueue {
+    static_assert(N >= 2 && (N & (N-1)) == 0, "MpscQueue size must be a power of two");
+
+    private:
+        typedef struct cell_t {
+            std::atomic<uint32_t> seq;        //== position when free, position+1 once published
+            T                     item;
+            } cell;
+
+        cell                  cells[N];
+        std::atomic<uint32_t> tail;           //next position a producer claims
+        uint32_t              head;           //next position the consumer takes, consumer only
+
+    public:
+        MpscQueue() : tail(0), head(0) {
+            for( uint32_t i=0; i<N; i++ )
+                cells[i].seq.store(i, std::memory_order_relaxed);
+            }
+
+        //any thread, false if the queue is full
+        bool push(const T& v) {
+            uint32_t pos = tail.load(std::memory_order_relaxed);
+            cell    *c;
+
+            for( ;; ) {
+                c = &cells[pos & (N-1)];
+                int32_t dif = (int32_t)(c->seq.load(std::memory_order_acquire) - pos);
+                if( dif == 0 ) {
+                    if( tail.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed) )
+                        break;
+                    }
+                else if( dif < 0 )
+                    return false;
+                else
+                    pos = tail.load(std::memory_order_relaxed);
+                }
+            c->item = v;
+            c->seq.store(pos+1, std::memory_order_release);
+            return true;
+            }
+
+        //consumer thread only, false if nothing has been published
+        bool pop(T& v) {
+            cell *c = &cells[head & (N-1)];
+
+            if( c->seq.load(std::memory_order_acquire) != head+1 )
+                return false;
+            v = c->item;
+            c->seq.store(head+N, std::memory_order_release);
+            head++;
+            return true;
+            }
+};
+
+#endif // __MPSC_HPP__
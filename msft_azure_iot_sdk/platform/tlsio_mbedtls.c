@@ -0,0 +1,1264 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Copyright (c) 2018, James Flynn
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+//
+// tlsio adapter for mbedtls that owns its TCP socket.  The SDK's adapter layers TLS on top of socketio and
+// the application has no way to see the socket, so the only way to service the connection is to call
+// IoTHubClient_LL_DoWork() in a loop.  This one hands the socket to the application (tlsio_socket.h),
+// telling it whether to wait for it to be readable or writable, so it can sleep in epoll until there is
+// something to do.
+//
+// The socket is non-blocking from the start.  open only resolves the host (getaddrinfo still blocks) and
+// starts the connect; dowork, run when the socket is ready, finishes the connect and then steps the
+// handshake each time mbedtls can make progress.  The open fails if both take more than TLSIO_OPEN_TIMEOUT_MS,
+// which dowork checks, so the application has to run it at least once a second or so while connecting.
+// Once open, dowork reads until mbedtls wants more data, so nothing is ever left buffered inside mbedtls
+// when the application goes back to waiting on the socket.
+//
+// The options socketio_berkeley took are applied to the socket here (TCP keep-alive); the client certificate
+// and key options are handled by mbedtls.  An interface to bind to (net_interface_mac_address) is not
+// supported and is refused, like any option that isn't recognised.
+//
+// The session (ID and, when the server issues one, ticket) from the last handshake with each host is kept
+// after the tlsio is destroyed.  The application destroys the IoT Hub client when it enters Low Power Mode,
+// offering the saved session on the next connect lets the server resume it with an abbreviated handshake
+// instead of sending its certificate chain and doing a new key exchange.
+//
+// The trusted certificates are parsed once into a shared chain that every tlsio given the same TrustedCerts
+// uses.  It is kept when the last tlsio is destroyed so a reconnect doesn't parse the PEM again, and only a
+// tlsio given different certificates while the shared chain is in use parses its own copy.
+//
+// The wire bytes are also counted by class (telemetry, keep-alive, handshake...).  What is sent is classified
+// before it is encrypted, so its records are counted against that class as they are written; what is read is
+// held as pending until mbedtls hands over the plaintext it decrypted to and can be classified.
+//
+// The IoT Hub client and a blob upload each have their own tlsio and may run on different threads, so the
+// session cache, the shared trust chain and all the counters are only touched with tlsio_lock held.  The
+// socket callback is set per tlsio (TLSIO_OPTION_SOCKET_WATCH), a tlsio without one is never reported.
+//
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "mbedtls/config.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/error.h"
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/tlsio.h"
+#include "azure_c_shared_utility/xio.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/optionhandler.h"
+#include "azure_c_shared_utility/shared_util_options.h"
+
+#include "tlsio_socket.h"
+
+#define TLSIO_OPEN_TIMEOUT_MS       30000   // connect and handshake
+#define TLSIO_SEND_TIMEOUT_MS       10000
+#define TLSIO_READ_CHUNK            1024
+#define TLSIO_SESSION_CACHE         2       // hosts whose last session is kept for resumption
+
+// the names socketio_berkeley gave its options, older c-utility versions don't define all of them
+#ifndef OPTION_X509_ECC_CERT
+#define OPTION_X509_ECC_CERT        "x509EccCertificate"
+#endif
+#ifndef OPTION_X509_ECC_KEY
+#define OPTION_X509_ECC_KEY         "x509EccAliasKey"
+#endif
+#ifndef OPTION_NET_INT_MAC_ADDRESS
+#define OPTION_NET_INT_MAC_ADDRESS  "net_interface_mac_address"
+#endif
+#define OPTION_TCP_KEEPALIVE        "tcp_keepalive"
+#define OPTION_TCP_KEEPALIVE_TIME   "tcp_keepalive_time"
+#define OPTION_TCP_KEEPALIVE_INTVL  "tcp_keepalive_interval"
+#define OPTION_TCP_KEEPALIVE_PROBES "tcp_keepalive_probes"
+
+typedef enum TLSIO_STATE_TAG
+{
+    TLSIO_STATE_NOT_OPEN,
+    TLSIO_STATE_CONNECTING,
+    TLSIO_STATE_HANDSHAKE,
+    TLSIO_STATE_OPEN,
+    TLSIO_STATE_ERROR
+} TLSIO_STATE;
+
+typedef struct TLS_IO_INSTANCE_TAG
+{
+    char*                    hostname;
+    int                      port;
+    char*                    trusted_certs;     // trust_pem when shared_trust is set
+    int                      shared_trust;
+    TLSIO_STATE              state;
+    TLSIO_SOCKET_WATCH       watch;
+    int                      events;            // TLSIO_WANT_ flags last given to the socket callback
+
+    ON_IO_OPEN_COMPLETE      on_io_open_complete;
+    void*                    on_io_open_complete_context;
+    ON_BYTES_RECEIVED        on_bytes_received;
+    void*                    on_bytes_received_context;
+    ON_IO_ERROR              on_io_error;
+    void*                    on_io_error_context;
+
+    mbedtls_net_context      net;
+    mbedtls_ssl_context      ssl;
+    mbedtls_ssl_config       config;
+    mbedtls_x509_crt         trusted_chain;     // only used when the certificates aren't shared
+    mbedtls_entropy_context  entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+
+    char*                    x509_cert;         // client certificate and key, PEM
+    char*                    x509_key;
+    mbedtls_x509_crt         own_cert;
+    mbedtls_pk_context       own_key;
+    int                      keepalive;         // the tcp_keepalive options, -1 when not set
+    int                      keepalive_time;
+    int                      keepalive_interval;
+    int                      keepalive_probes;
+
+    struct addrinfo*         addrs;             // while connecting
+    struct addrinfo*         next_addr;         // tried if the connect under way fails
+    struct timespec          open_start;
+    struct timespec          handshake_start;
+    uint64_t                 handshake_bytes;   // wire bytes when the handshake started
+    int                      offered;           // a saved session was offered...
+    unsigned char            offered_master[48];// ...with this master secret
+
+    TLSIO_FLOW               flow;
+    int                      wire_class;        // what is being written
+    uint64_t                 rx_pending;        // read but not classified yet
+} TLS_IO_INSTANCE;
+
+typedef struct TLSIO_SESSION_TAG
+{
+    char*                    hostname;      // NULL when the entry is free
+    int                      port;
+    mbedtls_ssl_session      session;
+} TLSIO_SESSION;
+
+static pthread_mutex_t       tlsio_lock = PTHREAD_MUTEX_INITIALIZER;    // for everything below
+
+static TLSIO_SESSION         session_cache[TLSIO_SESSION_CACHE];
+static int                   session_next;  // entry replaced when the cache is full
+static TLSIO_HANDSHAKE_STATS handshake_stats;
+
+static char*                 trust_pem;         // the text the shared chain was parsed from
+static mbedtls_x509_crt      trust_chain;
+static int                   trust_users;       // tlsio instances using the shared chain
+
+static uint64_t              wire_tx_bytes;
+static uint64_t              wire_rx_bytes;
+static uint64_t              class_tx_bytes[TLSIO_CLASSES];
+static uint64_t              class_rx_bytes[TLSIO_CLASSES];
+static TLSIO_CLASSIFY_CALLBACK classify_callback;
+static void*                 classify_callback_context;
+
+void tlsio_mbedtls_get_wire_bytes(uint64_t* tx_bytes, uint64_t* rx_bytes)
+{
+    (void)pthread_mutex_lock(&tlsio_lock);
+    *tx_bytes = wire_tx_bytes;
+    *rx_bytes = wire_rx_bytes;
+    (void)pthread_mutex_unlock(&tlsio_lock);
+}
+
+void tlsio_mbedtls_reset_wire_bytes(void)
+{
+    (void)pthread_mutex_lock(&tlsio_lock);
+    wire_tx_bytes = wire_rx_bytes = 0;
+    memset(class_tx_bytes, 0x00, sizeof(class_tx_bytes));
+    memset(class_rx_bytes, 0x00, sizeof(class_rx_bytes));
+    (void)pthread_mutex_unlock(&tlsio_lock);
+}
+
+void tlsio_mbedtls_set_classify_callback(TLSIO_CLASSIFY_CALLBACK callback, void* context)
+{
+    classify_callback = callback;
+    classify_callback_context = context;
+}
+
+void tlsio_mbedtls_get_class_bytes(uint64_t tx_bytes[TLSIO_CLASSES], uint64_t rx_bytes[TLSIO_CLASSES])
+{
+    (void)pthread_mutex_lock(&tlsio_lock);
+    memcpy(tx_bytes, class_tx_bytes, sizeof(class_tx_bytes));
+    memcpy(rx_bytes, class_rx_bytes, sizeof(class_rx_bytes));
+    (void)pthread_mutex_unlock(&tlsio_lock);
+}
+
+static int classify(TLS_IO_INSTANCE* tls_io_instance, int tx, const unsigned char* buf, size_t len)
+{
+    int cls = TLSIO_CLASS_OTHER;
+    if (classify_callback != NULL)
+    {
+        cls = classify_callback(&tls_io_instance->flow, tx, buf, len, classify_callback_context);
+        if (cls < 0 || cls >= TLSIO_CLASSES)
+        {
+            cls = TLSIO_CLASS_OTHER;
+        }
+    }
+    return cls;
+}
+
+// charges what was read since the last call to 'cls'
+static void settle_rx(TLS_IO_INSTANCE* tls_io_instance, int cls)
+{
+    (void)pthread_mutex_lock(&tlsio_lock);
+    class_rx_bytes[cls] += tls_io_instance->rx_pending;
+    (void)pthread_mutex_unlock(&tlsio_lock);
+    tls_io_instance->rx_pending = 0;
+}
+
+// the bio callbacks count what actually goes over the socket: records, handshake and alerts included
+static int wire_send(void* ctx, const unsigned char* buf, size_t len)
+{
+    TLS_IO_INSTANCE* tls_io_instance = (TLS_IO_INSTANCE*)ctx;
+    int ret = mbedtls_net_send(&tls_io_instance->net, buf, len);
+    if (ret > 0)
+    {
+        (void)pthread_mutex_lock(&tlsio_lock);
+        wire_tx_bytes += ret;
+        class_tx_bytes[tls_io_instance->wire_class] += ret;
+        (void)pthread_mutex_unlock(&tlsio_lock);
+    }
+    return ret;
+}
+
+static int wire_recv(void* ctx, unsigned char* buf, size_t len)
+{
+    TLS_IO_INSTANCE* tls_io_instance = (TLS_IO_INSTANCE*)ctx;
+    int ret = mbedtls_net_recv(&tls_io_instance->net, buf, len);
+    if (ret > 0)
+    {
+        (void)pthread_mutex_lock(&tlsio_lock);
+        wire_rx_bytes += ret;
+        (void)pthread_mutex_unlock(&tlsio_lock);
+        tls_io_instance->rx_pending += ret;
+    }
+    return ret;
+}
+
+void tlsio_mbedtls_get_handshake_stats(TLSIO_HANDSHAKE_STATS* stats)
+{
+    (void)pthread_mutex_lock(&tlsio_lock);
+    *stats = handshake_stats;
+    (void)pthread_mutex_unlock(&tlsio_lock);
+}
+
+// the session cache functions are called with tlsio_lock held
+static TLSIO_SESSION* find_session(const char* hostname, int port)
+{
+    int i;
+    for (i = 0; i < TLSIO_SESSION_CACHE; i++)
+    {
+        if (session_cache[i].hostname != NULL && session_cache[i].port == port && strcmp(session_cache[i].hostname, hostname) == 0)
+        {
+            return &session_cache[i];
+        }
+    }
+    return NULL;
+}
+
+static void forget_session(TLSIO_SESSION* cached)
+{
+    if (cached != NULL && cached->hostname != NULL)
+    {
+        mbedtls_ssl_session_free(&cached->session);
+        free(cached->hostname);
+        cached->hostname = NULL;
+    }
+}
+
+void tlsio_mbedtls_forget_sessions(void)
+{
+    int i;
+    (void)pthread_mutex_lock(&tlsio_lock);
+    for (i = 0; i < TLSIO_SESSION_CACHE; i++)
+    {
+        forget_session(&session_cache[i]);
+    }
+    (void)pthread_mutex_unlock(&tlsio_lock);
+}
+
+// keeps the session just negotiated so the next connection to the same host can resume it
+static void save_session(TLS_IO_INSTANCE* tls_io_instance)
+{
+    TLSIO_SESSION* cached = find_session(tls_io_instance->hostname, tls_io_instance->port);
+
+    if (cached == NULL)
+    {
+        int i;
+        for (i = 0; i < TLSIO_SESSION_CACHE && session_cache[i].hostname != NULL; i++)
+            ;
+        if (i == TLSIO_SESSION_CACHE)
+        {
+            i = session_next;
+            session_next = (session_next + 1) % TLSIO_SESSION_CACHE;
+            forget_session(&session_cache[i]);
+        }
+        cached = &session_cache[i];
+        if (mallocAndStrcpy_s(&cached->hostname, tls_io_instance->hostname) != 0)
+        {
+            cached->hostname = NULL;
+            return;
+        }
+        cached->port = tls_io_instance->port;
+    }
+    else
+    {
+        mbedtls_ssl_session_free(&cached->session);
+    }
+
+    mbedtls_ssl_session_init(&cached->session);
+    if (mbedtls_ssl_get_session(&tls_io_instance->ssl, &cached->session) != 0)
+    {
+        forget_session(cached);
+    }
+}
+
+static uint32_t elapsed_ms(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000);
+}
+
+static void log_mbedtls_error(const char* what, int err)
+{
+    char text[96];
+    mbedtls_strerror(err, text, sizeof(text));
+    LogError("%s failed: -0x%04x %s", what, -err, text);
+}
+
+static void indicate_error(TLS_IO_INSTANCE* tls_io_instance)
+{
+    tls_io_instance->state = TLSIO_STATE_ERROR;
+    if (tls_io_instance->on_io_error != NULL)
+    {
+        tls_io_instance->on_io_error(tls_io_instance->on_io_error_context);
+    }
+}
+
+// tells the application what to wait for on the socket, when that changes
+static void want(TLS_IO_INSTANCE* tls_io_instance, int events)
+{
+    if (tls_io_instance->events != events)
+    {
+        tls_io_instance->events = events;
+        if (tls_io_instance->watch.callback != NULL)
+        {
+            tls_io_instance->watch.callback(tls_io_instance->net.fd, events, tls_io_instance->watch.context);
+        }
+    }
+}
+
+static void drop_socket(TLS_IO_INSTANCE* tls_io_instance)
+{
+    if (tls_io_instance->net.fd >= 0)
+    {
+        want(tls_io_instance, 0);
+        mbedtls_net_free(&tls_io_instance->net);
+    }
+}
+
+static void close_connection(TLS_IO_INSTANCE* tls_io_instance)
+{
+    if (tls_io_instance->net.fd >= 0 && tls_io_instance->state == TLSIO_STATE_OPEN)
+    {
+        (void)mbedtls_ssl_close_notify(&tls_io_instance->ssl);
+    }
+    drop_socket(tls_io_instance);
+    if (tls_io_instance->addrs != NULL)
+    {
+        freeaddrinfo(tls_io_instance->addrs);
+        tls_io_instance->addrs = tls_io_instance->next_addr = NULL;
+    }
+    tls_io_instance->wire_class = TLSIO_CLASS_OTHER;
+    settle_rx(tls_io_instance, TLSIO_CLASS_OTHER);
+    mbedtls_ssl_session_reset(&tls_io_instance->ssl);
+    tls_io_instance->state = TLSIO_STATE_NOT_OPEN;
+}
+
+// (re)parses the shared chain, unless it already holds 'certs'; it can only be replaced while it is unused.
+// Called with tlsio_lock held.
+static int load_trust_store(const char* certs)
+{
+    int result;
+    char* copy;
+
+    if (trust_pem != NULL && strcmp(trust_pem, certs) == 0)
+    {
+        result = 0;
+    }
+    else if (trust_users != 0)
+    {
+        result = __FAILURE__;
+    }
+    else if (mallocAndStrcpy_s(&copy, certs) != 0)
+    {
+        LogError("unable to copy TrustedCerts");
+        result = __FAILURE__;
+    }
+    else
+    {
+        int err;
+
+        free(trust_pem);
+        trust_pem = NULL;
+        mbedtls_x509_crt_free(&trust_chain);
+        mbedtls_x509_crt_init(&trust_chain);
+        handshake_stats.trust_store_parses++;
+        err = mbedtls_x509_crt_parse(&trust_chain, (const unsigned char*)copy, strlen(copy) + 1);
+        if (err < 0)
+        {
+            log_mbedtls_error("mbedtls_x509_crt_parse", err);
+            mbedtls_x509_crt_free(&trust_chain);
+            free(copy);
+            result = __FAILURE__;
+        }
+        else
+        {
+            trust_pem = copy;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static void release_trusted_certs(TLS_IO_INSTANCE* tls_io_instance)
+{
+    if (tls_io_instance->shared_trust)
+    {
+        (void)pthread_mutex_lock(&tlsio_lock);
+        trust_users--;
+        (void)pthread_mutex_unlock(&tlsio_lock);
+    }
+    else
+    {
+        free(tls_io_instance->trusted_certs);
+        mbedtls_x509_crt_free(&tls_io_instance->trusted_chain);
+        mbedtls_x509_crt_init(&tls_io_instance->trusted_chain);
+    }
+    tls_io_instance->trusted_certs = NULL;
+    tls_io_instance->shared_trust = 0;
+}
+
+// a tlsio given certificates other than the shared chain's while that is in use parses its own copy
+static int load_own_trust(TLS_IO_INSTANCE* tls_io_instance, const char* certs)
+{
+    int result;
+
+    if (mallocAndStrcpy_s(&tls_io_instance->trusted_certs, certs) != 0)
+    {
+        LogError("unable to copy TrustedCerts");
+        tls_io_instance->trusted_certs = NULL;
+        result = __FAILURE__;
+    }
+    else
+    {
+        int err = mbedtls_x509_crt_parse(&tls_io_instance->trusted_chain, (const unsigned char*)tls_io_instance->trusted_certs, strlen(certs) + 1);
+        (void)pthread_mutex_lock(&tlsio_lock);
+        handshake_stats.trust_store_parses++;
+        (void)pthread_mutex_unlock(&tlsio_lock);
+        if (err < 0)
+        {
+            log_mbedtls_error("mbedtls_x509_crt_parse", err);
+            result = __FAILURE__;
+        }
+        else
+        {
+            mbedtls_ssl_conf_ca_chain(&tls_io_instance->config, &tls_io_instance->trusted_chain, NULL);
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static int set_trusted_certs(TLS_IO_INSTANCE* tls_io_instance, const char* certs)
+{
+    int result;
+
+    if (certs == NULL)
+    {
+        LogError("invalid parameter: TrustedCerts is NULL");
+        result = __FAILURE__;
+    }
+    else
+    {
+        int shared;
+
+        release_trusted_certs(tls_io_instance);
+        (void)pthread_mutex_lock(&tlsio_lock);
+        shared = (trust_users == 0 || (trust_pem != NULL && strcmp(trust_pem, certs) == 0));
+        if (shared && (result = load_trust_store(certs)) == 0)
+        {
+            trust_users++;
+            tls_io_instance->shared_trust = 1;
+            tls_io_instance->trusted_certs = trust_pem;
+            mbedtls_ssl_conf_ca_chain(&tls_io_instance->config, &trust_chain, NULL);
+        }
+        (void)pthread_mutex_unlock(&tlsio_lock);
+
+        if (!shared)
+        {
+            result = load_own_trust(tls_io_instance, certs);
+        }
+    }
+    return result;
+}
+
+// keeps the client certificate or key, once both are set they are parsed and given to mbedtls
+static int set_client_cert(TLS_IO_INSTANCE* tls_io_instance, const char* name, const char* pem, int is_key)
+{
+    int result;
+    char* copy;
+
+    if (pem == NULL)
+    {
+        LogError("invalid parameter: %s is NULL", name);
+        result = __FAILURE__;
+    }
+    else if (mallocAndStrcpy_s(&copy, pem) != 0)
+    {
+        LogError("unable to copy %s", name);
+        result = __FAILURE__;
+    }
+    else
+    {
+        char** field = is_key ? &tls_io_instance->x509_key : &tls_io_instance->x509_cert;
+        free(*field);
+        *field = copy;
+        result = 0;
+
+        if (tls_io_instance->x509_cert != NULL && tls_io_instance->x509_key != NULL)
+        {
+            int err;
+
+            mbedtls_x509_crt_free(&tls_io_instance->own_cert);
+            mbedtls_x509_crt_init(&tls_io_instance->own_cert);
+            mbedtls_pk_free(&tls_io_instance->own_key);
+            mbedtls_pk_init(&tls_io_instance->own_key);
+            if ((err = mbedtls_x509_crt_parse(&tls_io_instance->own_cert, (const unsigned char*)tls_io_instance->x509_cert, strlen(tls_io_instance->x509_cert) + 1)) != 0 ||
+                (err = mbedtls_pk_parse_key(&tls_io_instance->own_key, (const unsigned char*)tls_io_instance->x509_key, strlen(tls_io_instance->x509_key) + 1, NULL, 0)) != 0 ||
+                (err = mbedtls_ssl_conf_own_cert(&tls_io_instance->config, &tls_io_instance->own_cert, &tls_io_instance->own_key)) != 0)
+            {
+                log_mbedtls_error("client certificate", err);
+                result = __FAILURE__;
+            }
+        }
+    }
+    return result;
+}
+
+static int is_string_option(const char* name)
+{
+    return strcmp(name, OPTION_TRUSTED_CERT) == 0 ||
+           strcmp(name, SU_OPTION_X509_CERT) == 0 || strcmp(name, SU_OPTION_X509_PRIVATE_KEY) == 0 ||
+           strcmp(name, OPTION_X509_ECC_CERT) == 0 || strcmp(name, OPTION_X509_ECC_KEY) == 0;
+}
+
+static void set_watch(TLS_IO_INSTANCE* tls_io_instance, const TLSIO_SOCKET_WATCH* watch)
+{
+    int events = tls_io_instance->events;
+
+    // an open socket moves from the old callback to the new one
+    want(tls_io_instance, 0);
+    tls_io_instance->watch = *watch;
+    want(tls_io_instance, events);
+}
+
+static int is_int_option(const char* name)
+{
+    return strcmp(name, OPTION_TCP_KEEPALIVE) == 0 || strcmp(name, OPTION_TCP_KEEPALIVE_TIME) == 0 ||
+           strcmp(name, OPTION_TCP_KEEPALIVE_INTVL) == 0 || strcmp(name, OPTION_TCP_KEEPALIVE_PROBES) == 0;
+}
+
+// applies the tcp_keepalive options that were set to a new socket
+static void set_keepalive(TLS_IO_INSTANCE* tls_io_instance, int fd)
+{
+    if (tls_io_instance->keepalive >= 0 &&
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &tls_io_instance->keepalive, sizeof(int)) != 0)
+    {
+        LogError("unable to set SO_KEEPALIVE: %s", strerror(errno));
+    }
+    if (tls_io_instance->keepalive_time > 0 &&
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &tls_io_instance->keepalive_time, sizeof(int)) != 0)
+    {
+        LogError("unable to set TCP_KEEPIDLE: %s", strerror(errno));
+    }
+    if (tls_io_instance->keepalive_interval > 0 &&
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &tls_io_instance->keepalive_interval, sizeof(int)) != 0)
+    {
+        LogError("unable to set TCP_KEEPINTVL: %s", strerror(errno));
+    }
+    if (tls_io_instance->keepalive_probes > 0 &&
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &tls_io_instance->keepalive_probes, sizeof(int)) != 0)
+    {
+        LogError("unable to set TCP_KEEPCNT: %s", strerror(errno));
+    }
+}
+
+/*---- options ----*/
+
+static void* tlsio_mbedtls_clone_option(const char* name, const void* value)
+{
+    void* result = NULL;
+
+    if (name == NULL || value == NULL)
+    {
+        LogError("invalid parameter: name=%p value=%p", name, value);
+    }
+    else if (is_string_option(name))
+    {
+        if (mallocAndStrcpy_s((char**)&result, (const char*)value) != 0)
+        {
+            LogError("unable to clone %s", name);
+            result = NULL;
+        }
+    }
+    else if (strcmp(name, TLSIO_OPTION_SOCKET_WATCH) == 0)
+    {
+        if ((result = malloc(sizeof(TLSIO_SOCKET_WATCH))) == NULL)
+        {
+            LogError("unable to clone %s", name);
+        }
+        else
+        {
+            *(TLSIO_SOCKET_WATCH*)result = *(const TLSIO_SOCKET_WATCH*)value;
+        }
+    }
+    else if (is_int_option(name))
+    {
+        if ((result = malloc(sizeof(int))) == NULL)
+        {
+            LogError("unable to clone %s", name);
+        }
+        else
+        {
+            *(int*)result = *(const int*)value;
+        }
+    }
+    else
+    {
+        LogError("not handled option: %s", name);
+    }
+    return result;
+}
+
+static void tlsio_mbedtls_destroy_option(const char* name, const void* value)
+{
+    if (name != NULL && value != NULL && (is_string_option(name) || is_int_option(name) || strcmp(name, TLSIO_OPTION_SOCKET_WATCH) == 0))
+    {
+        free((void*)value);
+    }
+}
+
+static int tlsio_mbedtls_setoption(CONCRETE_IO_HANDLE tls_io, const char* optionName, const void* value)
+{
+    int result;
+    TLS_IO_INSTANCE* tls_io_instance = (TLS_IO_INSTANCE*)tls_io;
+
+    if (tls_io_instance == NULL || optionName == NULL)
+    {
+        LogError("invalid parameter: tls_io=%p optionName=%p", tls_io, optionName);
+        result = __FAILURE__;
+    }
+    else if (strcmp(optionName, OPTION_TRUSTED_CERT) == 0)
+    {
+        result = set_trusted_certs(tls_io_instance, (const char*)value);
+    }
+    else if (strcmp(optionName, TLSIO_OPTION_SOCKET_WATCH) == 0)
+    {
+        if (value == NULL)
+        {
+            LogError("invalid parameter: %s is NULL", optionName);
+            result = __FAILURE__;
+        }
+        else
+        {
+            set_watch(tls_io_instance, (const TLSIO_SOCKET_WATCH*)value);
+            result = 0;
+        }
+    }
+    else if (strcmp(optionName, SU_OPTION_X509_CERT) == 0 || strcmp(optionName, OPTION_X509_ECC_CERT) == 0)
+    {
+        result = set_client_cert(tls_io_instance, optionName, (const char*)value, 0);
+    }
+    else if (strcmp(optionName, SU_OPTION_X509_PRIVATE_KEY) == 0 || strcmp(optionName, OPTION_X509_ECC_KEY) == 0)
+    {
+        result = set_client_cert(tls_io_instance, optionName, (const char*)value, 1);
+    }
+    else if (is_int_option(optionName))
+    {
+        if (value == NULL)
+        {
+            LogError("invalid parameter: %s is NULL", optionName);
+            result = __FAILURE__;
+        }
+        else
+        {
+            int v = *(const int*)value;
+
+            if (strcmp(optionName, OPTION_TCP_KEEPALIVE) == 0)
+                tls_io_instance->keepalive = (v != 0);
+            else if (strcmp(optionName, OPTION_TCP_KEEPALIVE_TIME) == 0)
+                tls_io_instance->keepalive_time = v;
+            else if (strcmp(optionName, OPTION_TCP_KEEPALIVE_INTVL) == 0)
+                tls_io_instance->keepalive_interval = v;
+            else
+                tls_io_instance->keepalive_probes = v;
+            if (tls_io_instance->net.fd >= 0)
+            {
+                set_keepalive(tls_io_instance, tls_io_instance->net.fd);
+            }
+            result = 0;
+        }
+    }
+    else if (strcmp(optionName, OPTION_NET_INT_MAC_ADDRESS) == 0)
+    {
+        LogError("%s is not supported, the socket isn't bound to an interface", optionName);
+        result = __FAILURE__;
+    }
+    else
+    {
+        LogError("option not supported: %s", optionName);
+        result = __FAILURE__;
+    }
+    return result;
+}
+
+static int save_int_option(OPTIONHANDLER_HANDLE options, const char* name, const int* value)
+{
+    return (*value < 0 || OptionHandler_AddOption(options, name, value) == OPTIONHANDLER_OK) ? 0 : __FAILURE__;
+}
+
+static OPTIONHANDLER_HANDLE tlsio_mbedtls_retrieveoptions(CONCRETE_IO_HANDLE tls_io)
+{
+    OPTIONHANDLER_HANDLE result;
+    TLS_IO_INSTANCE* tls_io_instance = (TLS_IO_INSTANCE*)tls_io;
+
+    if (tls_io_instance == NULL)
+    {
+        LogError("invalid parameter: tls_io is NULL");
+        result = NULL;
+    }
+    else if ((result = OptionHandler_Create(tlsio_mbedtls_clone_option, tlsio_mbedtls_destroy_option, tlsio_mbedtls_setoption)) == NULL)
+    {
+        LogError("unable to OptionHandler_Create");
+    }
+    else if ((tls_io_instance->trusted_certs != NULL &&
+              OptionHandler_AddOption(result, OPTION_TRUSTED_CERT, tls_io_instance->trusted_certs) != OPTIONHANDLER_OK) ||
+             (tls_io_instance->x509_cert != NULL &&
+              OptionHandler_AddOption(result, SU_OPTION_X509_CERT, tls_io_instance->x509_cert) != OPTIONHANDLER_OK) ||
+             (tls_io_instance->x509_key != NULL &&
+              OptionHandler_AddOption(result, SU_OPTION_X509_PRIVATE_KEY, tls_io_instance->x509_key) != OPTIONHANDLER_OK) ||
+             save_int_option(result, OPTION_TCP_KEEPALIVE, &tls_io_instance->keepalive) != 0 ||
+             save_int_option(result, OPTION_TCP_KEEPALIVE_TIME, &tls_io_instance->keepalive_time) != 0 ||
+             save_int_option(result, OPTION_TCP_KEEPALIVE_INTVL, &tls_io_instance->keepalive_interval) != 0 ||
+             save_int_option(result, OPTION_TCP_KEEPALIVE_PROBES, &tls_io_instance->keepalive_probes) != 0 ||
+             (tls_io_instance->watch.callback != NULL &&
+              OptionHandler_AddOption(result, TLSIO_OPTION_SOCKET_WATCH, &tls_io_instance->watch) != OPTIONHANDLER_OK))
+    {
+        LogError("unable to save the options");
+        OptionHandler_Destroy(result);
+        result = NULL;
+    }
+    return result;
+}
+
+/*---- interface ----*/
+
+static CONCRETE_IO_HANDLE tlsio_mbedtls_create(void* io_create_parameters)
+{
+    TLSIO_CONFIG* tls_io_config = (TLSIO_CONFIG*)io_create_parameters;
+    TLS_IO_INSTANCE* result;
+
+    if (tls_io_config == NULL || tls_io_config->hostname == NULL)
+    {
+        LogError("invalid parameter: TLSIO_CONFIG or its hostname is NULL");
+        result = NULL;
+    }
+    else if ((result = (TLS_IO_INSTANCE*)calloc(1, sizeof(TLS_IO_INSTANCE))) == NULL)
+    {
+        LogError("unable to allocate the tlsio instance");
+    }
+    else if (mallocAndStrcpy_s(&result->hostname, tls_io_config->hostname) != 0)
+    {
+        LogError("unable to copy the hostname");
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        int err;
+
+        result->port = tls_io_config->port;
+        result->state = TLSIO_STATE_NOT_OPEN;
+        result->flow.port = result->port;
+        result->keepalive = result->keepalive_time = result->keepalive_interval = result->keepalive_probes = -1;
+
+        mbedtls_net_init(&result->net);
+        mbedtls_ssl_init(&result->ssl);
+        mbedtls_ssl_config_init(&result->config);
+        mbedtls_x509_crt_init(&result->trusted_chain);
+        mbedtls_x509_crt_init(&result->own_cert);
+        mbedtls_pk_init(&result->own_key);
+        mbedtls_entropy_init(&result->entropy);
+        mbedtls_ctr_drbg_init(&result->ctr_drbg);
+
+        if ((err = mbedtls_ctr_drbg_seed(&result->ctr_drbg, mbedtls_entropy_func, &result->entropy, (const unsigned char*)"azIoTClient", 11)) != 0 ||
+            (err = mbedtls_ssl_config_defaults(&result->config, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT)) != 0)
+        {
+            log_mbedtls_error("tlsio_mbedtls_create", err);
+            mbedtls_ssl_config_free(&result->config);
+            mbedtls_ctr_drbg_free(&result->ctr_drbg);
+            mbedtls_entropy_free(&result->entropy);
+            free(result->hostname);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            mbedtls_ssl_conf_authmode(&result->config, MBEDTLS_SSL_VERIFY_REQUIRED);
+            mbedtls_ssl_conf_rng(&result->config, mbedtls_ctr_drbg_random, &result->ctr_drbg);
+            mbedtls_ssl_conf_ca_chain(&result->config, &result->trusted_chain, NULL);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+            mbedtls_ssl_conf_session_tickets(&result->config, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+            if ((err = mbedtls_ssl_setup(&result->ssl, &result->config)) != 0 ||
+                (err = mbedtls_ssl_set_hostname(&result->ssl, result->hostname)) != 0)
+            {
+                log_mbedtls_error("mbedtls_ssl_setup", err);
+                mbedtls_ssl_free(&result->ssl);
+                mbedtls_ssl_config_free(&result->config);
+                mbedtls_ctr_drbg_free(&result->ctr_drbg);
+                mbedtls_entropy_free(&result->entropy);
+                free(result->hostname);
+                free(result);
+                result = NULL;
+            }
+        }
+    }
+    return result;
+}
+
+static void tlsio_mbedtls_destroy(CONCRETE_IO_HANDLE tls_io)
+{
+    TLS_IO_INSTANCE* tls_io_instance = (TLS_IO_INSTANCE*)tls_io;
+
+    if (tls_io_instance != NULL)
+    {
+        close_connection(tls_io_instance);
+        release_trusted_certs(tls_io_instance);
+        mbedtls_x509_crt_free(&tls_io_instance->own_cert);
+        mbedtls_pk_free(&tls_io_instance->own_key);
+        free(tls_io_instance->x509_cert);
+        free(tls_io_instance->x509_key);
+        mbedtls_ssl_free(&tls_io_instance->ssl);
+        mbedtls_ssl_config_free(&tls_io_instance->config);
+        mbedtls_ctr_drbg_free(&tls_io_instance->ctr_drbg);
+        mbedtls_entropy_free(&tls_io_instance->entropy);
+        free(tls_io_instance->hostname);
+        free(tls_io_instance);
+    }
+}
+
+// starts connecting to the next address that was resolved, 0 once a connect is under way
+static int connect_next(TLS_IO_INSTANCE* tls_io_instance)
+{
+    while (tls_io_instance->next_addr != NULL)
+    {
+        struct addrinfo* ai = tls_io_instance->next_addr;
+        int fd;
+
+        tls_io_instance->next_addr = ai->ai_next;
+        if ((fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol)) < 0)
+        {
+            continue;
+        }
+        set_keepalive(tls_io_instance, fd);
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 || errno == EINPROGRESS)
+        {
+            tls_io_instance->net.fd = fd;
+            want(tls_io_instance, TLSIO_WANT_WRITE);
+            return 0;
+        }
+        LogError("connect to %s failed: %s", tls_io_instance->hostname, strerror(errno));
+        close(fd);
+    }
+    return __FAILURE__;
+}
+
+static void open_failed(TLS_IO_INSTANCE* tls_io_instance, IO_OPEN_RESULT open_result)
+{
+    close_connection(tls_io_instance);
+    tls_io_instance->on_io_open_complete(tls_io_instance->on_io_open_complete_context, open_result);
+}
+
+static void start_handshake(TLS_IO_INSTANCE* tls_io_instance)
+{
+    TLSIO_SESSION* cached;
+
+    (void)pthread_mutex_lock(&tlsio_lock);
+    cached = find_session(tls_io_instance->hostname, tls_io_instance->port);
+    tls_io_instance->offered = 0;
+    if (cached != NULL && mbedtls_ssl_set_session(&tls_io_instance->ssl, &cached->session) == 0)
+    {
+        memcpy(tls_io_instance->offered_master, cached->session.master, sizeof(tls_io_instance->offered_master));
+        tls_io_instance->offered = 1;
+    }
+    tls_io_instance->handshake_bytes = wire_tx_bytes + wire_rx_bytes;
+    (void)pthread_mutex_unlock(&tlsio_lock);
+
+    clock_gettime(CLOCK_MONOTONIC, &tls_io_instance->handshake_start);
+    tls_io_instance->flow.tx_class = tls_io_instance->flow.rx_class = TLSIO_CLASS_OTHER;
+    tls_io_instance->flow.rx_left = 0;
+    tls_io_instance->wire_class = TLSIO_CLASS_HANDSHAKE;
+    mbedtls_ssl_set_bio(&tls_io_instance->ssl, tls_io_instance, wire_send, wire_recv, NULL);
+    tls_io_instance->state = TLSIO_STATE_HANDSHAKE;
+}
+
+// the socket is writable once the connect is complete, SO_ERROR says whether it succeeded
+static void continue_connect(TLS_IO_INSTANCE* tls_io_instance)
+{
+    struct pollfd pfd;
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    pfd.fd = tls_io_instance->net.fd;
+    pfd.events = POLLOUT;
+    if (poll(&pfd, 1, 0) <= 0)
+    {
+        return;
+    }
+    if (getsockopt(tls_io_instance->net.fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0)
+    {
+        LogError("connect to %s failed: %s", tls_io_instance->hostname, strerror(err != 0 ? err : errno));
+        drop_socket(tls_io_instance);
+        if (connect_next(tls_io_instance) != 0)
+        {
+            open_failed(tls_io_instance, IO_OPEN_ERROR);
+        }
+    }
+    else
+    {
+        freeaddrinfo(tls_io_instance->addrs);
+        tls_io_instance->addrs = tls_io_instance->next_addr = NULL;
+        start_handshake(tls_io_instance);
+    }
+}
+
+// runs the handshake as far as it can go without waiting on the socket
+static void continue_handshake(TLS_IO_INSTANCE* tls_io_instance)
+{
+    int err = mbedtls_ssl_handshake(&tls_io_instance->ssl);
+
+    if (err == MBEDTLS_ERR_SSL_WANT_READ)
+    {
+        want(tls_io_instance, TLSIO_WANT_READ);
+        return;
+    }
+    if (err == MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+        want(tls_io_instance, TLSIO_WANT_WRITE);
+        return;
+    }
+
+    tls_io_instance->wire_class = TLSIO_CLASS_OTHER;
+    settle_rx(tls_io_instance, TLSIO_CLASS_HANDSHAKE);
+    if (err != 0)
+    {
+        log_mbedtls_error("mbedtls_ssl_handshake", err);
+        (void)pthread_mutex_lock(&tlsio_lock);
+        handshake_stats.failed_count++;
+        forget_session(find_session(tls_io_instance->hostname, tls_io_instance->port));     // the next attempt does a full handshake
+        (void)pthread_mutex_unlock(&tlsio_lock);
+        open_failed(tls_io_instance, IO_OPEN_ERROR);
+    }
+    else
+    {
+        uint64_t bytes;
+
+        (void)pthread_mutex_lock(&tlsio_lock);
+        bytes = wire_tx_bytes + wire_rx_bytes - tls_io_instance->handshake_bytes;
+        // a resumed session (by ID or ticket) keeps its master secret, a full handshake derives a new one
+        if (tls_io_instance->offered &&
+            memcmp(tls_io_instance->ssl.session->master, tls_io_instance->offered_master, sizeof(tls_io_instance->offered_master)) == 0)
+        {
+            handshake_stats.resumed_count++;
+            handshake_stats.resumed_ms += elapsed_ms(&tls_io_instance->handshake_start);
+            handshake_stats.resumed_bytes += bytes;
+        }
+        else
+        {
+            handshake_stats.full_count++;
+            handshake_stats.full_ms += elapsed_ms(&tls_io_instance->handshake_start);
+            handshake_stats.full_bytes += bytes;
+        }
+        save_session(tls_io_instance);
+        (void)pthread_mutex_unlock(&tlsio_lock);
+
+        tls_io_instance->state = TLSIO_STATE_OPEN;
+        want(tls_io_instance, TLSIO_WANT_READ | TLSIO_OPEN);
+        tls_io_instance->on_io_open_complete(tls_io_instance->on_io_open_complete_context, IO_OPEN_OK);
+    }
+}
+
+//
+// Resolves the host and starts the connect, dowork completes the open.  A host that can't be resolved or
+// reached fails the open before this returns.
+//
+static int tlsio_mbedtls_open(CONCRETE_IO_HANDLE tls_io, ON_IO_OPEN_COMPLETE on_io_open_complete, void* on_io_open_complete_context,
+                              ON_BYTES_RECEIVED on_bytes_received, void* on_bytes_received_context, ON_IO_ERROR on_io_error, void* on_io_error_context)
+{
+    int result;
+    TLS_IO_INSTANCE* tls_io_instance = (TLS_IO_INSTANCE*)tls_io;
+
+    if (tls_io_instance == NULL || on_io_open_complete == NULL || on_bytes_received == NULL || on_io_error == NULL)
+    {
+        LogError("invalid parameter to tlsio_mbedtls_open");
+        result = __FAILURE__;
+    }
+    else if (tls_io_instance->state != TLSIO_STATE_NOT_OPEN)
+    {
+        LogError("tlsio_mbedtls_open called while already open");
+        result = __FAILURE__;
+    }
+    else
+    {
+        char port[8];
+        struct addrinfo hints;
+        int err;
+
+        tls_io_instance->on_io_open_complete = on_io_open_complete;
+        tls_io_instance->on_io_open_complete_context = on_io_open_complete_context;
+        tls_io_instance->on_bytes_received = on_bytes_received;
+        tls_io_instance->on_bytes_received_context = on_bytes_received_context;
+        tls_io_instance->on_io_error = on_io_error;
+        tls_io_instance->on_io_error_context = on_io_error_context;
+
+        clock_gettime(CLOCK_MONOTONIC, &tls_io_instance->open_start);
+        (void)snprintf(port, sizeof(port), "%d", tls_io_instance->port);
+        memset(&hints, 0x00, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_protocol = IPPROTO_TCP;
+        if ((err = getaddrinfo(tls_io_instance->hostname, port, &hints, &tls_io_instance->addrs)) != 0)
+        {
+            LogError("unable to resolve %s: %s", tls_io_instance->hostname, gai_strerror(err));
+            tls_io_instance->addrs = NULL;
+            open_failed(tls_io_instance, IO_OPEN_ERROR);
+        }
+        else
+        {
+            tls_io_instance->next_addr = tls_io_instance->addrs;
+            tls_io_instance->state = TLSIO_STATE_CONNECTING;
+            if (connect_next(tls_io_instance) != 0)
+            {
+                open_failed(tls_io_instance, IO_OPEN_ERROR);
+            }
+        }
+        result = 0;
+    }
+    return result;
+}
+
+static int tlsio_mbedtls_close(CONCRETE_IO_HANDLE tls_io, ON_IO_CLOSE_COMPLETE on_io_close_complete, void* callback_context)
+{
+    int result;
+    TLS_IO_INSTANCE* tls_io_instance = (TLS_IO_INSTANCE*)tls_io;
+
+    if (tls_io_instance == NULL)
+    {
+        LogError("invalid parameter: tls_io is NULL");
+        result = __FAILURE__;
+    }
+    else if (tls_io_instance->state == TLSIO_STATE_NOT_OPEN)
+    {
+        LogError("tlsio_mbedtls_close called while not open");
+        result = __FAILURE__;
+    }
+    else
+    {
+        int opening = (tls_io_instance->state == TLSIO_STATE_CONNECTING || tls_io_instance->state == TLSIO_STATE_HANDSHAKE);
+
+        close_connection(tls_io_instance);
+        if (opening)
+        {
+            tls_io_instance->on_io_open_complete(tls_io_instance->on_io_open_complete_context, IO_OPEN_CANCELLED);
+        }
+        if (on_io_close_complete != NULL)
+        {
+            on_io_close_complete(callback_context);
+        }
+        result = 0;
+    }
+    return result;
+}
+
+//
+// writes the whole buffer; the socket is non-blocking so if the socket buffer is full this waits (up to
+// TLSIO_SEND_TIMEOUT_MS) for it to drain
+//
+static int tlsio_mbedtls_send(CONCRETE_IO_HANDLE tls_io, const void* buffer, size_t size, ON_SEND_COMPLETE on_send_complete, void* callback_context)
+{
+    int result;
+    TLS_IO_INSTANCE* tls_io_instance = (TLS_IO_INSTANCE*)tls_io;
+
+    if (tls_io_instance == NULL || buffer == NULL || size == 0)
+    {
+        LogError("invalid parameter: tls_io=%p buffer=%p size=%u", tls_io, buffer, (unsigned int)size);
+        result = __FAILURE__;
+    }
+    else if (tls_io_instance->state != TLSIO_STATE_OPEN)
+    {
+        LogError("tlsio_mbedtls_send called while not open");
+        result = __FAILURE__;
+    }
+    else
+    {
+        const unsigned char* p = (const unsigned char*)buffer;
+        size_t left = size;
+
+        tls_io_instance->wire_class = classify(tls_io_instance, 1, p, size);
+        while (left > 0)
+        {
+            int n = mbedtls_ssl_write(&tls_io_instance->ssl, p, left);
+            if (n > 0)
+            {
+                p += n;
+                left -= n;
+            }
+            else if (n == MBEDTLS_ERR_SSL_WANT_WRITE || n == MBEDTLS_ERR_SSL_WANT_READ)
+            {
+                struct pollfd pfd;
+                pfd.fd = tls_io_instance->net.fd;
+                pfd.events = (n == MBEDTLS_ERR_SSL_WANT_WRITE) ? POLLOUT : POLLIN;
+                if (poll(&pfd, 1, TLSIO_SEND_TIMEOUT_MS) <= 0)
+                {
+                    LogError("tlsio_mbedtls_send timed out");
+                    break;
+                }
+            }
+            else
+            {
+                log_mbedtls_error("mbedtls_ssl_write", n);
+                break;
+            }
+        }
+        tls_io_instance->wire_class = TLSIO_CLASS_OTHER;
+
+        if (left > 0)
+        {
+            indicate_error(tls_io_instance);
+            result = __FAILURE__;
+        }
+        else
+        {
+            if (on_send_complete != NULL)
+            {
+                on_send_complete(callback_context, IO_SEND_OK);
+            }
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static void tlsio_mbedtls_dowork(CONCRETE_IO_HANDLE tls_io)
+{
+    TLS_IO_INSTANCE* tls_io_instance = (TLS_IO_INSTANCE*)tls_io;
+    unsigned char buffer[TLSIO_READ_CHUNK];
+
+    if (tls_io_instance == NULL)
+    {
+        return;
+    }
+    if (tls_io_instance->state == TLSIO_STATE_CONNECTING || tls_io_instance->state == TLSIO_STATE_HANDSHAKE)
+    {
+        if (elapsed_ms(&tls_io_instance->open_start) >= TLSIO_OPEN_TIMEOUT_MS)
+        {
+            LogError("timed out opening the connection to %s", tls_io_instance->hostname);
+            if (tls_io_instance->state == TLSIO_STATE_HANDSHAKE)
+            {
+                (void)pthread_mutex_lock(&tlsio_lock);
+                handshake_stats.failed_count++;
+                (void)pthread_mutex_unlock(&tlsio_lock);
+            }
+            open_failed(tls_io_instance, IO_OPEN_ERROR);
+            return;
+        }
+        if (tls_io_instance->state == TLSIO_STATE_CONNECTING)
+        {
+            continue_connect(tls_io_instance);
+        }
+        if (tls_io_instance->state == TLSIO_STATE_HANDSHAKE)
+        {
+            continue_handshake(tls_io_instance);
+        }
+    }
+    if (tls_io_instance->state != TLSIO_STATE_OPEN)
+    {
+        return;
+    }
+
+    for (;;)
+    {
+        int n = mbedtls_ssl_read(&tls_io_instance->ssl, buffer, sizeof(buffer));
+        if (n > 0)
+        {
+            settle_rx(tls_io_instance, classify(tls_io_instance, 0, buffer, n));
+            tls_io_instance->on_bytes_received(tls_io_instance->on_bytes_received_context, buffer, n);
+        }
+        else if (n == MBEDTLS_ERR_SSL_WANT_READ || n == MBEDTLS_ERR_SSL_WANT_WRITE)
+        {
+            break;
+        }
+        else
+        {
+            if (n != 0 && n != MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY)
+            {
+                log_mbedtls_error("mbedtls_ssl_read", n);
+            }
+            else
+            {
+                LogInfo("TLS connection closed by the server");
+            }
+            indicate_error(tls_io_instance);
+            break;
+        }
+    }
+}
+
+static const IO_INTERFACE_DESCRIPTION tlsio_mbedtls_interface_description =
+{
+    tlsio_mbedtls_retrieveoptions,
+    tlsio_mbedtls_create,
+    tlsio_mbedtls_destroy,
+    tlsio_mbedtls_open,
+    tlsio_mbedtls_close,
+    tlsio_mbedtls_send,
+    tlsio_mbedtls_dowork,
+    tlsio_mbedtls_setoption
+};
+
+const IO_INTERFACE_DESCRIPTION* tlsio_mbedtls_get_interface_description(void)
+{
+    return &tlsio_mbedtls_interface_description;
+}
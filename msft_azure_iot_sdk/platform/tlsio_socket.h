@@ -0,0 +1,96 @@
+// Copyright (c) 2018, James Flynn
+// Licensed under the MIT license.
+
+//
+// The local tlsio_mbedtls adapter talks to the TLS socket directly (there is no socketio layer underneath)
+// so that the application can wait on the socket instead of polling the IoT Hub client.  The application
+// sets a callback on the client (TLSIO_OPTION_SOCKET_WATCH) that is told what its connection's socket is
+// waiting for: readable or writable while connecting and during the handshake, readable once the connection
+// is open, and nothing when it is about to be closed.  The application runs IoTHubClient_LL_DoWork() when
+// the socket is ready.  Other connections (a blob upload) don't have the option and aren't reported.
+//
+// Everything else here is shared by all the connections and may be called from any thread.
+//
+
+#ifndef TLSIO_SOCKET_H
+#define TLSIO_SOCKET_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TLSIO_WANT_READ     0x01
+#define TLSIO_WANT_WRITE    0x02
+#define TLSIO_OPEN          0x04        // set from the end of the handshake on
+
+// 'events' are the TLSIO_ flags for the socket, 0 when it is about to be closed
+typedef void (*TLSIO_SOCKET_CALLBACK)(int fd, int events, void* context);
+
+typedef struct TLSIO_SOCKET_WATCH_TAG
+{
+    TLSIO_SOCKET_CALLBACK callback;
+    void*                 context;
+} TLSIO_SOCKET_WATCH;
+
+// the value is a TLSIO_SOCKET_WATCH*, which is copied; the transports pass options they don't know on to
+// the tlsio, except HTTP which runs its requests to completion within DoWork and doesn't need it
+#define TLSIO_OPTION_SOCKET_WATCH   "tlsio_socket_watch"
+
+// bytes written to / read from the sockets of all connections (TLS records, handshakes included)
+void tlsio_mbedtls_get_wire_bytes(uint64_t* tx_bytes, uint64_t* rx_bytes);
+void tlsio_mbedtls_reset_wire_bytes(void);
+
+// what the bytes on the wire were spent on
+typedef enum TLSIO_CLASS_TAG
+{
+    TLSIO_CLASS_OTHER = 0,      // connect, subscribe, closes and anything not recognised
+    TLSIO_CLASS_HANDSHAKE,      // TLS handshakes
+    TLSIO_CLASS_TELEMETRY,      // device-to-cloud messages and their acknowledgements
+    TLSIO_CLASS_C2D,            // cloud-to-device messages and direct methods, with their responses
+    TLSIO_CLASS_TWIN,
+    TLSIO_CLASS_KEEPALIVE,      // MQTT PINGREQ/PINGRESP
+    TLSIO_CLASS_POLLING,        // HTTP requests for cloud-to-device messages
+    TLSIO_CLASS_UPLOAD,         // file upload
+    TLSIO_CLASSES
+} TLSIO_CLASS;
+
+// kept per connection for the classify callback, which may update everything but the port
+typedef struct TLSIO_FLOW_TAG
+{
+    int      port;
+    int      tx_class;          // of the last data sent...
+    int      rx_class;          // ...and received
+    uint32_t rx_left;           // bytes of a received message still to come in later reads
+} TLSIO_FLOW;
+
+// returns the TLSIO_CLASS of plaintext about to be sent (tx != 0) or just decrypted, every record written for
+// it, or read to get it, is counted against that class
+typedef int (*TLSIO_CLASSIFY_CALLBACK)(TLSIO_FLOW* flow, int tx, const unsigned char* buf, size_t len, void* context);
+
+void tlsio_mbedtls_set_classify_callback(TLSIO_CLASSIFY_CALLBACK callback, void* context);
+// the wire bytes of each TLSIO_CLASS, cleared with the totals by tlsio_mbedtls_reset_wire_bytes()
+void tlsio_mbedtls_get_class_bytes(uint64_t tx_bytes[TLSIO_CLASSES], uint64_t rx_bytes[TLSIO_CLASSES]);
+
+// the last session with each host outlives the tlsio and is offered for resumption on the next connect
+typedef struct TLSIO_HANDSHAKE_STATS_TAG
+{
+    uint32_t full_count;        // handshakes that sent the certificate chain and did a key exchange
+    uint32_t resumed_count;     // abbreviated handshakes
+    uint32_t failed_count;
+    uint64_t full_ms;           // total time spent in each kind of handshake
+    uint64_t resumed_ms;
+    uint64_t full_bytes;        // total bytes exchanged (both directions) by each kind
+    uint64_t resumed_bytes;
+    uint32_t trust_store_parses; // times TrustedCerts PEM was parsed into an X.509 chain
+} TLSIO_HANDSHAKE_STATS;
+
+void tlsio_mbedtls_get_handshake_stats(TLSIO_HANDSHAKE_STATS* stats);
+void tlsio_mbedtls_forget_sessions(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TLSIO_SOCKET_H
@@ -0,0 +1,176 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   reactor.cpp
+*   @brief  member functions for the Reactor class.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "reactor.hpp"
+
+Reactor::Reactor() : epfd(-1), evfd(-1)
+{
+    for( int i=0; i<REACTOR_MAX_FDS; i++ )
+        handlers[i].fd = -1;
+}
+
+bool Reactor::open(void)
+{
+    struct epoll_event ev;
+
+    if( epfd >= 0 )
+        return true;
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if( epfd < 0 || evfd < 0 ) {
+        close();
+        return false;
+        }
+    memset(&ev, 0x00, sizeof(ev));
+    ev.events   = EPOLLIN;
+    ev.data.ptr = NULL;                      //NULL is the wake-up eventfd
+    if( epoll_ctl(epfd, EPOLL_CTL_ADD, evfd, &ev) ) {
+        close();
+        return false;
+        }
+    return true;
+}
+
+void Reactor::close(void)
+{
+    for( int i=0; i<REACTOR_MAX_FDS; i++ ) {
+        if( handlers[i].fd >= 0 && handlers[i].timer )     //the timers belong to the reactor
+            ::close(handlers[i].fd);
+        handlers[i].fd = -1;
+        }
+    if( evfd >= 0 )
+        ::close(evfd);
+    if( epfd >= 0 )
+        ::close(epfd);
+    evfd = epfd = -1;
+}
+
+Reactor::handler *Reactor::slot(int fd)
+{
+    for( int i=0; i<REACTOR_MAX_FDS; i++ )
+        if( handlers[i].fd == fd )
+            return &handlers[i];
+    return NULL;
+}
+
+bool Reactor::add(int fd, uint32_t events, bool timer, reactor_cb cb, void *ctx)
+{
+    struct epoll_event ev;
+    handler           *h;
+
+    if( epfd < 0 || fd < 0 || slot(fd) != NULL || (h = slot(-1)) == NULL )
+        return false;
+
+    memset(&ev, 0x00, sizeof(ev));
+    ev.events   = events;
+    ev.data.ptr = h;
+    if( epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) )
+        return false;
+    h->fd    = fd;
+    h->timer = timer;
+    h->cb    = cb;
+    h->ctx   = ctx;
+    return true;
+}
+
+bool Reactor::modify(int fd, uint32_t events)
+{
+    struct epoll_event ev;
+    handler           *h = slot(fd);
+
+    if( fd < 0 || h == NULL )
+        return false;
+    memset(&ev, 0x00, sizeof(ev));
+    ev.events   = events;
+    ev.data.ptr = h;
+    return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void Reactor::remove(int fd)
+{
+    handler *h = slot(fd);
+
+    if( fd < 0 || h == NULL )
+        return;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    h->fd = -1;
+}
+
+int Reactor::add_timer(int period_ms, reactor_cb cb, void *ctx)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if( fd < 0 )
+        return -1;
+    if( !set_timer(fd, period_ms) || !add(fd, EPOLLIN, true, cb, ctx) ) {
+        ::close(fd);
+        return -1;
+        }
+    return fd;
+}
+
+bool Reactor::set_timer(int fd, int period_ms)
+{
+    struct itimerspec its;
+
+    its.it_interval.tv_sec  = period_ms / 1000;
+    its.it_interval.tv_nsec = (period_ms % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+    return timerfd_settime(fd, 0, &its, NULL) == 0;
+}
+
+void Reactor::remove_timer(int fd)
+{
+    remove(fd);
+    if( fd >= 0 )
+        ::close(fd);
+}
+
+void Reactor::wake(void)
+{
+    uint64_t one = 1;
+
+    if( evfd >= 0 )
+        (void)!write(evfd, &one, sizeof(one));
+}
+
+int Reactor::run_once(int timeout_ms)
+{
+    struct epoll_event ev[REACTOR_MAX_FDS+1];
+    uint64_t           count;
+    int                i, n, ran=0;
+
+    n = epoll_wait(epfd, ev, REACTOR_MAX_FDS+1, timeout_ms);
+    for( i=0; i<n; i++ ) {
+        handler *h = (handler *)ev[i].data.ptr;
+
+        if( h == NULL ) {
+            (void)!read(evfd, &count, sizeof(count));
+            continue;
+            }
+        if( h->fd < 0 )                       //removed by an earlier callback
+            continue;
+        if( h->timer && read(h->fd, &count, sizeof(count)) != sizeof(count) )
+            continue;
+        h->cb(h->fd, ev[i].events, h->ctx);
+        ran++;
+        }
+    return ran;
+}
@@ -0,0 +1,67 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   reactor.hpp
+*   @brief  A small epoll based event loop.  File descriptors (the IoT Hub socket, UART2, timers) are added
+*           with a callback that is run when the descriptor is ready, and run_once() sleeps until at least one
+*           of them is.  Other threads (the buttons) call wake() to get the loop to re-check its state.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#ifndef __REACTOR_HPP__
+#define __REACTOR_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#define REACTOR_MAX_FDS   8
+
+typedef void (*reactor_cb)(int fd, uint32_t events, void *ctx);
+
+class Reactor {
+    private:
+        typedef struct handler_t {
+            int         fd;               //-1 when the slot is free
+            bool        timer;            //timerfd, the expiration count is read before the callback
+            reactor_cb  cb;
+            void       *ctx;
+            } handler;
+
+        int      epfd;
+        int      evfd;                    //eventfd used by wake()
+        handler  handlers[REACTOR_MAX_FDS];
+
+        handler *slot(int fd);
+        bool     add(int fd, uint32_t events, bool timer, reactor_cb cb, void *ctx);
+
+    public:
+        Reactor();
+        ~Reactor() { close(); }
+
+        bool open(void);
+        void close(void);
+
+        bool add(int fd, uint32_t events, reactor_cb cb, void *ctx=NULL) { return add(fd, events, false, cb, ctx); }
+        bool modify(int fd, uint32_t events);  //false if 'fd' hasn't been added
+        void remove(int fd);
+
+        //creates a periodic CLOCK_MONOTONIC timer, returns its fd or -1
+        int  add_timer(int period_ms, reactor_cb cb, void *ctx=NULL);
+        bool set_timer(int fd, int period_ms);
+        void remove_timer(int fd);
+
+        //may be called from any thread
+        void wake(void);
+
+        //waits up to timeout_ms (-1 = forever) for events and runs their callbacks, returns how many ran
+        int  run_once(int timeout_ms);
+};
+
+#endif // __REACTOR_HPP__
@@ -0,0 +1,165 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   report.cpp
+*   @brief  member functions for the Report class and the table describing each field of the standard report.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "report.hpp"
+
+//
+// The deadbands are chosen to be just larger than the noise of each sensor.  Strings and integers are
+// sent whenever they change.  The window statistics are different every report so they are always sent
+// when present.
+//
+static const field_desc report_fields[RF_COUNT] = {
+//    key                  type       prec fmt               db_abs  db_rel  always
+    { "ObjectName",        FT_STRING, 0,   NULL,             0.0,    0.0,    true  },
+    { "ObjectType",        FT_STRING, 0,   NULL,             0.0,    0.0,    true  },
+    { "Version",           FT_STRING, 0,   NULL,             0.0,    0.0,    false },
+    { "ReportingDevice",   FT_STRING, 0,   NULL,             0.0,    0.0,    false },
+    { "DeviceICCID",       FT_STRING, 0,   NULL,             0.0,    0.0,    false },
+    { "DeviceIMEI",        FT_STRING, 0,   NULL,             0.0,    0.0,    false },
+    { "ADC_value",         FT_FLOAT,  2,   NULL,             0.05,   0.0,    false },
+    { "last GPS fix",      FT_TIME,   0,   "%a %F %X",       300.0,  0.0,    false },
+    { "lat",               FT_FLOAT,  2,   NULL,             0.01,   0.0,    false },
+    { "long",              FT_FLOAT,  2,   NULL,             0.01,   0.0,    false },
+    { "Temperature",       FT_FLOAT,  2,   NULL,             0.5,    0.0,    false },
+    { "Board Moved",       FT_INT,    0,   NULL,             0.0,    0.0,    false },
+    { "Board Position",    FT_INT,    0,   NULL,             0.0,    0.0,    false },
+    { "Report Period",     FT_INT,    0,   NULL,             0.0,    0.0,    false },
+    { "TOD",               FT_TIME,   0,   "%a %F %X UTC",   0.0,    0.0,    true  },
+    { "Barometer",         FT_FLOAT,  2,   NULL,             0.0,    0.0005, false },
+    { "Humidity",          FT_FLOAT,  1,   NULL,             1.0,    0.0,    false },
+    { "ADC_stats",         FT_STATS,  2,   NULL,             0.0,    0.0,    true  },
+    { "Temperature_stats", FT_STATS,  2,   NULL,             0.0,    0.0,    true  },
+    { "Barometer_stats",   FT_STATS,  2,   NULL,             0.0,    0.0,    true  },
+    { "Humidity_stats",    FT_STATS,  1,   NULL,             0.0,    0.0,    true  },
+    };
+
+static uint32_t str_hash(const char *s)      //FNV-1a
+{
+    uint32_t h = 2166136261u;
+    while( *s ) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+        }
+    return h;
+}
+
+Report::Report() : keyframe_every(0), since_keyframe(0)
+{
+    memcpy(desc, report_fields, sizeof(desc));
+    memset(sent, 0x00, sizeof(sent));
+    memset(last_num, 0x00, sizeof(last_num));
+    memset(last_hash, 0x00, sizeof(last_hash));
+    clear();
+}
+
+void Report::clear(void)
+{
+    memset(val, 0x00, sizeof(val));
+}
+
+//
+// true if field 'f' has moved past its deadband since it was last sent
+//
+bool Report::changed(int f)
+{
+    double d;
+
+    if( !sent[f] )
+        return true;
+
+    switch( desc[f].type ) {
+        case FT_STRING:
+            return str_hash(val[f].str) != last_hash[f];
+
+        case FT_INT:
+            return val[f].num != last_num[f];
+
+        default:
+            d = fabs(val[f].num - last_num[f]);
+            if( desc[f].db_abs == 0.0 && desc[f].db_rel == 0.0 )
+                return d != 0.0;
+            if( desc[f].db_abs > 0.0 && d >= desc[f].db_abs )
+                return true;
+            if( desc[f].db_rel > 0.0 && d >= desc[f].db_rel * fabs(last_num[f]) )
+                return true;
+            return false;
+        }
+}
+
+void Report::write_stats(Encoder& enc, const agg_stats *a, int prec)
+{
+    enc.begin_map(5);
+    enc.key(0, "count").value((int)a->count);
+    enc.key(1, "min").value(a->min, prec);
+    enc.key(2, "max").value(a->max, prec);
+    enc.key(3, "mean").value(a->mean, prec);
+    enc.key(4, "stddev").value(a->stddev, prec+1);
+    enc.end_map();
+}
+
+void Report::write_field(Encoder& enc, int f)
+{
+    enc.key(f, desc[f].key);
+    switch( desc[f].type ) {
+        case FT_STRING:
+            enc.value(val[f].str);
+            last_hash[f] = str_hash(val[f].str);
+            break;
+        case FT_FLOAT:
+            enc.value(val[f].num, desc[f].prec);
+            break;
+        case FT_INT:
+            enc.value((int)val[f].num);
+            break;
+        case FT_TIME:
+            enc.value((time_t)val[f].num, desc[f].fmt);
+            break;
+        case FT_STATS:
+            write_stats(enc, &val[f].stats, desc[f].prec);
+            break;
+        }
+    last_num[f] = val[f].num;
+    sent[f] = true;
+}
+
+int Report::write(Encoder& enc)
+{
+    bool keyframe = true;
+    bool send[RF_COUNT];
+    int  n = 0;
+
+    if( keyframe_every ) {
+        keyframe = (since_keyframe == 0);
+        since_keyframe = (since_keyframe+1) % keyframe_every;
+        }
+
+    if( !keyframe )
+        set(RF_OBJECT_TYPE, "SensorDelta");
+
+    //decide what is being sent first, the binary encoders need the count up front
+    for( int f=0; f<RF_COUNT; f++ ) {
+        send[f] = val[f].present && (keyframe || desc[f].always || changed(f));
+        n += send[f];
+        }
+
+    enc.begin_map(n);
+    for( int f=0; f<RF_COUNT; f++ ) 
+        if( send[f] )
+            write_field(enc, f);
+    enc.end_map();
+    return n;
+}
@@ -0,0 +1,112 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   report.hpp
+*   @brief  The Report class holds the fields of the standard telemetry report and writes them out.  Each field
+*           has an entry in a table (key, type, precision and deadband) so the report can be sent in full or,
+*           when deadband reporting is enabled, with only the fields that moved past their threshold since they
+*           were last sent.  A full 'keyframe' report goes out every K reports so the cloud never loses state.
+*           Delta reports are sent with an ObjectType of "SensorDelta" so they can be told apart.
+*
+*           The report is written through an Encoder, text encoders use the key strings and the binary encoders
+*           use the field ID, which is the report_field value.  The IDs are part of the binary message format so
+*           new fields must only ever be added at the end of the list.
+*
+*           The _STATS fields carry the window statistics (aggregate.hpp) as a nested map of count, min, max,
+*           mean and stddev; the binary encoders use 0-4 as the keys of that map.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#ifndef __REPORT_HPP__
+#define __REPORT_HPP__
+
+#include <stdint.h>
+#include <time.h>
+
+#include "encoder.hpp"
+#include "aggregate.hpp"
+
+typedef enum report_field_t {
+    RF_OBJECT_NAME=0,
+    RF_OBJECT_TYPE,
+    RF_VERSION,
+    RF_DEVICE,
+    RF_ICCID,
+    RF_IMEI,
+    RF_ADC,
+    RF_GPS_FIX,
+    RF_LAT,
+    RF_LONG,
+    RF_TEMPERATURE,
+    RF_MOVED,
+    RF_POSITION,
+    RF_PERIOD,
+    RF_TOD,
+    RF_BAROMETER,
+    RF_HUMIDITY,
+    RF_ADC_STATS,
+    RF_TEMPERATURE_STATS,
+    RF_BAROMETER_STATS,
+    RF_HUMIDITY_STATS,
+    RF_COUNT
+    } report_field;
+
+typedef enum field_type_t { FT_STRING, FT_FLOAT, FT_INT, FT_TIME, FT_STATS } field_type;
+
+typedef struct field_desc_t {
+    const char *key;
+    field_type  type;
+    int         prec;        //digits after the decimal point (FT_FLOAT, FT_STATS)
+    const char *fmt;         //strftime format (FT_TIME)
+    double      db_abs;      //absolute deadband, 0 = not used
+    double      db_rel;      //relative deadband as a fraction of the last value sent, 0 = not used
+    bool        always;      //sent in every report, even a delta report
+    } field_desc;
+
+class Report {
+    private:
+        typedef struct field_value_t {
+            bool        present;
+            double      num;
+            const char *str;
+            agg_stats   stats;
+            } field_value;
+
+        field_desc  desc[RF_COUNT];
+        field_value val[RF_COUNT];
+        bool        sent[RF_COUNT];      //field has been sent at least once, last_num/last_hash hold a value
+        double      last_num[RF_COUNT];  //value last sent
+        uint32_t    last_hash[RF_COUNT]; //hash of the string last sent
+        int         keyframe_every;      //0 = deadband reporting off, every report is complete
+        int         since_keyframe;
+
+        bool changed(int f);
+        void write_stats(Encoder& enc, const agg_stats *a, int prec);
+        void write_field(Encoder& enc, int f);
+
+    public:
+        Report();
+
+        //K is the number of reports between complete keyframe reports, 0 turns deadband reporting off
+        void deadband_mode(int K) { keyframe_every = (K>0)? K:0; since_keyframe = 0; }
+        bool deadband_mode(void)  { return keyframe_every != 0; }
+        void set_deadband(report_field f, double abs, double rel) { desc[f].db_abs = abs; desc[f].db_rel = rel; }
+
+        void clear(void);
+        void set(report_field f, const char *s) { val[f].present = true; val[f].str = s; }
+        void set(report_field f, double v)      { val[f].present = true; val[f].num = v; }
+        void set(report_field f, int v)         { val[f].present = true; val[f].num = v; }
+        void set(report_field f, time_t t)      { val[f].present = true; val[f].num = (double)t; }
+        void set(report_field f, const agg_stats *a) { val[f].present = (a->count != 0); val[f].stats = *a; }
+
+        //writes the report, returns the number of fields written
+        int  write(Encoder& enc);
+};
+
+#endif // __REPORT_HPP__
@@ -0,0 +1,212 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   sampler.cpp
+*   @brief  the sampler_task waits on one timerfd per source and reads whichever sources are due, publishing
+*           the results as a snapshot. The slow i2c reads are done into a private copy first so the published
+*           snapshot is only 'busy' for the time it takes to copy it.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "iothub_client_ll.h"
+
+#include "led.hpp"
+#include "sampler.hpp"
+#include "azIoTClient.h"
+
+//
+// default periods: the ADC and LIS2DW12 are cheap to read, the Click sensors less so and GPS is mostly
+// unchanged between reads
+//
+static const struct {
+    const char *name;
+    int         period_ms;
+    } sources[SRC_COUNT] = {
+    { "adc",    1000  },
+    { "mems",   2000  },
+    { "baro",   5000  },
+    { "humid",  5000  },
+    { "gps",    20000 },
+    };
+
+int Sampler::default_period(int src)
+{
+    return sources[src].period_ms;
+}
+
+const char *Sampler::source_name(int src)
+{
+    return sources[src].name;
+}
+
+int Sampler::source(const char *name)
+{
+    for( int i=0; i<SRC_COUNT; i++ )
+        if( !strcmp(name, sources[i].name) )
+            return i;
+    return -1;
+}
+
+static void add_ms(struct timespec *t, int ms)
+{
+    t->tv_sec  += ms / 1000;
+    t->tv_nsec += (ms % 1000) * 1000000L;
+    if( t->tv_nsec >= 1000000000L ) {
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000L;
+        }
+}
+
+//
+// (re)starts the periodic timer of a source, the first deadline is 'phase_ms' from now
+//
+bool Sampler::arm(int src, int phase_ms)
+{
+    struct itimerspec its;
+
+    if( tfd[src] < 0 )
+        return true;
+    clock_gettime(CLOCK_MONOTONIC, &its.it_value);
+    add_ms(&its.it_value, phase_ms);
+    its.it_interval.tv_sec  = period_ms[src] / 1000;
+    its.it_interval.tv_nsec = (period_ms[src] % 1000) * 1000000L;
+    return timerfd_settime(tfd[src], TFD_TIMER_ABSTIME, &its, NULL) == 0;
+}
+
+bool Sampler::start(unsigned int click_modules)
+{
+    int phase = 0;
+
+    if( started )
+        return true;
+    clicks = click_modules;
+
+    for( int i=0; i<SRC_COUNT; i++ ) {
+        if( (i == SRC_BAROMETER && !(clicks & BAROMETER_CLICK)) || (i == SRC_HUMIDITY && !(clicks & HTS221_CLICK)) )
+            continue;
+        tfd[i] = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if( tfd[i] < 0 || !arm(i, phase) ) {
+            terminate();
+            return false;
+            }
+        phase += SAMPLE_STAGGER_MS;
+        }
+
+    sampler_on = started = true;
+    pthread_create(&sampler_thread, NULL, sampler_task, (void*)this);
+    return true;
+}
+
+void Sampler::terminate(void)
+{
+    int rval;
+
+    if( started ) {
+        sampler_on = false;
+        pthread_join(sampler_thread, (void**)&rval);
+        started = false;
+        }
+    for( int i=0; i<SRC_COUNT; i++ ) 
+        if( tfd[i] >= 0 ) {
+            close(tfd[i]);
+            tfd[i] = -1;
+            }
+}
+
+bool Sampler::set_period(int src, int ms)
+{
+    if( src < 0 || src >= SRC_COUNT || ms <= 0 )
+        return false;
+    period_ms[src] = ms;
+    return arm(src, ms);
+}
+
+void Sampler::accumulate(agg_field f, double v)
+{
+    if( !aggregating )
+        return;
+    pthread_mutex_lock(&agg_lock);
+    acc[f].add(v);
+    pthread_mutex_unlock(&agg_lock);
+}
+
+void Sampler::take_sample(int src)
+{
+    gpsstatus *loc;
+
+    switch( src ) {
+        case SRC_ADC:
+            work.adc = (float)*adc;
+            accumulate(AGG_ADC, work.adc);
+            break;
+
+        case SRC_MEMS:
+            work.temperature = mems->lis2dw12_getTemp();
+            work.position    = mems->lis2dw12_getPosition();
+            if( mems->movement_ocured() )
+                work.move_count++;
+            accumulate(AGG_TEMPERATURE, work.temperature);
+            break;
+
+        case SRC_BAROMETER:
+            work.pressure = barom->get_pressure();
+            accumulate(AGG_PRESSURE, work.pressure);
+            break;
+
+        case SRC_HUMIDITY:
+            work.humidity = humid->readHumidity();
+            accumulate(AGG_HUMIDITY, work.humidity);
+            break;
+
+        case SRC_GPS:
+            loc = gps->getLocation();
+            work.gps_pos = loc->last_pos;
+            work.gps_fix = loc->last_good;
+            break;
+        }
+
+    clock_gettime(CLOCK_REALTIME, &work.taken);
+    work.sample++;
+
+    seq.fetch_add(1, std::memory_order_relaxed);           //odd, readers will retry
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&snap, &work, sizeof(work));
+    seq.fetch_add(1, std::memory_order_release);           //even, snapshot is consistent
+}
+
+void *Sampler::sampler_task(void *thread)
+{
+    Sampler       *self = static_cast<Sampler *>(thread);
+    struct pollfd  pfd[SRC_COUNT];
+    int            src[SRC_COUNT];
+    int            i, n=0;
+    uint64_t       expired;
+
+    for( i=0; i<SRC_COUNT; i++ )
+        if( self->tfd[i] >= 0 ) {
+            pfd[n].fd     = self->tfd[i];
+            pfd[n].events = POLLIN;
+            src[n++]      = i;
+            }
+
+    while( self->sampler_on ) {
+        if( poll(pfd, n, SAMPLE_POLL_MS) <= 0 )
+            continue;
+        //a source that fell behind (expired > 1) is only read once, missed deadlines aren't caught up
+        for( i=0; i<n; i++ )
+            if( (pfd[i].revents & POLLIN) && read(pfd[i].fd, &expired, sizeof(expired)) == sizeof(expired) )
+                self->take_sample(src[i]);
+        }
+    pthread_exit(0);
+}
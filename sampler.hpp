@@ -0,0 +1,163 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   sampler.hpp
+*   @brief  The Sampler class runs a thread that reads the sensors that are present on their own schedules
+*           and publishes the readings as a time stamped snapshot.  Reading some sensors can block for a second
+*           or more (the HTS221 and LIS2DW12 poll status bits with sleep(1)) so report building and C2D replies
+*           should take the latest snapshot instead of going to the i2c bus themselves.
+*
+*           Each source (ADC, LIS2DW12, barometer, humidity, GPS) has its own period and a timerfd that fires
+*           on absolute CLOCK_MONOTONIC deadlines, so slow or power hungry sensors are read less often than the
+*           fast ones and a slow read doesn't make the others drift.  The first deadline of each source is
+*           staggered by SAMPLE_STAGGER_MS so sources with related periods don't all hit the i2c bus at once.
+*
+*           The snapshot is published with a sequence lock: the sampler thread is the only writer, readers
+*           never take a lock, they just retry the copy if the sampler was writing at the same time.
+*
+*           When aggregation is on each numeric reading is also added to a Welford accumulator, window() hands
+*           back the statistics since the last call and starts a new window.  Those do take a (short) lock since
+*           the reader resets them.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#ifndef __SAMPLER_HPP__
+#define __SAMPLER_HPP__
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+
+#include "adc.hpp"
+#include "lis2dw12.hpp"
+#include "barometer.hpp"
+#include "hts221.hpp"
+#include "gps.hpp"
+#include "aggregate.hpp"
+
+#define SAMPLE_STAGGER_MS  150     //offset between the first deadlines of each source
+#define SAMPLE_POLL_MS     500     //how long the thread waits before checking if it should stop
+
+//the sources the sampler schedules, each has its own period
+typedef enum sample_source_t {
+    SRC_ADC=0,
+    SRC_MEMS,                      //LIS2DW12 temperature, position and movement
+    SRC_BAROMETER,
+    SRC_HUMIDITY,
+    SRC_GPS,
+    SRC_COUNT
+    } sample_source;
+
+typedef struct sensor_snapshot_t {
+    struct timespec taken;         //CLOCK_REALTIME when the sample was completed
+    uint32_t        sample;        //number of samples taken so far, 0 if none yet
+    float           adc;
+    float           temperature;   //LIS2DW12 temperature, in F
+    int             position;      //Lis2dw12::position
+    uint32_t        move_count;    //incremented each time the LIS2DW12 reports the board moved
+    float           pressure;      //only valid with a Barometer Click
+    double          humidity;      //only valid with a Temp&Hum Click
+    latlong         gps_pos;
+    time_t          gps_fix;       //time of the last good GPS fix
+    } sensor_snapshot;
+
+class Sampler {
+    private:
+        Adc              *adc;
+        Lis2dw12         *mems;
+        Barometer        *barom;
+        Hts221           *humid;
+        Wncgps           *gps;
+
+        pthread_t         sampler_thread;
+        bool              sampler_on;
+        bool              started;
+        unsigned int      clicks;
+        int               period_ms[SRC_COUNT];
+        int               tfd[SRC_COUNT];     //timerfd of each source, -1 when the source isn't sampled
+
+        std::atomic<uint32_t> seq;     //odd while the snapshot is being written
+        sensor_snapshot   snap;
+        sensor_snapshot   work;        //only used by the sampler thread
+
+        bool              aggregating;
+        pthread_mutex_t   agg_lock;
+        Welford           acc[AGG_COUNT];
+
+        static void *sampler_task(void *thread);
+        void take_sample(int src);
+        void accumulate(agg_field f, double v);
+        bool arm(int src, int phase_ms);
+
+    public:
+        Sampler(Adc *a, Lis2dw12 *m, Barometer *b, Hts221 *h, Wncgps *g) :
+            adc(a),
+            mems(m),
+            barom(b),
+            humid(h),
+            gps(g),
+            sampler_on(false),
+            started(false),
+            clicks(0),
+            seq(0),
+            aggregating(false)
+            {
+            for( int i=0; i<SRC_COUNT; i++ ) {
+                period_ms[i] = default_period(i);
+                tfd[i] = -1;
+                }
+            memset(&snap, 0x00, sizeof(snap));
+            memset(&work, 0x00, sizeof(work));
+            pthread_mutex_init(&agg_lock, NULL);
+            }
+
+        ~Sampler() { pthread_mutex_destroy(&agg_lock); }
+
+        //click_modules tells the sampler which of the optional sensors are present, returns false if the
+        //timers couldn't be created
+        bool start(unsigned int click_modules);
+        void terminate(void);
+
+        //the period of a source can be changed at any time, it takes effect from now
+        bool set_period(int src, int ms);
+        void set_period(int ms) { for( int i=0; i<SRC_COUNT; i++ ) set_period(i, ms); }
+        int  period(int src)    { return period_ms[src]; }
+
+        static int         default_period(int src);
+        static const char *source_name(int src);
+        static int         source(const char *name);      //-1 if there is no source called 'name'
+
+        void aggregate(bool on) { aggregating = on; }
+        bool aggregate(void)    { return aggregating; }
+
+        //copies the statistics of the readings taken since the last call and starts a new window
+        void window(agg_stats out[AGG_COUNT]) {
+            pthread_mutex_lock(&agg_lock);
+            for( int i=0; i<AGG_COUNT; i++ ) {
+                acc[i].stats(&out[i]);
+                acc[i].reset();
+                }
+            pthread_mutex_unlock(&agg_lock);
+            }
+
+        //copies the latest snapshot, returns false if nothing has been sampled yet
+        bool get(sensor_snapshot *s) {
+            uint32_t s1, s2;
+            do {
+                s1 = seq.load(std::memory_order_acquire);
+                memcpy(s, &snap, sizeof(sensor_snapshot));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                s2 = seq.load(std::memory_order_relaxed);
+                } while( (s1 & 1) || s1 != s2 );
+            return s->sample != 0;
+            }
+};
+
+#endif // __SAMPLER_HPP__
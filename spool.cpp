@@ -0,0 +1,235 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   spool.cpp
+*   @brief  member functions for the Spool (store-and-forward) class.  The ring is kept consistent by writing a
+*           record's contents before its mark, and the mark before the header is updated, so a restart in the
+*           middle of a put() loses at most that one message.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "spool.hpp"
+
+bool Spool::open(const char *path, size_t capacity, bool evict_oldest)
+{
+    struct stat st;
+    void       *p;
+    bool        fresh;
+
+    close();
+    drop_oldest = evict_oldest;
+    capacity &= ~(size_t)3;
+    if( capacity < 1024 )
+        return false;
+
+    fd = ::open(path, O_RDWR | O_CREAT, 0644);
+    if( fd < 0 )
+        return false;
+
+    map_len = sizeof(spool_hdr) + capacity;
+    fresh = fstat(fd, &st) || (size_t)st.st_size != map_len;
+    if( fresh && ftruncate(fd, map_len) ) {
+        ::close(fd);
+        fd = -1;
+        return false;
+        }
+
+    p = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if( p == MAP_FAILED ) {
+        ::close(fd);
+        fd = -1;
+        return false;
+        }
+    hdr  = (spool_hdr*)p;
+    data = (unsigned char*)p + sizeof(spool_hdr);
+
+    if( fresh || !recover() )
+        init(capacity);
+    return true;
+}
+
+void Spool::close(void)
+{
+    if( hdr != NULL ) {
+        msync(hdr, map_len, MS_SYNC);
+        munmap(hdr, map_len);
+        hdr  = NULL;
+        data = NULL;
+        }
+    if( fd >= 0 ) {
+        ::close(fd);
+        fd = -1;
+        }
+}
+
+void Spool::init(uint32_t capacity)
+{
+    memset(hdr, 0x00, sizeof(spool_hdr));
+    hdr->magic    = SPOOL_MAGIC;
+    hdr->version  = SPOOL_VERSION;
+    hdr->capacity = capacity;
+}
+
+//
+// checks the header of an existing file and walks its records.  If the device was reset part way through an
+// update the ring is cut back to the last complete record.  Returns false if the file isn't a usable spool.
+//
+bool Spool::recover(void)
+{
+    uint32_t cap = map_len - sizeof(spool_hdr);
+    uint32_t off, used=0, n=0;
+
+    if( hdr->magic != SPOOL_MAGIC || hdr->version != SPOOL_VERSION || hdr->capacity != cap )
+        return false;
+    if( hdr->head >= cap || hdr->tail > cap || (hdr->head & 3) || (hdr->tail & 3) )
+        return false;
+
+    off = hdr->head;
+    while( n < hdr->count && used <= cap ) {
+        if( cap-off < sizeof(spool_rec) || rec_at(off)->mark == SPOOL_REC_WRAP ) {
+            used += cap-off;
+            off = 0;
+            continue;
+            }
+        spool_rec *r = rec_at(off);
+        if( r->mark != SPOOL_REC_VALID || r->len > cap || off+rec_size(r->len) > cap )
+            break;
+        used += rec_size(r->len);
+        off  += rec_size(r->len);
+        n++;
+        }
+    if( used > cap )
+        return false;
+
+    hdr->count = n;
+    hdr->tail  = off;
+    hdr->used  = used;
+    if( !n )
+        hdr->head = hdr->tail = hdr->used = 0;
+    return true;
+}
+
+//
+// moves the head past the gap at the end of the ring when the oldest record is at the start
+//
+void Spool::skip_wrap(void)
+{
+    uint32_t cap = hdr->capacity;
+
+    if( hdr->count && (cap-hdr->head < sizeof(spool_rec) || rec_at(hdr->head)->mark == SPOOL_REC_WRAP) ) {
+        hdr->used -= cap-hdr->head;
+        hdr->head  = 0;
+        }
+}
+
+void Spool::evict(void)
+{
+    pop();
+    hdr->dropped++;
+}
+
+bool Spool::put(const char *msg, size_t len, int samples, int fmt)
+{
+    uint32_t   need, gap;
+    bool       wrap;
+    spool_rec *r;
+
+    if( hdr == NULL )
+        return false;
+    need = rec_size(len);
+    if( need > hdr->capacity ) {
+        hdr->dropped++;
+        return false;
+        }
+
+    for(;;) {
+        wrap = (hdr->tail + need > hdr->capacity);
+        gap  = wrap? hdr->capacity - hdr->tail : 0;
+        if( hdr->capacity - hdr->used >= gap + need )
+            break;
+        if( !drop_oldest ) {
+            hdr->dropped++;
+            return false;
+            }
+        evict();
+        }
+
+    if( wrap ) {
+        if( gap >= sizeof(spool_rec) )
+            rec_at(hdr->tail)->mark = SPOOL_REC_WRAP;
+        hdr->used += gap;
+        hdr->tail  = 0;
+        }
+
+    r = rec_at(hdr->tail);
+    r->mark    = 0;
+    r->len     = len;
+    r->samples = (samples > 0xffff)? 0xffff : samples;
+    r->fmt     = fmt;
+    memcpy(r+1, msg, len);
+    __sync_synchronize();
+    r->mark    = SPOOL_REC_VALID;
+
+    hdr->tail += need;
+    hdr->used += need;
+    hdr->count++;
+    return true;
+}
+
+bool Spool::peek(const char **msg, size_t *len, int *samples, int *fmt)
+{
+    spool_rec *r;
+
+    if( hdr == NULL || !hdr->count )
+        return false;
+    skip_wrap();
+    r = rec_at(hdr->head);
+    *msg     = (const char*)(r+1);
+    *len     = r->len;
+    *samples = r->samples;
+    *fmt     = r->fmt;
+    return true;
+}
+
+void Spool::pop(void)
+{
+    uint32_t sz;
+
+    if( hdr == NULL || !hdr->count )
+        return;
+    skip_wrap();
+    sz = rec_size(rec_at(hdr->head)->len);
+    hdr->head += sz;
+    hdr->used -= sz;
+    if( !--hdr->count )
+        hdr->head = hdr->tail = hdr->used = 0;
+}
+
+bool Spool::burst_due(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if( (now.tv_sec - last_burst.tv_sec)*1000 + (now.tv_nsec - last_burst.tv_nsec)/1000000 < SPOOL_BURST_MS )
+        return false;
+    last_burst = now;
+    return true;
+}
+
+void Spool::sync(void)
+{
+    if( hdr != NULL )
+        msync(hdr, map_len, MS_ASYNC);
+}
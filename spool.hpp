@@ -0,0 +1,107 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   spool.hpp
+*   @brief  The Spool class is a store-and-forward queue for telemetry messages that could not be sent, either
+*           because the device is in Low Power Mode, the cellular link is down, or the IoT Hub client refused
+*           the message.  It is a ring buffer in a file on the M18Qx flash that is memory mapped, so storing a
+*           message is a memcpy and the queue survives a restart.  Messages are sent again, oldest first, in
+*           rate limited bursts once the connection returns.
+*
+*           When the ring is full the oldest message is evicted to make room, or (if drop_oldest is false) the
+*           new message is refused.
+*
+*           File layout: a spool_hdr followed by 'capacity' bytes of records.  Each record is a spool_rec
+*           followed by the message and padded to 4 bytes.  A record never wraps, if it doesn't fit before the
+*           end of the file a wrap marker is written and it goes at the start.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#ifndef __SPOOL_HPP__
+#define __SPOOL_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#define SPOOL_DEF_PATH      "/CUSTAPP/azIoTClient.spool"
+#define SPOOL_DEF_KBYTES    256          //default size of the record area
+#define SPOOL_BURST         4            //messages re-sent per burst...
+#define SPOOL_BURST_MS      1000         //...and the time between bursts
+
+#define SPOOL_MAGIC         0x4c4f4f50   //"POOL" in the file
+#define SPOOL_VERSION       1
+#define SPOOL_REC_VALID     0xa5
+#define SPOOL_REC_WRAP      0x5a
+
+typedef struct spool_hdr_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;      //bytes in the record area
+    uint32_t head;          //offset of the oldest record
+    uint32_t tail;          //offset the next record is written at
+    uint32_t count;         //records in the ring
+    uint32_t used;          //bytes in use, including record headers, padding and the wrap gap
+    uint32_t dropped;       //records evicted or refused since the file was created
+    } spool_hdr;
+
+typedef struct spool_rec_t {
+    uint32_t len;           //message length, not including this header or the padding
+    uint16_t samples;       //samples in the message (batches hold more than one)
+    uint8_t  fmt;           //caller defined, the encoder the message was written with
+    uint8_t  mark;          //SPOOL_REC_VALID or SPOOL_REC_WRAP, written last
+    } spool_rec;
+
+class Spool {
+    private:
+        int              fd;
+        spool_hdr       *hdr;
+        unsigned char   *data;
+        size_t           map_len;
+        bool             drop_oldest;
+        struct timespec  last_burst;
+
+        static uint32_t rec_size(size_t len) { return (sizeof(spool_rec) + len + 3) & ~3u; }
+
+        spool_rec *rec_at(uint32_t off) { return (spool_rec*)(data + off); }
+
+        void init(uint32_t capacity);
+        bool recover(void);
+        void skip_wrap(void);
+        void evict(void);
+
+    public:
+        Spool() : fd(-1), hdr(NULL), data(NULL), map_len(0), drop_oldest(true) { last_burst.tv_sec = 0; last_burst.tv_nsec = 0; }
+
+        ~Spool() { close(); }
+
+        //maps the spool file, creating it if needed; existing records are kept if the file is valid and the
+        //same size.  Returns false if the file can't be used, the spool is then disabled.
+        bool open(const char *path, size_t capacity, bool evict_oldest=true);
+        void close(void);
+
+        bool enabled(void) { return hdr != NULL; }
+        int  count(void)   { return hdr? hdr->count : 0; }
+        int  dropped(void) { return hdr? hdr->dropped : 0; }
+        bool empty(void)   { return !count(); }
+
+        //stores a message, returns false if it was refused (too big, or the spool is full and keeping the oldest)
+        bool put(const char *msg, size_t len, int samples, int fmt);
+
+        //the oldest message, the pointer is into the mapped file and is valid until pop()
+        bool peek(const char **msg, size_t *len, int *samples, int *fmt);
+        void pop(void);
+
+        //true once every SPOOL_BURST_MS, when another burst of stored messages may be sent
+        bool burst_due(void);
+
+        void sync(void);
+};
+
+#endif // __SPOOL_HPP__
@@ -0,0 +1,313 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   transport.cpp
+*   @brief  member functions for the Transport class.  Everything named worker below runs on the thread that
+*           owns the IoT Hub client, the rest is called by the application.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "iothub_client_ll.h"
+
+#include "transport.hpp"
+#include "linkstats.hpp"
+#include "tlsio_socket.h"
+
+bool iothub_connect(void);
+void iothub_watch_socket(TLSIO_SOCKET_CALLBACK callback, void *context);
+void iothub_dowork(void);
+bool sendMessage(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char* buffer, size_t size,
+                 const char* content_type, const char* content_encoding, void *payload, bool reply);
+
+extern IOTHUB_CLIENT_LL_HANDLE IoTHub_client_ll_handle;
+extern bool                    iothub_work;
+extern uint32_t                iothub_generation;
+extern LinkStats               link_stats;
+
+bool Transport::start(Reactor *app_loop, void (*tick_cb)(void), void (*closing_cb)(void))
+{
+    if( running )
+        return true;
+    app     = app_loop;
+    tick    = tick_cb;
+    closing = closing_cb;
+    if( !loop.open() || loop.add_timer(XPORT_TICK_MS, on_tick, this) < 0 ) {
+        loop.close();
+        return false;
+        }
+    running = true;
+    if( pthread_create(&thread, NULL, worker_task, (void*)this) ) {
+        running = false;
+        loop.close();
+        return false;
+        }
+    return true;
+}
+
+void Transport::stop(void)
+{
+    if( !running )
+        return;
+    running = false;
+    loop.wake();
+    pthread_join(thread, NULL);
+    loop.close();
+}
+
+bool Transport::send(const char *buf, size_t len, int samples, int fmt, const char *content_type,
+                     const char *content_encoding)
+{
+    return queue(XMSG_MESSAGE, buf, len, samples, fmt, content_type, content_encoding);
+}
+
+bool Transport::reply(const char *buf, size_t len)
+{
+    return queue(XMSG_REPLY, buf, len, 0, 0, NULL, NULL);
+}
+
+bool Transport::queue(int type, const char *buf, size_t len, int samples, int fmt, const char *content_type,
+                      const char *content_encoding)
+{
+    xport_msg m;
+
+    if( !ready() || (m.data = (char*)malloc(len)) == NULL )
+        return false;
+    memcpy(m.data, buf, len);
+    m.type             = type;
+    m.len              = len;
+    m.content_type     = content_type;
+    m.content_encoding = content_encoding;
+    m.samples          = samples;
+    m.fmt              = fmt;
+    m.method_id        = NULL;
+    m.status           = 0;
+    if( !outq.push(m) ) {
+        free(m.data);
+        return false;
+        }
+    loop.wake();
+    return true;
+}
+
+bool Transport::respond(void *method_id, uint32_t generation, int status, const char *buf, size_t len)
+{
+    xport_msg m;
+
+    if( !running || (m.data = (char*)malloc(len)) == NULL )
+        return false;
+    memcpy(m.data, buf, len);
+    m.type             = XMSG_METHOD_RESPONSE;
+    m.len              = len;
+    m.content_type     = m.content_encoding = NULL;
+    m.samples          = m.fmt = 0;
+    m.method_id        = method_id;
+    m.generation       = generation;
+    m.status           = status;
+    if( !outq.push(m) ) {
+        free(m.data);
+        return false;
+        }
+    loop.wake();
+    return true;
+}
+
+//
+// worker: hands the application a command that arrived
+//
+bool Transport::post_command(const char *cmd, size_t len, void *method_id)
+{
+    xport_cmd c;
+
+    if( (c.cmd = (char*)malloc(len+1)) == NULL )
+        return false;
+    memcpy(c.cmd, cmd, len);
+    c.cmd[len]   = '\0';
+    c.method_id  = method_id;
+    c.generation = iothub_generation;
+    if( !cmdq.push(c) ) {
+        free(c.cmd);
+        return false;
+        }
+    if( app != NULL )
+        app->wake();
+    return true;
+}
+
+//
+// worker: telemetry the client wouldn't take goes back to the application to be stored, command replies
+// are dropped
+//
+void Transport::bounce(xport_msg& m)
+{
+    if( m.samples > 0 && backq.push(m) ) {
+        if( app != NULL )
+            app->wake();
+        return;
+        }
+    if( m.samples > 0 )
+        printf("Telemetry not sent, %d sample(s) lost.\n", m.samples);
+    free(m.data);
+}
+
+//
+// worker: hands the queued messages to the client, as long as the in-flight window has room
+//
+void Transport::drain(void)
+{
+    xport_msg m;
+
+    while( holding || outq.pop(m) ) {
+        if( holding )
+            m = held;
+        if( (m.type == XMSG_MESSAGE && link_stats.window_full()) || (m.type == XMSG_REPLY && link_stats.replies_full()) ) {
+            held    = m;
+            holding = true;
+            return;
+            }
+        holding = false;
+
+        if( m.type == XMSG_METHOD_RESPONSE ) {
+            if( m.generation != iothub_generation )
+                printf("direct method response dropped, the client it was for is gone.\n");
+            else if( IoTHub_client_ll_handle == NULL ||
+                IoTHubClient_LL_DeviceMethodResponse(IoTHub_client_ll_handle, (METHOD_HANDLE)m.method_id,
+                                                     (const unsigned char*)m.data, m.len, m.status) != IOTHUB_CLIENT_OK )
+                printf("FAILED to send the direct method response!\n");
+            else
+                iothub_work = true;
+            free(m.data);
+            }
+        else {
+            //telemetry is kept until the hub confirms it, see confirmed()
+            xport_msg *keep = NULL;
+            if( m.samples > 0 && (keep=(xport_msg*)malloc(sizeof(xport_msg))) != NULL )
+                *keep = m;
+            if( IoTHub_client_ll_handle == NULL ||
+                !sendMessage(IoTHub_client_ll_handle, m.data, m.len, m.content_type, m.content_encoding, keep,
+                             m.type == XMSG_REPLY) ) {
+                free(keep);
+                bounce(m);
+                }
+            else if( keep == NULL )
+                free(m.data);
+            }
+        }
+}
+
+//
+// worker: the send confirmation of a telemetry message drain() kept.  Anything but OK (an error, a timeout,
+// or the client being destroyed with it still in flight) sends it back to be stored; after a timeout the hub
+// may have it already, the copy sent again has the same content but a new sequence number.
+//
+void Transport::confirmed(void *payload, bool ok)
+{
+    xport_msg *m = (xport_msg *)payload;
+
+    if( ok )
+        free(m->data);
+    else
+        bounce(*m);
+    free(m);
+}
+
+//
+// worker, once stopped: sends what is still queued and runs the client until the hub has confirmed all of it,
+// the link is down or XPORT_STOP_MS is up.  Destroying the client cancels whatever is still in flight, a
+// batch flushed on the way into LPM would otherwise never leave.
+//
+void Transport::flush(void)
+{
+    struct timespec start, now;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for( ;; ) {
+        drain();
+        iothub_dowork();
+        if( IoTHub_client_ll_handle == NULL || !link_stats.connected() || (!holding && !link_stats.pending()) )
+            return;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if( (now.tv_sec - start.tv_sec)*1000 + (now.tv_nsec - start.tv_nsec)/1000000 >= XPORT_STOP_MS ) {
+            printf("(----)%d message(s) not confirmed before the client was closed\n", link_stats.pending());
+            return;
+            }
+        loop.run_once(XPORT_STOP_POLL_MS);
+        }
+}
+
+//the socket is waited on for whatever the tlsio needs next, the connect and handshake included
+void Transport::on_socket(int fd, int events, void *ctx)
+{
+    Transport *self = static_cast<Transport *>(ctx);
+    uint32_t   ev = ((events & TLSIO_WANT_READ)? EPOLLIN : 0) | ((events & TLSIO_WANT_WRITE)? EPOLLOUT : 0);
+
+    if( !ev )
+        self->loop.remove(fd);
+    else if( !self->loop.modify(fd, ev) )
+        self->loop.add(fd, ev, on_ready, self);
+}
+
+void Transport::on_ready(int, uint32_t, void *)
+{
+    iothub_dowork();
+}
+
+void Transport::on_tick(int, uint32_t, void *ctx)
+{
+    Transport *self = static_cast<Transport *>(ctx);
+
+    if( self->running && self->tick != NULL )       //not while flushing at stop
+        self->tick();
+    iothub_dowork();
+}
+
+void *Transport::worker_task(void *obj)
+{
+    Transport *self = static_cast<Transport *>(obj);
+    xport_msg  m;
+
+    iothub_watch_socket(on_socket, self);
+    link_stats.restarted();
+    iothub_connect();                             //retried from the tick if it fails
+    self->client = (IoTHub_client_ll_handle != NULL);
+
+    while( self->running ) {
+        self->loop.run_once(-1);
+        self->drain();
+        if( iothub_work )
+            iothub_dowork();
+        self->client = (IoTHub_client_ll_handle != NULL);
+        }
+
+    //send what was queued before stopping, what the client doesn't take goes back to be stored
+    self->flush();
+    if( self->closing != NULL )
+        self->closing();
+    if( IoTHub_client_ll_handle != NULL ) {
+        IoTHubClient_LL_Destroy(IoTHub_client_ll_handle);
+        IoTHub_client_ll_handle = NULL;
+        }
+    link_stats.closed();
+    self->client = false;
+    if( self->holding ) {
+        self->holding = false;
+        self->bounce(self->held);
+        }
+    while( self->outq.pop(m) )
+        if( m.type != XMSG_METHOD_RESPONSE )
+            self->bounce(m);
+        else
+            free(m.data);
+    iothub_watch_socket(NULL, NULL);
+    return NULL;
+}
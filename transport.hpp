@@ -0,0 +1,123 @@
+/**
+* copyright (c) 2018, James Flynn
+* SPDX-License-Identifier: MIT
+*/
+
+/**
+*   @file   transport.hpp
+*   @brief  The Transport class runs the worker thread that owns the IoT Hub client.  Only this thread calls
+*           IoTHubClient_LL_DoWork() and the other IoTHubClient_LL functions, it sleeps in its own Reactor on
+*           the client's socket and a house keeping tick, so a slow sensor read, MAL call or the UART console
+*           can never hold up the network I/O or the MQTT keep-alives.
+*
+*           The application hands over outbound telemetry, command replies and direct method responses
+*           through a bounded lock-free MPSC queue and gets the commands that arrive (C2D messages and direct
+*           methods) back through another one, it is woken through its own Reactor when there are some.
+*           Telemetry the client refuses, that is still queued when the worker stops, or that the hub never
+*           confirms, comes back through a third queue so the application can store it in the spool.
+*
+*           While the in-flight window (see LinkStats) is full the worker leaves messages in the queue, once
+*           the queue is full send() fails and the caller stores the message instead.  Replies to C2D commands
+*           (reply()) are sent outside that window.
+*
+*   @author James Flynn
+*
+*   @date   17-Oct-2026
+*/
+
+#ifndef __TRANSPORT_HPP__
+#define __TRANSPORT_HPP__
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "mpsc.hpp"
+#include "reactor.hpp"
+
+#define XPORT_QUEUE_LEN   16       //outbound messages waiting for the worker
+#define XPORT_BACK_LEN    64       //refused telemetry: all of outq and everything in flight can come back at stop
+#define XPORT_CMD_LEN     8        //commands waiting for the application
+#define XPORT_TICK_MS     1000     //the worker's house keeping tick
+#define XPORT_STOP_MS     10000    //at stop, how long the worker waits for the hub to confirm what was sent
+#define XPORT_STOP_POLL_MS 100
+
+typedef enum xport_msg_type_t { XMSG_MESSAGE=0, XMSG_REPLY, XMSG_METHOD_RESPONSE } xport_msg_type;
+
+typedef struct xport_msg_t {
+    int          type;
+    char        *data;             //malloc'd copy, freed by whoever takes the message off a queue
+    size_t       len;
+    const char  *content_type;     //static strings, or NULL
+    const char  *content_encoding;
+    int          samples;          //telemetry samples, 0 for a command reply (not stored if refused)
+    int          fmt;              //the encoder, kept with the message if it is stored
+    void        *method_id;        //the METHOD_HANDLE of a direct method response...
+    uint32_t     generation;       //...the client it belongs to (iothub_generation)...
+    int          status;           //...and its status
+    } xport_msg;
+
+typedef struct xport_cmd_t {
+    char        *cmd;              //malloc'd "COMMAND argument", freed by the application
+    void        *method_id;        //NULL for a C2D message
+    uint32_t     generation;       //iothub_generation when it arrived, given back to respond()
+    } xport_cmd;
+
+class Transport {
+    private:
+        Reactor              loop;         //the worker's
+        Reactor             *app;          //the application's, woken for commands and refused telemetry
+        void               (*tick)(void);  //run on the worker every XPORT_TICK_MS...
+        void               (*closing)(void); //...and just before it destroys the client
+        pthread_t            thread;
+        std::atomic<bool>    running;
+        std::atomic<bool>    client;       //the worker has an IoT Hub client
+
+        MpscQueue<xport_msg, XPORT_QUEUE_LEN> outq;
+        MpscQueue<xport_msg, XPORT_BACK_LEN>  backq;
+        MpscQueue<xport_cmd, XPORT_CMD_LEN>   cmdq;
+        xport_msg            held;         //taken off outq, waiting for room in the in-flight window
+        bool                 holding;
+
+        static void *worker_task(void *obj);
+        static void  on_socket(int fd, int events, void *ctx);
+        static void  on_ready(int fd, uint32_t events, void *ctx);
+        static void  on_tick(int fd, uint32_t events, void *ctx);
+        void         drain(void);
+        void         flush(void);
+        void         bounce(xport_msg& m);
+        bool         queue(int type, const char *buf, size_t len, int samples, int fmt, const char *content_type,
+                           const char *content_encoding);
+
+    public:
+        Transport() : app(NULL), tick(NULL), closing(NULL), running(false), client(false), holding(false) { }
+        ~Transport() { stop(); }
+
+        //application side: starts the worker, which creates the client and connects
+        bool start(Reactor *app_loop, void (*tick_cb)(void), void (*closing_cb)(void)=NULL);
+        //sends what is queued, waits for it to be confirmed (at most XPORT_STOP_MS), destroys the client and
+        //waits for the worker to end
+        void stop(void);
+        bool ready(void) { return running && client; }
+
+        //false if there is no client or the queue is full, the message has not been taken
+        bool send(const char *buf, size_t len, int samples=0, int fmt=0, const char *content_type=NULL,
+                  const char *content_encoding=NULL);
+        //the reply to a C2D command, a D2C message that isn't telemetry
+        bool reply(const char *buf, size_t len);
+        //the response to a direct method, dropped if the client it came from has been re-created since
+        bool respond(void *method_id, uint32_t generation, int status, const char *buf, size_t len);
+
+        //the next command, the caller frees c->cmd
+        bool next_command(xport_cmd *c)  { return cmdq.pop(*c); }
+        //the next refused telemetry message, the caller frees m->data
+        bool next_refused(xport_msg *m)  { return backq.pop(*m); }
+
+        //worker side, from the IoT Hub client's callbacks; false if the command queue is full
+        bool post_command(const char *cmd, size_t len, void *method_id);
+        //the result of a message drain() sent, 'payload' is what it passed to sendMessage()
+        void confirmed(void *payload, bool ok);
+};
+
+#endif // __TRANSPORT_HPP__
@@ -8,7 +8,8 @@
 *   @brief  A class for manaing the WWAN LED on the WNC M18Qx board. This isn't a normal binary i/o
 *           LED and must be controlled through the linux driver. The class creates a thread that 
 *           runs every 500msec and checks to see if we have signal, are on-line, and have an ip 
-*           address and flashes at a different rate depending on which is true.
+*           address and flashes at a different rate depending on which is true.  The MAL requests are
+*           submitted without waiting, the LED is set from their replies.
 *
 *   @author James Flynn
 *
@@ -18,11 +19,17 @@
 #ifndef __WWAN_HPP__
 #define __WWAN_HPP__
 
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
 #include <chrono>
 #include <thread>
 
 #include "mal.hpp"
 
+#define WWAN_POLL_MS   2000
+#define WWAN_MAL_MS    5000       //each MAL request of a poll
+
 class Wwan {
     private:
         Mal*        malptr;
@@ -30,43 +37,13 @@ class Wwan {
         int         wwan_active;
         bool        wwan_on;
         bool        wwan_enable;
+        int         blink_cnt;
+        std::atomic<bool> poll_pending;   //a poll's MAL requests are out
 
-        char* get_ipAddr(json_keyval *kv, int kvsize) {
-            int  i;
-            char rstr[500];
-            char jcmd[] = "{ \"action\" : \"get_wwan_ipv4_network_ip\" }";
-
-            malptr->send_mal_command(jcmd, rstr, sizeof(rstr), true);
-            i = malptr->parse_maljson (rstr, kv, kvsize);
-            if( i < 0 )  //parse failed
-                return NULL;
-            else if( atoi(kv[1].value) ) // we got an error value back
-                return kv[2].value;      // so return error message
-            else
-                return kv[3].value;    
-            }
-
-        char *getOperatingMode(json_keyval *kv, int kvsize) {
-            int  i;
-            char rstr[100];
-            char jcmd[] = "{ \"action\" : \"get_operating_mode\" }";
-
-            malptr->send_mal_command(jcmd, rstr, sizeof(rstr), true);
-            i = malptr->parse_maljson (rstr, kv, kvsize);
-            if( i < 0 )  //parse failed
-                return NULL;
-            else if( atoi(kv[1].value) ) // we got an error value back
-                return kv[2].value;      // so return error message
-            else
-                return kv[3].value;    
-            }
-
-        int get_wwan_status( json_keyval *kv, int kvsize) {
-            char rstr[500];
-            char jcmd[] = "{ \"action\" : \"get_wwan_serving_system_status\" }";
-        
-            malptr->send_mal_command(jcmd, rstr, sizeof(rstr), true);
-            return malptr->parse_maljson (rstr, kv, kvsize);
+        bool ask(const char *action, mal_cb cb) {
+            char jcmd[80];
+            snprintf(jcmd, sizeof(jcmd), "{ \"action\" : \"%s\" }", action);
+            return malptr->submit(jcmd, true, WWAN_MAL_MS, cb, this);
             }
 
         void wwan_io(int onoff) {
@@ -76,43 +53,66 @@ class Wwan {
             close(fd);
             }
 
+        //
+        // a poll is a chain of replies on the MAL I/O thread: no IP goes on to ask for the operating mode,
+        // not on-line goes on to ask for the serving system
+        //
+        static void on_ip(int result, const MalReply *reply, void *ctx) {
+            Wwan       *self = static_cast<Wwan *>(ctx);
+            WwanStatus  st;
+
+            if( st.decode_ip(result, reply) && (st.ip.len != 7 || memcmp(st.ip.p, "0.0.0.0", 7)) ) {
+                self->wwan_io(1);                           //on-line with IP - no blink
+                self->poll_pending = false;
+                }
+            else if( !self->ask("get_operating_mode", on_mode) )
+                self->poll_pending = false;
+            }
+
+        static void on_mode(int result, const MalReply *reply, void *ctx) {
+            Wwan       *self = static_cast<Wwan *>(ctx);
+            WwanStatus  st;
+
+            if( st.decode_mode(result, reply) && st.mode == 0 ) {
+                self->wwan_io( self->wwan_on = !self->wwan_on );    //on-line no IP - fast blink
+                self->poll_pending = false;
+                }
+            else if( !self->ask("get_wwan_serving_system_status", on_status) )
+                self->poll_pending = false;
+            }
+
+        static void on_status(int result, const MalReply *reply, void *ctx) {
+            Wwan       *self = static_cast<Wwan *>(ctx);
+            WwanStatus  st;
+
+            if( st.decode_serving(result, reply) && st.service ) {
+                self->wwan_io( (self->blink_cnt>1)?0:1 );   //not on-line and no IP, but have signal - slow blink
+                ++self->blink_cnt %= 4;
+                }
+            else 
+                self->wwan_io(0);                           //nothing - off
+            self->poll_pending = false;
+            }
+
     protected:
         static void *wwan_task(void *thread) {
-            json_keyval om[20];
             Wwan  *self = static_cast<Wwan *>(thread);
-            char *ptr;
-            int   blink_cnt=0;
-            bool  wwan_on=false;
 
             while( self->wwan_active ) {
-                if( !self->wwan_enable ) {
-                    sleep(2);
-                    continue;
-                    }
-                ptr=self->get_ipAddr(om, sizeof(om));
-                if( strcmp(ptr,"0.0.0.0") )               //on-line with IP - no blink
-                    self->wwan_io(1);
-                else{
-                    ptr=self->getOperatingMode(om, sizeof(om)); //on-line no IP - fast blink
-                    if( !atoi(ptr) ) 
-                        self->wwan_io( wwan_on = !wwan_on );
-                    else{
-                        self->get_wwan_status(om, sizeof(om));
-                        if( atoi(om[6].value) ) {         //not on-line and no IP, but have signal - slow blink
-                            self->wwan_io( (blink_cnt>1)?0:1 );
-                            ++blink_cnt %= 4;
-                            }
-                        else 
-                            self->wwan_io(0);                   //nothing - off
-                        }
+                if( self->wwan_enable && !self->poll_pending ) {
+                    self->poll_pending = true;
+                    if( !self->ask("get_wwan_ipv4_network_ip", on_ip) )
+                        self->poll_pending = false;
                     }
-                sleep(2);
+                usleep(WWAN_POLL_MS*1000);
                 }
+            while( self->poll_pending )             //the chain still has to finish
+                usleep(10000);
             pthread_exit(0);
             }
 
     public:
-        Wwan(void) : wwan_active(true), wwan_enable(false) {
+        Wwan(void) : wwan_active(true), wwan_on(false), wwan_enable(false), blink_cnt(0), poll_pending(false) {
             malptr = Mal::get_mal();
             while( !malptr->mal_running() )
                 sleep(1);